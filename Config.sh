@@ -1,14 +1,14 @@
-#SELECT HARDWARE (ONE OF)
+#SELECT HARDWARE (ONE OR MORE OF, EG. "SIM;GPIOD")
 
 HARDWARE=DRY
 #HARDWARE=SIM
 #HARDWARE=COMEDI
 #HARDWARE=USPACE
 #HARDWARE=GPIOD
-#HARDWARE=IIO (TODO)
+#HARDWARE=IIO
 #HARDWARE=GPIOD
 
-cmake -S ./src/ -B build-lib -G "Ninja" -DHW=$HARDWARE \
+cmake -S ./src/ -B build-lib -G "Ninja" -DHW="$HARDWARE" \
 -DCMAKE_EXPORT_COMPILE_COMMANDS=1 
 
 cmake -S ./tst/ -B build-tst -G "Ninja" -DCMAKE_EXPORT_COMPILE_COMMANDS=1
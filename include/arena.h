@@ -0,0 +1,67 @@
+/*******************************************************************************
+ LibreLogic : a free PLC library
+ Copyright (C) 2022, Antonis K. (kalamara AT ceid DOT upatras DOT gr)
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _ARENA_H_
+#define _ARENA_H_
+
+#include <stddef.h>
+
+#define CACHELINE 64
+#define HUGEPAGE  0x200000 // 2MB
+
+/**
+ * @brief The arena struct
+ * a region that is reserved once and then handed out in cache line
+ * aligned slices, never freed piecemeal.
+ * An arena without a base only measures what would be taken from it.
+ */
+typedef struct arena {
+    unsigned char *base; // start of the region, NULL while measuring
+    size_t size;         // reserved bytes
+    size_t used;         // bytes handed out so far
+    int mode;            // bitmask of MEMORY_MODES
+    unsigned char mapped; // region was mapped rather than allocated
+    unsigned char locked; // region is locked in RAM
+} *arena_t;
+
+/**
+ * @brief reserve a zeroed region for an arena
+ * huge pages and locking are best effort, the arena falls back to 
+ * regular pages and to unlocked memory if they are not available
+ * @param the arena
+ * @param the size in bytes
+ * @param memory mode (bitmask of MEMORY_MODES)
+ * @return OK or error
+ */
+int arena_reserve(arena_t a, size_t size, int mode);
+
+/**
+ * @brief take a slice of an arena
+ * @param the arena
+ * @param the size in bytes
+ * @return a cache line aligned slice, or NULL if measuring or exhausted
+ */
+void *arena_take(arena_t a, size_t size);
+
+/**
+ * @brief release the whole region of an arena at once
+ * @param the arena
+ */
+void arena_release(arena_t a);
+
+#endif /* _ARENA_H_ */
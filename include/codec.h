@@ -0,0 +1,92 @@
+/*******************************************************************************
+ LibreLogic : a free PLC library
+ Copyright (C) 2022, Antonis K. (kalamara AT ceid DOT upatras DOT gr)
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _CODEC_H_
+#define _CODEC_H_
+
+/**
+ * @brief decode packed input words: apply forcing, 
+ * compute edges against the previous image
+ * @param raw input bytes, padded to whole words
+ * @param previous contact values
+ * @param digital inputs, I / RE / FE / EDGE are written
+ * @param number of words
+ * @return nonzero if any contact changed
+ */
+uint64_t decode_bits(const PLC_BYTE *raw,
+                     const uint64_t *prev,
+                     di_t di,
+                     unsigned int words);
+
+/**
+ * @brief add the edges caught between scans to the decoded ones,
+ * except for forced inputs
+ * @param rising edges, padded to whole words
+ * @param falling edges, padded to whole words
+ * @param digital inputs, RE / FE / EDGE are updated
+ * @param number of words
+ * @return nonzero if any edge was caught
+ */
+uint64_t latch_edges(const PLC_BYTE *rising,
+                     const PLC_BYTE *falling,
+                     di_t di,
+                     unsigned int words);
+
+/**
+ * @brief encode packed output words: apply set / reset and forcing,
+ * OR the result into the output bytes
+ * @param output bytes, padded to whole words
+ * @param digital outputs
+ * @param number of words
+ */
+void encode_bits(PLC_BYTE *raw, const do_t dq, unsigned int words);
+
+/**
+ * @brief convert raw analog samples to values, val = offset + raw * scale
+ * @param raw samples
+ * @param precomputed conversion
+ * @param values
+ * @param number of channels
+ */
+void decode_analog(const uint64_t *raw,
+                   const conv_t conv,
+                   double *val,
+                   unsigned int n);
+
+/**
+ * @brief convert analog values to raw samples, raw = (val - offset) * scale
+ * @param values
+ * @param precomputed conversion
+ * @param raw samples
+ * @param number of channels
+ */
+void encode_analog(const double *val,
+                   const conv_t conv,
+                   uint64_t *raw,
+                   unsigned int n);
+
+/**
+ * @brief precompute the conversion of one analog channel
+ * @param conversion
+ * @param channel
+ * @param analog channel with its limits
+ * @param TRUE for inputs (raw to value), FALSE for outputs
+ */
+void scale_analog(conv_t conv, unsigned int i, const aio_t io, PLC_BYTE input);
+
+#endif //_CODEC_H_
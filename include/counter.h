@@ -0,0 +1,107 @@
+/*******************************************************************************
+ LibreLogic : a free PLC library
+ Copyright (C) 2022, Antonis K. (kalamara AT ceid DOT upatras DOT gr)
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _COUNTER_H_
+#define _COUNTER_H_
+
+#include <pthread.h>
+#include <stdint.h>
+
+#define MAXCOUNTER 16
+
+struct hardware;
+
+/**
+ * @brief where the edges of a fast counter come from
+ */
+typedef enum {
+    COUNT_SCAN,     // rising edges seen by the scan, at most one per scan
+    COUNT_POLL,     // a thread polling the input between scans
+    COUNT_HARDWARE, // the count hook of the hardware
+} COUNT_SOURCES;
+
+/**
+ * @brief The counters struct
+ * fast counters: rising edges of designated digital inputs, 
+ * accumulated between scans and taken once per scan
+ */
+typedef struct counters {
+    unsigned int n;                     // number of counters
+    unsigned int input[MAXCOUNTER];     // the digital input of each
+    unsigned char reg[MAXCOUNTER];      // the memory register of each
+    unsigned char source[MAXCOUNTER];   // COUNT_SOURCES
+    unsigned char level[MAXCOUNTER];    // last level the poller read
+    uint64_t count[MAXCOUNTER];         // edges counted by the poller, atomic
+    uint64_t seen[MAXCOUNTER];          // count as of the last scan
+    long poll;                          // usec between polls, 0 for no poller
+    struct hardware *hw;
+    pthread_t thread;
+    pthread_mutex_t lock;               // hardware access, while the poller runs
+    int running;                        // the poller runs
+} *counters_t;
+
+/**
+ * @brief count the rising edges of an input into a register
+ * @param the counters
+ * @param the memory register, counted again if already there
+ * @param the digital input
+ * @return OK, or error if there are too many counters
+ */
+int counter_add(counters_t c, unsigned char reg, unsigned int input);
+
+/**
+ * @brief start counting: use the count hook of the hardware where
+ * it can count an input, else the poller if a poll period is set,
+ * else the scanned edges
+ * @param the counters
+ * @param the hardware
+ */
+void counter_start(counters_t c, struct hardware *hw);
+
+/**
+ * @brief stop the poller, if any
+ * @param the counters
+ */
+void counter_stop(counters_t c);
+
+/**
+ * @brief serialize a hardware access of the scan with the poller:
+ * the hooks of a backend are not safe to call concurrently.
+ * fetch and flush may block, so they are left out, 
+ * and a backend guards what they share with dio_read itself.
+ * A no-op when no poller runs.
+ * @param the counters
+ */
+void counter_lock(counters_t c);
+
+/**
+ * @brief end a hardware access of the scan
+ * @param the counters
+ */
+void counter_unlock(counters_t c);
+
+/**
+ * @brief take the edges a counter accumulated since the last scan
+ * @param the counters
+ * @param the index of the counter
+ * @param the rising edges of the scan, packed
+ * @return number of edges
+ */
+uint64_t counter_take(counters_t c, unsigned int k, const uint64_t *re);
+
+#endif //_COUNTER_H_
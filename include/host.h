@@ -0,0 +1,68 @@
+/*******************************************************************************
+ LibreLogic : a free PLC library
+ Copyright (C) 2022, Antonis K. (kalamara AT ceid DOT upatras DOT gr)
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _HOST_H_
+#define _HOST_H_
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "plclib.h"
+
+/**
+ * @brief The hosted struct
+ * a PLC run by a host, with its own cycle deadline
+ */
+struct hosted {
+    plc_t plc;
+    uint64_t due;           // usec, monotonic: when its next scan is due
+    unsigned int scans;     // scans so far
+    unsigned int overruns;  // deadlines missed by a cycle time or more
+};
+
+/**
+ * @brief The host_queue struct
+ * the PLCs a worker owns, which other workers steal from when idle
+ */
+struct host_queue {
+    pthread_mutex_t lock;
+    unsigned int *slots;    // indices of the hosted PLCs
+    unsigned int size;
+    struct host *host;
+    unsigned int self;      // index of the worker
+};
+
+/**
+ * @brief The host struct
+ * worker threads that scan PLCs when they are due. 
+ * A PLC is in the queue of at most one worker, or being scanned 
+ * by the worker that took it, so it is never scanned concurrently.
+ */
+struct host {
+    pthread_t *threads;
+    unsigned int n;             // number of workers
+    unsigned int started;       // workers running
+    struct host_queue *queues;  // one per worker
+    struct hosted *plcs;
+    unsigned int size;          // number of hosted PLCs
+    pthread_mutex_t lock;
+    pthread_cond_t wake;        // idle workers sleep on it until a deadline
+    int quit;
+};
+
+#endif //_HOST_H_
@@ -24,12 +24,99 @@ typedef enum {
     HW_COMEDI,
     HW_USPACE, // TODO: update with current linux kernels
     HW_GPIOD,
-    HW_IIO,    // TODO Linux industrial I/O
+    HW_IIO,    // Linux industrial I/O
     HW_USB,    // TODO FAR IN THE FUTURE
     HW_EXT,    // external hardware
+    HW_TRACE,  // record and replay of I/O traces
     N_HW
 } HARDWARES;
 
+typedef enum {
+    MEM_HEAP     = 0x0, // one allocation per register array
+    MEM_ARENA    = 0x1, // the whole process image in one cache aligned arena
+    MEM_HUGEPAGE = 0x2, // back the arena with huge pages if possible
+    MEM_LOCKED   = 0x4, // lock the arena in RAM if possible
+} MEMORY_MODES;
+
+typedef enum {
+    REG_DI, // digital input
+    REG_DQ, // digital output
+    REG_AI, // analog input
+    REG_AQ, // analog output
+    REG_M,  // memory counter value
+    REG_MR, // real memory register
+    REG_T,  // timer output
+    REG_S,  // blinker output
+    N_REG
+} REGISTERS;
+
+/**
+ * @brief a register that changed during the last cycle
+ */
+typedef struct change {
+    uint32_t reg;   // enum REGISTERS
+    uint32_t index; // index of the register
+    uint64_t u;     // new value of a digital, counter, timer or blinker register
+    double r;       // new value of an analog or real register
+} *change_t;
+
+typedef enum {
+    REQ_FORCE,   // force an input or output to a value
+    REQ_UNFORCE, // release a forced input or output
+    REQ_WRITE,   // write a value to a memory register
+    N_REQ
+} REQUESTS;
+
+/**
+ * @brief a consistent copy of the process image of a PLC,
+ * as of the end of a cycle
+ */
+typedef struct snapshot {
+    uint64_t cycle;     // number of cycles published before it
+    unsigned int size;  // number of words copied
+    uint64_t *di;       // digital inputs, packed
+    uint64_t *dq;       // digital outputs, packed
+    double *ai;         // analog inputs
+    double *aq;         // analog outputs
+    uint64_t *m;        // counter values
+    double *mr;         // real registers
+    uint64_t *t;        // timer values
+    uint64_t *t_q;      // timer outputs, packed
+    uint64_t *s_q;      // blinker outputs, packed
+} *snapshot_t;
+
+enum {
+    SHARED_MAGIC = 0x4c4c5049,  // "LLPI", set once the segment is ready
+    SHARED_VERSION = 1          // of the layout below
+};
+
+/**
+ * @brief header of the shared memory segment of a PLC.
+ * The image follows at its offset, as in struct snapshot,
+ * with reals stored as their bits. 
+ * The sequence number is odd while the image is written: 
+ * readers load it (acquire), copy the image, and retry 
+ * if it was odd or changed. 
+ * The request queue follows at its offset.
+ */
+typedef struct shared_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;      // bytes of the segment
+    uint32_t words;     // words of the image
+    uint32_t image;     // offset of the image
+    uint32_t requests;  // offset of the request queue
+    uint32_t ni;        // the sizes of the PLC, as in plc_new()
+    uint32_t nq;
+    uint32_t nai;
+    uint32_t naq;
+    uint32_t nt;
+    uint32_t ns;
+    uint32_t nm;
+    uint32_t nmr;
+    uint64_t seq;       // twice the number of images published
+} *shared_header_t;
+
 typedef struct config_uspace {
     uint32_t base;
     uint8_t write;
@@ -45,14 +132,54 @@ typedef struct config_sim {
     uint32_t adc_size;
     uint32_t dac_size;
     const char *label;
+    const char *shm;      // shared memory of a plant model to use instead of the files
+    uint32_t lockstep_ms; // nonzero to wait up to this long for each plant step
 } *conf_sim_t;
 
+enum {
+    SIM_MAGIC = 0x4c4c5053,  // "LLPS", set once the region is ready
+    SIM_VERSION = 1          // of the layout below
+};
+
+/**
+ * @brief header of the shared memory region a simulation exchanges 
+ * its I/O through with a plant model.
+ * The input bytes, output bytes, analog input and analog output words
+ * follow at their offsets.
+ * Each side publishes its half under a sequence number, 
+ * odd while it is written, that the other side can wait on as a futex: 
+ * the plant writes the inputs under in_seq, the PLC the outputs under out_seq.
+ * In lock step, each scan of the PLC waits for a new step of the plant.
+ */
+typedef struct sim_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;      // bytes of the region
+    uint32_t ni;        // bytes
+    uint32_t nq;
+    uint32_t nai;       // 64 bit words
+    uint32_t naq;
+    uint32_t inputs;    // offsets
+    uint32_t outputs;
+    uint32_t adc;
+    uint32_t dac;
+    uint32_t lockstep;  // nonzero if the PLC waits for the plant
+    uint32_t in_seq;    // steps of the plant, twice
+    uint32_t out_seq;   // scans of the PLC, twice
+} *sim_header_t;
+
 typedef struct config_comedi {
     uint32_t file;
     uint8_t sub_i;
     uint8_t sub_q;
     uint8_t sub_adc;
     uint8_t sub_dac;
+    uint32_t in_size;  // bytes, 0 for every channel of the subdevice
+    uint32_t out_size;
+    uint32_t adc_size; // channels, 0 for every channel of the subdevice
+    uint32_t dac_size;
+    uint32_t stream_ns;  // scan period of streamed analog inputs, 0 reads them every cycle
+    uint8_t stream_mean; // 1 averages the scans streamed since the last cycle, 0 keeps the newest
     const char *label;
 } *conf_comedi_t;
 
@@ -63,16 +190,47 @@ typedef struct config_gpiod {
     uint32_t in_size;
     uint32_t out_size;
     const char *label;
+    uint32_t events; // nonzero to catch input edges between scans
 } *conf_gpiod_t;
 
-typedef int (*helper_f)(); // generic helper functions only return an error code
+typedef struct config_iio {
+    const char *root;    // prefix of /sys and /dev, NULL for the system's own
+    uint32_t adc_device; // N of the iio:deviceN that captures the analog inputs
+    uint32_t dac_device; // and of the one with the analog outputs
+    const char *trigger; // of the capture, NULL to keep the current one
+    uint32_t buffer;     // scans the capture buffer holds, 0 for its length as is
+    uint32_t adc_size;   // channels, 0 for every scan element
+    uint32_t dac_size;   // channels, 0 for every out_voltage
+    const char *label;
+} *conf_iio_t;
+
+struct hardware; // every hook gets the instance it belongs to
+
+typedef struct config_trace {
+    const char *path;        // of the trace
+    uint8_t replay;          // 0 records the device, 1 replays the trace instead
+    struct hardware *device; // the hardware recorded
+    uint32_t in_size;        // bytes, when recording: a replay takes them from the trace
+    uint32_t out_size;
+    uint32_t adc_size;
+    uint32_t dac_size;
+    const char *label;
+} *conf_trace_t;
+
+typedef int (*helper_f)(struct hardware*); // generic helper functions only return an error code
 
-typedef void (*dio_rd_f)(unsigned int, unsigned char*);
-typedef void (*dio_wr_f)(const unsigned char*, unsigned int, unsigned char);
-typedef void (*dio_bit_f)(const unsigned char*, unsigned char*);
-typedef void (*data_rd_f)(unsigned int, uint64_t*);
-typedef void (*data_wr_f)(unsigned int, uint64_t);
-typedef int (*config_f)(void*);
+typedef void (*dio_rd_f)(struct hardware*, unsigned int, unsigned char*);
+typedef void (*dio_wr_f)(struct hardware*, const unsigned char*, unsigned int, unsigned char);
+typedef void (*dio_bit_f)(struct hardware*, const unsigned char*, unsigned char*, unsigned int);
+typedef void (*dio_rd_bytes_f)(struct hardware*, unsigned int, unsigned char*);
+typedef void (*dio_wr_bytes_f)(struct hardware*, unsigned int, const unsigned char*);
+typedef void (*dio_edges_f)(struct hardware*, unsigned int, unsigned char*, unsigned char*);
+typedef int (*count_f)(struct hardware*, unsigned int, uint64_t*);
+typedef void (*data_rd_f)(struct hardware*, unsigned int, uint64_t*);
+typedef void (*data_wr_f)(struct hardware*, unsigned int, uint64_t);
+typedef int (*config_f)(struct hardware*, void*);
+typedef int (*wait_f)(struct hardware*, long);
+typedef uint64_t (*clock_f)(struct hardware*);
 
 typedef struct hardware {
     int type;
@@ -100,7 +258,8 @@ typedef struct hardware {
      */
     helper_f flush;
     /**
-     * @brief read digital input
+     * @brief read digital input. 
+     * A fast counter poller may call it while fetch or flush runs
      * @param index
      * @param value
      */
@@ -113,11 +272,43 @@ typedef struct hardware {
      */
     dio_wr_f dio_write;
     /**
-     * @brief read / write binary mask to digital input / output
+     * @brief write the output bits set in mask, keeping the others,
+     * then read the inputs into bits
      * @param mask
      * @param bits
+     * @param number of bytes
      */
     dio_bit_f dio_bitfield;
+    /**
+     * @brief optional: read digital input bytes at once, 
+     * instead of calling dio_read for each bit
+     * @param number of bytes
+     * @param the bytes
+     */
+    dio_rd_bytes_f dio_read_bytes;
+    /**
+     * @brief optional: write digital output bytes at once,
+     * instead of calling dio_write for each bit
+     * @param number of bytes
+     * @param the bytes
+     */
+    dio_wr_bytes_f dio_write_bytes;
+    /**
+     * @brief optional: the input edges caught since the last call,
+     * so that pulses shorter than a scan are not lost
+     * @param number of bytes
+     * @param the rising edges, a bit per input
+     * @param the falling edges
+     */
+    dio_edges_f dio_edges;
+    /**
+     * @brief optional: rising edges counted on a digital input 
+     * since the hardware was enabled
+     * @param input index
+     * @param the count
+     * @return error code if the input cannot be counted
+     */
+    count_f count;
     /**
      * @brief read analog sample
      * @param the index
@@ -136,6 +327,30 @@ typedef struct hardware {
      * @param the configuration
      */
     config_f configure;
+
+    /**
+     * @brief optional: block until an input may have changed
+     * @param longest time to wait in msec, negative to wait indefinitely
+     * @return 1 on an input event, 0 on timeout, error code otherwise
+     */
+    wait_f wait;
+    /**
+     * @brief optional: the time of the scan about to start, 
+     * instead of the system's, eg. as it was recorded
+     * @return monotonic time in msec
+     */
+    clock_f clock;
+    /**
+     * @brief optional: release everything the instance holds,
+     * enabled or not, before plc_free_hardware frees its state
+     * @return error code
+     */
+    helper_f release;
+    
+    /**
+     * state of the instance, owned by the backend
+     */
+    void *priv;
 } *hardware_t;
 
 /**
@@ -185,6 +400,15 @@ int plc_init(plc_t p);
  */
 plc_t plc_func(plc_t p);
 
+/**
+ * @brief PLC scan cycle without pacing: 
+ * it neither sleeps for the cycle time nor waits for events, 
+ * for hosts that schedule the cycles of several PLCs themselves
+ * @param the PLC
+ * @return PLC with updated state
+ */
+plc_t plc_scan(plc_t p);
+
 /**
  * @brief construct a new plc with a configuration
  * @param number of digital inputs
@@ -202,13 +426,72 @@ plc_t plc_func(plc_t p);
  */
 plc_t plc_new(int di, int dq, int ai, int aq, int nt, int ns, int nm, int nr, int step, hardware_t hw);
 
+/**
+ * @brief construct a new plc with a configuration and a memory mode.
+ * plc_new() lays out the whole process image in one arena
+ * @param number of digital inputs
+ * @param number of digital outputs
+ * @param number of analog inputs 
+ * @param number of analog outputs
+ * @param number of timers
+ * @param number of pulses
+ * @param number of integer memory variables
+ * @param number of real memory variables
+ * @param cycle time in milliseconds
+ * @param hardware identifier        
+ * @param memory mode (bitmask of MEMORY_MODES)
+ * @return configured plc
+ */
+plc_t plc_new_mem(int di, int dq, int ai, int aq, int nt, int ns, int nm, int nr, int step, hardware_t hw, int mem);
+
 /**
  * @brief hardware ctor factory
  * @param hardware type (enum HARDWARES)
- * @return handle to hardware instance
+ * @return handle to the shared hardware instance
  */
 hardware_t plc_get_hardware(int type);
 
+/**
+ * @brief construct a hardware instance of its own, 
+ * so that several PLCs can use the same backend
+ * @param hardware type (enum HARDWARES)
+ * @return handle to hardware instance, NULL if not built in
+ */
+hardware_t plc_new_hardware(int type);
+
+/**
+ * @brief free a hardware instance made by plc_new_hardware,
+ * releasing whatever it holds, enabled or not
+ * @param handle to hardware instance
+ */
+void plc_free_hardware(hardware_t hw);
+
+enum {
+    PLC_HW_ABI = 1  // layout of struct hardware, bumped when it changes
+};
+
+/**
+ * @brief load a hardware backend at run time, 
+ * from a shared object that exports its struct hardware
+ * and a uint32_t HardwareAbi equal to the PLC_HW_ABI it was built against.
+ * Each one is loaded once per process, later calls return it again.
+ * Without an HW_EXT built in, plc_get_hardware(HW_EXT) loads 
+ * the one named by the PLC_HARDWARE environment variable
+ * @param path of the shared object, NULL for $PLC_HARDWARE
+ * @param name of the exported struct hardware, NULL for "Hardware"
+ * @return handle to the shared hardware instance, NULL if not loaded
+ */
+hardware_t plc_load_hardware(const char *path, const char *symbol);
+
+/**
+ * @brief the first scan of a replayed trace whose outputs 
+ * differed from the recorded ones. 
+ * The replay runs until the trace ends, which sets the status of its hardware
+ * @param handle to a HW_TRACE hardware instance
+ * @return the scan, counted from 0, or -1 if none did
+ */
+long plc_trace_divergence(hardware_t hw);
+
 /**
  * @brief get digital input value
  * @param the PLC
@@ -249,6 +532,118 @@ unsigned int plc_get_t_val(plc_t p, unsigned int i);
  */
 unsigned char plc_get_t_out(plc_t p, unsigned int i);
 
+/**
+ * @brief enable or disable tickless mode.
+ * When a cycle changes nothing, the next one waits for an input event
+ * of the hardware or for the next timer or blinker deadline, 
+ * instead of the cycle time.
+ * Programs that read analog inputs or timer values, and hardware 
+ * without a wait hook, keep scanning every cycle.
+ * @param the PLC
+ * @param 1 to enable, 0 to disable
+ * @return plc handle
+ */
+plc_t plc_set_tickless(plc_t p, unsigned char on);
+
+/**
+ * @brief iterate over the registers changed by the last cycle.
+ * Timers and blinkers report their outputs. 
+ * The changes are valid until the next cycle.
+ * @param the PLC
+ * @param iterator, set it to 0 to start from the first change
+ * @return the next change, or NULL when there are no more
+ */
+const struct change *plc_next_change(plc_t p, unsigned int *it);
+
+/**
+ * @brief post a request from a thread other than the one scanning, 
+ * without blocking. Requests are applied in the order posted, 
+ * at the start of the next cycle, after the inputs are read
+ * @param the PLC
+ * @param the request (enum REQUESTS)
+ * @param the operand type
+ * @param the operand index
+ * @param the value, serialized, ignored by REQ_UNFORCE
+ * @return OK, error if the request is invalid, or if the queue is full
+ */
+int plc_post(plc_t p, int req, int op, unsigned char i, const char *val);
+
+/**
+ * @brief construct a snapshot sized for a PLC, for a reader thread
+ * @param the PLC
+ * @return the snapshot, NULL on error
+ */
+snapshot_t plc_new_snapshot(plc_t p);
+
+/**
+ * @brief copy the last image a PLC published, from any thread.
+ * The writer never waits for readers; 
+ * a reader retries until it copied an image that was not being written
+ * @param the PLC
+ * @param a snapshot made for it
+ * @return OK or error
+ */
+int plc_read_snapshot(plc_t p, snapshot_t s);
+
+/**
+ * @brief free a snapshot
+ * @param the snapshot
+ */
+void plc_free_snapshot(snapshot_t s);
+
+/**
+ * @brief move the published image and the request queue of a PLC 
+ * to a POSIX shared memory segment, for other processes to attach to. 
+ * Do it before other threads use the PLC. 
+ * Fails if the segment exists; a stale one left by a crashed PLC
+ * has to be shm_unlink'ed first.
+ * The segment is unlinked when the PLC is cleared
+ * @param the PLC
+ * @param the name of the segment, eg. "/plc0"
+ * @return plc with updated status
+ */
+plc_t plc_share(plc_t p, const char *name);
+
+/**
+ * @brief attach to the segment of a PLC from another process
+ * @param the name of the segment
+ * @return the mapped header, NULL if there is no ready segment 
+ * of a layout this version understands
+ */
+shared_header_t plc_attach(const char *name);
+
+/**
+ * @brief detach from a segment
+ * @param the mapped header
+ */
+void plc_detach(shared_header_t h);
+
+/**
+ * @brief construct a snapshot sized for a shared segment
+ * @param the mapped header
+ * @return the snapshot, NULL on error
+ */
+snapshot_t plc_new_shared_snapshot(shared_header_t h);
+
+/**
+ * @brief copy the image of a shared segment, as plc_read_snapshot()
+ * @param the mapped header
+ * @param a snapshot made for it
+ * @return OK or error
+ */
+int plc_read_shared_snapshot(shared_header_t h, snapshot_t s);
+
+/**
+ * @brief post a request to a shared segment, as plc_post()
+ * @param the mapped header
+ * @param the request (enum REQUESTS)
+ * @param the operand type
+ * @param the operand index
+ * @param the value, serialized, ignored by REQ_UNFORCE
+ * @return OK, error if the request is invalid, or if the queue is full
+ */
+int plc_shared_post(shared_header_t h, int req, int op, unsigned char i, const char *val);
+
 /**
  * @brief is plc running?
  * @param the PLC
@@ -269,3 +664,46 @@ unsigned char plc_is_updated(plc_t p);
  * @return plc handle
  */
 plc_t plc_reset_update(plc_t p);
+
+/**
+ * Forward declaration host_t
+ */
+typedef struct host *host_t;
+
+/**
+ * @brief construct a host that runs several PLCs on a pool of threads.
+ * Each PLC is scanned once per cycle time of its own; 
+ * a thread with no PLC due steals one that is due from another thread. 
+ * PLCs must not share hardware instances, see plc_new_hardware()
+ * @param number of threads
+ * @return the host, NULL on error
+ */
+host_t plc_new_host(unsigned int threads);
+
+/**
+ * @brief add a PLC to a host that has not started. 
+ * The host scans it, plc_start() and plc_stop() still apply
+ * @param the host
+ * @param the PLC
+ * @return OK or error
+ */
+int plc_host_add(host_t h, plc_t p);
+
+/**
+ * @brief start scanning the PLCs of a host
+ * @param the host
+ * @return OK or error
+ */
+int plc_host_start(host_t h);
+
+/**
+ * @brief stop scanning, once every scan in progress is over
+ * @param the host
+ */
+void plc_host_stop(host_t h);
+
+/**
+ * @brief stop and free a host, not its PLCs
+ * @param the host
+ */
+void plc_free_host(host_t h);
@@ -26,9 +26,16 @@
 #include <stdio.h>
 #include <string.h>
 #include <inttypes.h>
+#include <sys/time.h>
+#include "util.h"
 #include "data.h"
 #include "instruction.h"
 #include "rung.h"
+#include "arena.h"
+#include "wheel.h"
+#include "pool.h"
+#include "queue.h"
+#include "counter.h"
 
 #include "plc_iface.h"
 
@@ -36,6 +43,7 @@
 #define THOUSAND 1000
 
 #define MAXRUNG  256
+#define MAXTASK  8
 
 #define FLOAT_PRECISION 0.000001
 
@@ -95,32 +103,51 @@ typedef enum {
     CHANGED_STATUS = 0x20
 } CHANGE_DELTA;
 
+/**
+ * @brief number of 64 bit words needed to pack n bits
+ */
+#define BITWORDS(n) (((n) + LWORDSIZE - 1) / LWORDSIZE)
+#define BIT_GET(w, n)    (((w)[(n) / LWORDSIZE] >> ((n) % LWORDSIZE)) & 1)
+#define BIT_PUT(w, n, b) ((w)[(n) / LWORDSIZE] |= (uint64_t) (b) << ((n) % LWORDSIZE))
+#define BIT_ASSIGN(w, n, b) ((w)[(n) / LWORDSIZE] = \
+    ((w)[(n) / LWORDSIZE] & ~((uint64_t) 1 << ((n) % LWORDSIZE))) \
+    | ((uint64_t) ((b) != 0) << ((n) % LWORDSIZE)))
+
 /***********************plc_t*****************************/
 /**
  * @brief The digital_input struct
+ * parallel packed bit arrays, bit n of each belongs to input n
  */
 typedef struct digital_input {
-    PLC_BIT(I);      // contact value
-    PLC_BIT(RE);     // rising edge
-    PLC_BIT(FE);     // falling edge
-    PLC_BIT(EDGE);   // true if value changed
-    PLC_BIT(MASK);   // true if forced 1
-    PLC_BIT(N_MASK); // true if forced 0
-    char *nick;  // [NICKLEN]; // nickname
+    uint64_t *I;      // contact value (in current bank)
+    uint64_t *RE;     // rising edge
+    uint64_t *FE;     // falling edge
+    uint64_t *EDGE;   // true if value changed
+    uint64_t *MASK;   // true if forced 1
+    uint64_t *N_MASK; // true if forced 0
 } *di_t;
 
 /**
  * @brief The digital_output struct
+ * parallel packed bit arrays, bit n of each belongs to output n
  */
 typedef struct digital_output {
-    PLC_BIT(Q);      // contact
-    PLC_BIT(SET);    // set
-    PLC_BIT(RESET);  // reset
-    PLC_BIT(MASK);   // true if forced true
-    PLC_BIT(N_MASK); // true if forced false
-    char *nick;  // [NICKLEN];//nickname
+    uint64_t *Q;      // contact
+    uint64_t *SET;    // set
+    uint64_t *RESET;  // reset
+    uint64_t *MASK;   // true if forced true
+    uint64_t *N_MASK; // true if forced false
 } *do_t;
 
+/**
+ * @brief The symbols struct
+ * nicknames of the bit-packed registers, kept away from the hot state
+ */
+typedef struct symbols {
+    char **di; // digital input nicknames
+    char **dq; // digital output nicknames
+} *sym_t;
+
 /**
  * @brief The analog_io  struct
  */
@@ -132,14 +159,25 @@ typedef struct analog_io {
     char *nick;  // [NICKLEN]; // nickname
 } *aio_t;
 
+/**
+ * @brief The conversion struct
+ * linear conversion factors between raw samples and analog values,
+ * one entry per channel, precomputed from the channel limits
+ */
+typedef struct conversion {
+    double *offset; // value at raw 0
+    double *scale;  // value per raw count for inputs, raw count per value for outputs
+} *conv_t;
+
 /**
  * @brief The timer struct.
  * struct which represents  a timer state at a given cycle
  */
 typedef struct timer {
-    long S;       // scale; S=1000=>increase every 1000 cycles. STEP= 10 msec=> increase every 10 sec
-    long sn;      // internal counter used for scaling
-    long V;       // value
+    long S;       // time base in msec; S=1000=>increase every second. S=1=>V, P in msec
+    long sn;      // msec counted towards the next increase, as of since
+    long V;       // value as of since, see timer_value() while running
+    uint64_t since; // time in msec at which the timer (re)started counting
     PLC_BIT(Q);       // output
     long P;       // Preset value
     PLC_BIT(ONDELAY); // 1=on delay, 0 = off delay
@@ -155,8 +193,7 @@ typedef struct timer {
  */
 typedef struct blink {
     PLC_BIT(Q);     // output
-    long S;     // scale; S=1000=>toggle every 1000 cycles. STEP= 10 msec=> toggle every 10 sec
-    long sn;    // internal counter for scaling
+    long S;     // half period in msec; S=1000=>toggle every second
     char *nick; // [NICKLEN];
 } *blink_t;
 
@@ -186,17 +223,86 @@ typedef struct mreal {
     char *nick; // [NICKLEN]; // nickname
 } *mreal_t;
 
+/**
+ * @brief The PLC_bank struct
+ * one half of the double-buffered state: everything a cycle
+ * needs to compare against the previous cycle.
+ * Two banks are swapped by pointer at every cycle boundary, 
+ * so nothing is copied from one cycle to the next.
+ */
+typedef struct PLC_bank {
+    PLC_BYTE *inputs;  // digital input values buffer
+    PLC_BYTE *outputs; // digital output values buffer
+    uint64_t *di;      // decoded (forced) digital inputs, packed
+    uint64_t *pulses;  // counter pulses, packed
+    double *ai;        // analog input values
+    double *aq;        // analog output values
+} *bank_t;
+
+/**
+ * @brief The change_set struct
+ * registers touched during a cycle and the values last reported,
+ * so that only those that really changed make it to the list.
+ * Inputs and outputs are compared against the previous bank instead
+ */
+typedef struct change_set {
+    uint64_t *mr_dirty;  // real registers stored to
+    uint64_t *t_dirty;   // timers whose output may have changed
+    uint64_t *s_dirty;   // blinkers that toggled
+    uint64_t *m_seen;    // counter values last reported
+    double *mr_seen;     // real register values last reported
+    uint64_t *t_seen;    // timer outputs last reported, packed
+    uint64_t *s_seen;    // blinker outputs last reported, packed
+    struct change *list; // the changes of the last cycle
+    unsigned int size;   // number of changes in the list
+} *change_set_t;
+
+/**
+ * @brief The image struct
+ * the process image published at the end of each cycle, for readers 
+ * on other threads. The sequence number is odd while it is written.
+ * Words are stored and loaded atomically, reals as their bits
+ */
+typedef struct image {
+    uint64_t *seq;   // twice the number of images published
+    uint64_t *words; // the image, in the order of struct snapshot
+    unsigned int size;
+} *image_t;
+
+/**
+ * @brief The shared struct
+ * the shared memory segment the image and the requests were moved to
+ */
+typedef struct shared {
+    shared_header_t header; // start of the mapping
+    char *name;             // of the segment, unlinked with the PLC
+} *shared_t;
+
+/**
+ * @brief The plc_task struct
+ * rungs scanned together, at their own period.
+ * Rungs belong to task 0 unless bound elsewhere
+ */
+typedef struct plc_task {
+    long period;           // msec between runs, 0 to run every cycle
+    PLC_BYTE priority;     // lower runs first, then the shorter period
+    long watchdog;         // usec a run may take, 0 for the cycle time
+    uint64_t due;          // clock of the next run
+    unsigned int overruns; // runs that were a period or more late
+    unsigned int first;    // its first rung in the task rung table
+    unsigned int rungs;    // number of its rungs
+} *plc_task_t;
+
 /**
  * @brief The PLC_regs struct
  * The struct which contains all the software PLC registers
  */
-// TODO: should masks and edges be packed inside di_t, dq_t?
 typedef struct PLC_regs {
     hardware_t hw;
     // hardware interface
-    PLC_BYTE *inputs;         // digital input values buffer
+    PLC_BYTE *inputs;         // digital input values buffer (in current bank)
     uint64_t *real_in;    // analog raw input values buffer
-    PLC_BYTE *outputs;        // digital output values buffer
+    PLC_BYTE *outputs;        // digital output values buffer (in current bank)
     uint64_t *real_out;   // analog raw output values buffer
     
     PLC_BYTE command;         // serial command from plcpipe
@@ -206,25 +312,35 @@ typedef struct PLC_regs {
     int status;           // 0 = stopped, 1 = running, negative = error
     
     PLC_BYTE ni;              // number of bytes for digital inputs
-    di_t di;              // digital inputs
+    struct digital_input di;  // digital inputs
+    PLC_BYTE *rising;         // input edges the hardware caught between scans,
+    PLC_BYTE *falling;        // as input bytes padded to whole words
     
     PLC_BYTE nq;              // number of bytes for digital outputs
-    do_t dq;              // the digital outputs
+    struct digital_output dq; // the digital outputs
 
     PLC_BYTE nai;             // number of analog input channels
     aio_t ai;             // the analog inputs
+    struct conversion ai_conv; // raw to value
     
     PLC_BYTE naq;             // number of analog output channels
     aio_t aq;             // the analog outputs
+    struct conversion aq_conv; // value to raw
 
     PLC_BYTE nt;              // number of timers
     dt_t t;               // the timers
+    struct wheel t_wheel;     // running timers, by the time they reach their preset
+    wheel_node_t t_node;  // wheel entry of each timer
     
     PLC_BYTE ns;              // number of blinkers
     blink_t s;            // the blinkers
+    struct wheel s_wheel;     // blinkers, by the time of their next toggle
+    wheel_node_t s_node;  // wheel entry of each blinker
     
     PLC_BYTE nm;              // number of memory counters
     mvar_t m;             // the memory
+    uint64_t *m_dirty;    // counters touched since they were last found unchanged
+    struct counters hsc;      // fast counters, counting inputs into memory counters
     
     PLC_BYTE nmr;             // number of memory registers
     mreal_t mr;           // the memory
@@ -232,8 +348,35 @@ typedef struct PLC_regs {
     rung_t *rungs;
     PLC_BYTE rungno;          // 256 rungs should suffice
     
+    struct plc_task tasks[MAXTASK]; // the tasks
+    PLC_BYTE task_order[MAXTASK];   // the tasks in the order they run
+    PLC_BYTE task_rung[MAXRUNG];    // rung indices grouped by task, in scan order
+    PLC_BYTE rung_level[MAXRUNG];   // depth of each rung in the dependencies of its task
+    PLC_BYTE par_rung[MAXRUNG];     // rung indices grouped by task, then by level
+    PLC_BYTE workers;               // threads scanning independent rungs, 1 for none
+    pool_t pool;                    // the threads, while running
+    
+    struct symbols sym;   // nicknames of digital inputs and outputs
+    struct change_set chg; // what the last cycle changed
+    queue_t requests;      // forcing and writes posted by other threads
+    struct image image;    // the last published process image
+    struct shared shm;     // where they are shared with other processes
+    
     long step;            // cycle time in milliseconds
-    struct PLC_regs *old; // pointer to previous state
+    uint64_t clock;       // monotonic time in msec, captured once per cycle
+    PLC_BYTE tickless;        // wait for events instead of the cycle time when idle
+    PLC_BYTE periodic;        // the program reads values that change with time
+    PLC_BYTE quiet;           // the last cycle changed nothing
+    struct timeval last;      // end of the last run of the program
+    long run_time;            // usec the last run of the program took
+    struct variance jitter;   // cycle time statistics
+    
+    struct PLC_bank bank[2]; // double-buffered state
+    bank_t cur;           // state of the current cycle
+    bank_t prev;          // state of the previous cycle
+    PLC_BYTE *bank_mem;   // one allocation backing both banks
+    
+    struct arena arena;   // backing store of the process image (MEM_ARENA)
 } *plc_t;
 
 /**
@@ -379,11 +522,31 @@ plc_t plc_configure_io_limit(const plc_t p, int io, PLC_BYTE idx, const char *va
  * @return plc instance with saved change or updated error status
  */
 plc_t plc_configure_counter_direction(const plc_t p, PLC_BYTE idx, const char *val);
+
 /**
- * @brief configure a timer scale
+ * @brief configure a register as fast counter of a digital input, 
+ * from the next start. Rising edges of the input between scans 
+ * are added to the register, or subtracted if it counts down
+ * @param plc instance   
+ * @param variable index
+ * @param serialized input index (eg 3)
+ * @return plc instance with saved change or updated error status
+ */
+plc_t plc_configure_fast_counter(const plc_t p, PLC_BYTE idx, const char *val);
+
+/**
+ * @brief configure how often fast counters are polled between scans,
+ * for hardware that cannot count by itself, from the next start
+ * @param plc instance   
+ * @param serialized long, usec between polls (eg 100), 0 to count scanned edges
+ * @return plc instance with saved change or updated error status
+ */
+plc_t plc_configure_counter_poll(const plc_t p, const char *val);
+/**
+ * @brief configure a timer time base
  * @param plc instance   
  * @param timer index
- * @param serialized long (eg 100000)
+ * @param serialized long, msec per increase of the timer (eg 1000)
  * @see also timer_t
  * @return plc instance with saved change or updated error status
  */
@@ -393,7 +556,7 @@ plc_t plc_configure_timer_scale(const plc_t p, PLC_BYTE idx, const char *val);
  * @brief configure a timer preset
  * @param plc instance   
  * @param timer index
- * @param serialized long (eg 100000)
+ * @param serialized long, in units of the time base (eg 100000)
  * @see also timer_t
  * @return plc instance with saved change or updated error status
  */
@@ -413,10 +576,58 @@ plc_t plc_configure_timer_delay_mode(const plc_t p, PLC_BYTE idx, const char *va
  * @brief configure a pulse scale
  * @param plc instance   
  * @param pulse index
- * @param serialized long (eg 100000)
+ * @param serialized long, msec between toggles (eg 500)
  * @see also blink_t
  * @return plc instance with saved change or updated error status
  */
 plc_t plc_configure_pulse_scale(const plc_t p, PLC_BYTE idx, const char *val);
 
+/**
+ * @brief configure a task period
+ * @param plc instance   
+ * @param task index
+ * @param serialized long, msec between runs (eg 100), 0 for every cycle
+ * @see also plc_task_t
+ * @return plc instance with saved change or updated error status
+ */
+plc_t plc_configure_task_period(const plc_t p, PLC_BYTE idx, const char *val);
+
+/**
+ * @brief configure a task priority
+ * @param plc instance   
+ * @param task index
+ * @param serialized byte, tasks with lower values run first (eg 1)
+ * @see also plc_task_t
+ * @return plc instance with saved change or updated error status
+ */
+plc_t plc_configure_task_priority(const plc_t p, PLC_BYTE idx, const char *val);
+
+/**
+ * @brief configure a task watchdog
+ * @param plc instance   
+ * @param task index
+ * @param serialized long, usec a run may take (eg 500), 0 for the cycle time
+ * @see also plc_task_t
+ * @return plc instance with saved change or updated error status
+ */
+plc_t plc_configure_task_watchdog(const plc_t p, PLC_BYTE idx, const char *val);
+
+/**
+ * @brief configure how many threads scan the rungs, from the next start.
+ * Rungs that do not depend on each other run concurrently
+ * @param plc instance   
+ * @param serialized byte, number of threads (eg 4), 0 or 1 to scan in order
+ * @return plc instance with saved change or updated error status
+ */
+plc_t plc_configure_workers(const plc_t p, const char *val);
+
+/**
+ * @brief bind a rung to a task
+ * @param plc instance   
+ * @param rung index
+ * @param serialized task index (eg 1)
+ * @return plc instance with saved change or updated error status
+ */
+plc_t plc_configure_rung_task(const plc_t p, PLC_BYTE idx, const char *val);
+
 #endif /* _PLCLIB_H_ */
@@ -0,0 +1,75 @@
+/*******************************************************************************
+ LibreLogic : a free PLC library
+ Copyright (C) 2022, Antonis K. (kalamara AT ceid DOT upatras DOT gr)
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _POOL_H_
+#define _POOL_H_
+
+#include <pthread.h>
+
+/**
+ * @brief a job of a batch
+ * @param the argument of the batch
+ * @param index of the job in the batch
+ */
+typedef void (*job_f)(void *arg, unsigned int i);
+
+/**
+ * @brief The pool struct
+ * worker threads that run batches of independent jobs together 
+ * with the caller, which returns when the whole batch is done.
+ * Workers sleep between batches.
+ */
+typedef struct pool {
+    pthread_t *threads;    // the workers
+    unsigned int n;        // number of workers, besides the caller
+    pthread_mutex_t lock;
+    pthread_cond_t go;     // a batch is ready
+    pthread_cond_t idle;   // every worker is done with the batch
+    unsigned int batch;    // number of batches started
+    unsigned int busy;     // workers not yet done with the batch
+    job_f job;             // the job of the current batch
+    void *arg;             // its argument
+    unsigned int count;    // number of jobs in the batch
+    unsigned int next;     // next job to take, taken atomically
+    int quit;              // the workers should exit
+} *pool_t;
+
+/**
+ * @brief start a pool
+ * @param number of threads running the batches, including the caller
+ * @return the pool, or NULL if no worker could be started
+ */
+pool_t pool_new(unsigned int threads);
+
+/**
+ * @brief run a batch of jobs on the pool and wait for all of them.
+ * Jobs of a batch must not depend on each other
+ * @param the pool
+ * @param the job
+ * @param the argument of the batch
+ * @param number of jobs
+ */
+void pool_run(pool_t pool, job_f job, void *arg, unsigned int count);
+
+/**
+ * @brief stop the workers and free the pool
+ * @param the pool
+ */
+void pool_free(pool_t pool);
+
+#endif //_POOL_H_
@@ -0,0 +1,85 @@
+/*******************************************************************************
+ LibreLogic : a free PLC library
+ Copyright (C) 2022, Antonis K. (kalamara AT ceid DOT upatras DOT gr)
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _QUEUE_H_
+#define _QUEUE_H_
+
+#include <stdint.h>
+
+#define QUEUE_SIZE 256 // requests that can be pending, a power of 2
+#define QUEUE_PAD  64  // keeps producers and the consumer off each other's cache line
+
+/**
+ * @brief The request struct
+ * a change to a PLC asked for by another thread
+ */
+struct request {
+    uint32_t req;   // enum REQUESTS
+    uint32_t op;    // the operand type
+    uint32_t index; // the operand index
+    uint64_t u;     // the value, parsed as an integer
+    double r;       // the value, parsed as a real
+};
+
+/**
+ * @brief The queue_cell struct
+ * a slot of the queue, with the sequence number that tells 
+ * whether it is free for the producer of a round or full for the consumer
+ */
+struct queue_cell {
+    uint64_t seq;
+    struct request r;
+};
+
+/**
+ * @brief The queue struct
+ * a bounded lock free queue of requests, 
+ * any number of threads push and one thread pops. 
+ * It holds no pointers, so it can be shared between processes
+ */
+typedef struct queue {
+    uint64_t head;            // next cell to push to, claimed atomically
+    char pad[QUEUE_PAD - sizeof(uint64_t)];
+    uint64_t tail;            // next cell to pop from
+    uint64_t dropped;         // requests refused because the queue was full
+    struct queue_cell cells[QUEUE_SIZE];
+} *queue_t;
+
+/**
+ * @brief make a queue empty
+ * @param the queue
+ */
+void queue_init(queue_t q);
+
+/**
+ * @brief push a request, from any thread, without blocking
+ * @param the queue
+ * @param the request
+ * @return 1 if queued, 0 if the queue is full
+ */
+int queue_push(queue_t q, const struct request *r);
+
+/**
+ * @brief pop the oldest request, from the consumer thread only
+ * @param the queue
+ * @param where to copy the request
+ * @return 1 if a request was popped, 0 if the queue is empty
+ */
+int queue_pop(queue_t q, struct request *r);
+
+#endif //_QUEUE_H_
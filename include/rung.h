@@ -54,6 +54,7 @@ typedef struct rung {
     opcode_t stack;                   // head of stack
     struct opcode prealloc[MAXSTACK]; // preallocated stack
     union accdata acc;                // accumulator
+    PLC_BYTE task;                    // index of the task that scans it
 } *rung_t;
 
 /**
@@ -0,0 +1,82 @@
+/*******************************************************************************
+ LibreLogic : a free PLC library
+ Copyright (C) 2022, Antonis K. (kalamara AT ceid DOT upatras DOT gr)
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _WHEEL_H_
+#define _WHEEL_H_
+
+#include <stdint.h>
+
+#define WHEEL_BITS   6
+#define WHEEL_SLOTS  (1 << WHEEL_BITS)
+#define WHEEL_MASK   (WHEEL_SLOTS - 1)
+#define WHEEL_LEVELS 4 // 2^24 ticks ahead before entries are parked
+
+/**
+ * @brief The wheel_node struct
+ * an entry embedded in whatever is scheduled, owned by the caller.
+ * A zeroed node is not armed.
+ */
+typedef struct wheel_node {
+    struct wheel_node *next;   // next in slot, or in the due list
+    struct wheel_node **pprev; // link pointing to this node, NULL if not armed
+    uint64_t expiry;           // tick at which the node is due
+} *wheel_node_t;
+
+/**
+ * @brief The wheel struct
+ * hierarchical timing wheel: level l holds entries due within 
+ * 64^(l+1) ticks, and is cascaded into the lower levels as time advances.
+ * A zeroed wheel is empty at tick 0.
+ */
+typedef struct wheel {
+    uint64_t now;       // current tick
+    unsigned int armed; // number of armed nodes
+    wheel_node_t slot[WHEEL_LEVELS][WHEEL_SLOTS];
+} *wheel_t;
+
+/**
+ * @brief schedule a node, rescheduling it if already armed
+ * @param the wheel
+ * @param the node
+ * @param tick at which it is due, past ticks are due on the next one
+ */
+void wheel_arm(wheel_t w, wheel_node_t n, uint64_t expiry);
+
+/**
+ * @brief unschedule a node, if armed
+ * @param the wheel
+ * @param the node
+ */
+void wheel_disarm(wheel_t w, wheel_node_t n);
+
+/**
+ * @brief advance the wheel to a tick
+ * @param the wheel
+ * @param the new tick, not before the current one
+ * @return the nodes that became due, disarmed and chained by next 
+ */
+wheel_node_t wheel_advance(wheel_t w, uint64_t now);
+
+/**
+ * @brief find when the wheel is next due, eg. to sleep until then
+ * @param the wheel
+ * @return the earliest expiry of an armed node, 0 if none is armed
+ */
+uint64_t wheel_next(const struct wheel *w);
+
+#endif //_WHEEL_H_
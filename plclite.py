@@ -3,10 +3,11 @@
 """PLC - lite for running logic on Raspberry pi"""
 VERSION = '0.0'
 
-USAGE = '''Usage: plclite [-p config file]
+USAGE = '''Usage: plclite [-p config file] [-t]
     Options:
     -h displays this help message
     -p uses a program fle";
+    -t tickless: sleep until an input or timer event when idle
 
 '''
 
@@ -31,21 +32,20 @@ hardware_conf = ffi.new("struct config_gpiod *",
 }
 )
 
-def dump(plc):
-    instr = "In:  "  
-    for i in range(0,len(INPUTS)):
-        instr = instr + str(lib.plc_get_di_val(plc, i)) + " "
-    print(instr);
+REGISTERS = ['DI', 'DQ', 'AI', 'AQ', 'M', 'MR', 'T', 'S']
 
-    qstr = "Out: "  
-    for q in range(0,len(OUTPUTS)):
-        qstr = qstr + str(lib.plc_get_dq_val(plc, q)) + " "
-    print(qstr);
-        
+def changes(plc):
+    reals = [lib.REG_AI, lib.REG_AQ, lib.REG_MR]
+    it = ffi.new("unsigned int *", 0)
+    c = lib.plc_next_change(plc, it)
+    while c != ffi.NULL:
+        val = c.r if c.reg in reals else c.u
+        print(REGISTERS[c.reg] + str(c.index) + ": " + str(val))
+        c = lib.plc_next_change(plc, it)
 
 def logic(prog):
-    hw_gpiod = lib.plc_get_hardware(lib.HW_GPIOD); 
-    hw_gpiod.configure(hardware_conf);
+    hw_gpiod = lib.plc_new_hardware(lib.HW_GPIOD);
+    hw_gpiod.configure(hw_gpiod, hardware_conf);
     plc = lib.plc_new( 1, 1, 0, 0, 1, 0, 2, 0, STEP, hw_gpiod); 
     
     return lib.plc_load_program_file(ffi.new("char[]", prog.encode('ascii')), plc);
@@ -54,13 +54,14 @@ def main(args=None):
     import getopt
 
     p_file = PROGRAM
+    tickless = 0
     
     if args is None:
         args = sys.argv[1:]
     try:
-        opts, args = getopt.gnu_getopt(args, 'hvp:',
+        opts, args = getopt.gnu_getopt(args, 'hvp:t',
                                        ['help', 'version',
-                                        'program='
+                                        'program=', 'tickless'
                                        ])
         for o,a in opts:
             if o in ('-h', '--help'):
@@ -71,6 +72,8 @@ def main(args=None):
                 return 0
             elif o in ('-p', '--program'):
                 p_file = a
+            elif o in ('-t', '--tickless'):
+                tickless = 1
             
     except getopt.GetoptError:
         e = sys.exc_info()[1]     # current exception
@@ -78,12 +81,11 @@ def main(args=None):
         sys.stderr.write(USAGE+"\n")
         return 1
         
-    plc = lib.plc_start(logic(p_file))
+    plc = lib.plc_start(lib.plc_set_tickless(logic(p_file), tickless))
         
     while(lib.plc_is_running(plc) == 1):
         plc = lib.plc_func(plc)
-        if lib.plc_is_updated(plc) > 0:
-            dump(lib.plc_reset_update(plc))
+        changes(plc)
 
 if __name__ == '__main__':
     sys.exit(main())
@@ -18,7 +18,9 @@
 
 #ifdef COMEDI
 
+#include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 
 #include "util.h"
 #include "data.h"
@@ -26,87 +28,439 @@
 #include "rung.h"
 #include "plc_iface.h"
 
-struct hardware Comedi;
-
 #include <comedilib.h>
 
-static comedi_t *it;
-uint32_t Comedi_file;
-uint8_t Comedi_subdev_i;
-uint8_t Comedi_subdev_q;
-uint8_t Comedi_subdev_ai;
-uint8_t Comedi_subdev_aq;
+/**
+ * @brief an analog acquisition the card paces by itself,
+ * read straight from its mapped buffer
+ */
+struct stream {
+    uint32_t period;       // ns per scan, 0 for no streaming
+    uint8_t mean;          // average the scans of a cycle instead of the newest
+    comedi_cmd cmd;
+    unsigned int *chanlist;
+    unsigned char *map;    // the streaming buffer
+    unsigned int size;     // of the buffer, in bytes
+    unsigned int front;    // offset of the first unread byte
+    unsigned int sample;   // bytes per sample
+};
+
+/**
+ * @brief The comedi struct
+ * state of a comedi hardware instance
+ */
+struct comedi {
+    comedi_t *it;
+    uint32_t file;
+    uint8_t subdev_i;
+    uint8_t subdev_q;
+    uint8_t subdev_ai;
+    uint8_t subdev_aq;
+    uint32_t n_di;  // channels of each subdevice the scan uses
+    uint32_t n_dq;
+    uint32_t n_ai;
+    uint32_t n_aq;
+    comedi_insnlist reads;  // a scan's reads: words of inputs, then samples
+    comedi_insnlist writes; // a scan's writes: words of outputs, then samples
+    lsampl_t *data;         // of the reads and then the writes
+    lsampl_t *ai;           // the samples of the analog inputs, within data
+    struct stream stream;
+};
+
+#define COM_WORD 32 // channels per instruction of bits
 
-int com_config(void *conf) {
+static struct comedi *com_state(hardware_t hw) {
+    if (hw->priv == NULL) {
+        hw->priv = calloc(1, sizeof(struct comedi));
+    }
+    return (struct comedi*) hw->priv;
+}
+
+int com_config(hardware_t hw, void *conf) {
+    struct comedi *s = com_state(hw);
     conf_comedi_t c = (conf_comedi_t) conf;
 
-    Comedi_file = c->file;
+    s->file = c->file;
     
-    Comedi_subdev_i = c->sub_i;
-    Comedi_subdev_q = c->sub_q;
-    Comedi_subdev_ai = c->sub_adc;
-    Comedi_subdev_aq = c->sub_dac;
+    s->subdev_i = c->sub_i;
+    s->subdev_q = c->sub_q;
+    s->subdev_ai = c->sub_adc;
+    s->subdev_aq = c->sub_dac;
+    s->n_di = BYTESIZE * c->in_size;
+    s->n_dq = BYTESIZE * c->out_size;
+    s->n_ai = c->adc_size;
+    s->n_aq = c->dac_size;
+    s->stream.period = c->stream_ns;
+    s->stream.mean = c->stream_mean;
     
-    Comedi.label = (char*) c->label;
+    hw->label = (char*) c->label;
     
     return PLC_OK;
 }
 
-int com_enable() { // Enable bus communication
+/**
+ * @brief how many channels of a subdevice to batch
+ * @param the device
+ * @param the subdevice
+ * @param channels configured, 0 for all of them
+ * @return number of channels
+ */
+static uint32_t com_channels(comedi_t *it, unsigned int subdev, uint32_t configured) {
+    int n = comedi_get_n_channels(it, subdev);
+    
+    if (n <= 0) {
+        return 0;
+    }
+    return (configured > 0 && configured < (uint32_t) n) ? configured : (uint32_t) n;
+}
+
+static comedi_insn *com_bits(comedi_insn *insn, unsigned int subdev, 
+                             uint32_t channels, lsampl_t **data) {
+    uint32_t c = 0;
+    for (; c < channels; c += COM_WORD, insn++) { // mask, then bits
+        insn->insn = INSN_BITS;
+        insn->n = 2;
+        insn->data = *data;
+        insn->subdev = subdev;
+        insn->chanspec = CR_PACK(c, 0, 0); // the first channel of the word
+        *data += 2;
+    }
+    return insn;
+}
+
+static comedi_insn *com_samples(comedi_insn *insn, unsigned int op, unsigned int subdev, 
+                                uint32_t channels, lsampl_t **data) {
+    uint32_t c = 0;
+    for (; c < channels; c++, insn++) {
+        insn->insn = op;
+        insn->n = 1;
+        insn->data = *data;
+        insn->subdev = subdev;
+        insn->chanspec = CR_PACK(c, 0, AREF_GROUND);
+        *data += 1;
+    }
+    return insn;
+}
+
+/**
+ * @brief prepare the instruction lists of a scan, 
+ * so that all reads are one call, and so are all writes
+ * @param the state
+ * @return OK or error
+ */
+static int com_plan(struct comedi *s) {
+    uint32_t wi = 0;
+    uint32_t wq = 0;
+    comedi_insn *insn = NULL;
+    lsampl_t *data = NULL;
+    
+    s->n_di = com_channels(s->it, s->subdev_i, s->n_di);
+    s->n_dq = com_channels(s->it, s->subdev_q, s->n_dq);
+    s->n_ai = com_channels(s->it, s->subdev_ai, s->n_ai);
+    s->n_aq = com_channels(s->it, s->subdev_aq, s->n_aq);
+    wi = (s->n_di + COM_WORD - 1) / COM_WORD;
+    wq = (s->n_dq + COM_WORD - 1) / COM_WORD;
+    s->reads.n_insns = wi + s->n_ai;
+    s->writes.n_insns = wq + s->n_aq;
+    insn = (comedi_insn*) calloc(s->reads.n_insns + s->writes.n_insns + 1, 
+                                 sizeof(comedi_insn));
+    data = (lsampl_t*) calloc(2 * (wi + wq) + s->n_ai + s->n_aq + 1, 
+                              sizeof(lsampl_t));
+    if (insn == NULL || data == NULL) {
+        free(insn);
+        free(data);
+        s->reads.n_insns = s->writes.n_insns = 0;
+        
+        return PLC_ERR;
+    }
+    s->data = data;
+    s->reads.insns = insn;
+    insn = com_bits(insn, s->subdev_i, s->n_di, &data);
+    s->ai = data;
+    insn = com_samples(insn, INSN_READ, s->subdev_ai, s->n_ai, &data);
+    s->writes.insns = insn;
+    insn = com_bits(insn, s->subdev_q, s->n_dq, &data);
+    com_samples(insn, INSN_WRITE, s->subdev_aq, s->n_aq, &data);
+    return PLC_OK;
+}
+
+/**
+ * @brief map the streaming buffer and start the acquisition on it
+ * @param the state, with its channel list
+ * @param buffer size
+ * @return the mapped buffer, or NULL
+ */
+static unsigned char *com_command(struct comedi *s, int size) {
+    comedi_cmd *cmd = &s->stream.cmd;
+    void *map = NULL;
+    
+    memset(cmd, 0, sizeof(comedi_cmd));
+    cmd->subdev = s->subdev_ai;
+    cmd->start_src = TRIG_NOW;
+    cmd->scan_begin_src = TRIG_TIMER;
+    cmd->scan_begin_arg = s->stream.period;
+    cmd->convert_src = TRIG_TIMER; // as fast as the card goes, the test adjusts it
+    cmd->scan_end_src = TRIG_COUNT;
+    cmd->scan_end_arg = s->n_ai;
+    cmd->stop_src = TRIG_NONE;
+    cmd->chanlist = s->stream.chanlist;
+    cmd->chanlist_len = s->n_ai;
+    // the first test fixes the sources, the second the arguments
+    comedi_command_test(s->it, cmd);
+    if (comedi_command_test(s->it, cmd) != 0) {
+        return NULL;
+    }
+    map = mmap(NULL, size, PROT_READ, MAP_SHARED, comedi_fileno(s->it), 0);
+    if (map == MAP_FAILED) {
+        return NULL;
+    }
+    if (comedi_command(s->it, cmd) < 0) {
+        munmap(map, size);
+        return NULL;
+    }
+    return (unsigned char*) map;
+}
+
+/**
+ * @brief start streaming the analog inputs into the mapped buffer
+ * @param the state, planned
+ * @return OK or error, in which case the inputs are read every cycle
+ */
+static int com_stream(struct comedi *s) {
+    struct stream *st = &s->stream;
+    int size = 0;
+    int flags = 0;
+    uint32_t c = 0;
+    
+    if (s->n_ai == 0 
+    || (size = comedi_get_buffer_size(s->it, s->subdev_ai)) <= 0
+    || (flags = comedi_get_subdevice_flags(s->it, s->subdev_ai)) < 0) {
+        return PLC_ERR;
+    }
+    st->chanlist = (unsigned int*) calloc(s->n_ai, sizeof(unsigned int));
+    if (st->chanlist == NULL) {
+        return PLC_ERR;
+    }
+    for (; c < s->n_ai; c++) {
+        st->chanlist[c] = CR_PACK(c, 0, AREF_GROUND);
+    }
+    if ((st->map = com_command(s, size)) == NULL) {
+        free(st->chanlist);
+        st->chanlist = NULL;
+        
+        return PLC_ERR;
+    }
+    st->size = (unsigned int) size;
+    st->front = 0;
+    st->sample = (flags & SDF_LSAMPL) ? sizeof(lsampl_t) : sizeof(sampl_t);
+    return PLC_OK;
+}
+
+static lsampl_t com_sample(const struct stream *st, unsigned int offset) {
+    const unsigned char *p = st->map + offset % st->size;
+    
+    if (st->sample == sizeof(lsampl_t)) {
+        return *(const lsampl_t*) p;
+    }
+    return *(const sampl_t*) p;
+}
+
+/**
+ * @brief consume the whole scans streamed since the last cycle,
+ * keeping the newest or their mean for the analog inputs
+ * @param the state, streaming
+ * @return OK or error
+ */
+static int com_consume(struct comedi *s) {
+    struct stream *st = &s->stream;
+    unsigned int scan = s->n_ai * st->sample;
+    unsigned int scans = 0;
+    unsigned int from = 0;
+    unsigned int c = 0;
+    int n = comedi_get_buffer_contents(s->it, s->subdev_ai);
+    
+    if (n < 0) {
+        return PLC_ERR;
+    }
+    scans = (unsigned int) n / scan;
+    if (scans == 0) { // nothing new, keep the last values
+        return PLC_OK;
+    }
+    from = st->mean ? st->front : st->front + (scans - 1) * scan;
+    for (; c < s->n_ai; c++) {
+        uint64_t sum = 0;
+        unsigned int k = 0;
+        unsigned int taken = st->mean ? scans : 1;
+        for (; k < taken; k++) {
+            sum += com_sample(st, from + k * scan + c * st->sample);
+        }
+        s->ai[c] = (lsampl_t) (sum / taken);
+    }
+    st->front = (st->front + scans * scan) % st->size;
+    return comedi_mark_buffer_read(s->it, s->subdev_ai, scans * scan) < 0 
+           ? PLC_ERR : PLC_OK;
+}
+
+int com_enable(hardware_t hw) { // Enable bus communication
+    struct comedi *s = com_state(hw);
     int r = 0;
 
     char filestr[MEDSTR];
     memset(filestr, 0, MEDSTR);
-    sprintf(filestr, "/dev/comedi%d", Comedi_file);
+    sprintf(filestr, "/dev/comedi%d", s->file);
     printf("%s\n", filestr);
-    if ((it = comedi_open(filestr)) == NULL)
+    if ((s->it = comedi_open(filestr)) == NULL)
         r = -1;
+    else
+        r = com_plan(s);
+    if (r == PLC_OK && s->stream.period > 0) { 
+        if (com_stream(s) == PLC_OK) { // the analog reads come last
+            s->reads.n_insns -= s->n_ai;
+        } else {
+            plc_log("Analog streaming of %s unavailable, reading every cycle", filestr);
+        }
+    }
     //printf("io card enabled\n");
     return r;
 }
 
-int com_disable() { // Disable bus communication
-    comedi_close(it);
+int com_disable(hardware_t hw) { // Disable bus communication
+    struct comedi *s = com_state(hw);
+    if (s->stream.map != NULL) {
+        comedi_cancel(s->it, s->subdev_ai);
+        munmap(s->stream.map, s->stream.size);
+        free(s->stream.chanlist);
+        s->stream.map = NULL;
+        s->stream.chanlist = NULL;
+    }
+    if (s->it != NULL) {
+        comedi_close(s->it);
+        s->it = NULL;
+    }
+    if (s->reads.insns != NULL) { // heads the writes too
+        free(s->reads.insns);
+    }
+    if (s->data != NULL) {
+        free(s->data);
+    }
+    memset(&s->reads, 0, sizeof(comedi_insnlist));
+    memset(&s->writes, 0, sizeof(comedi_insnlist));
+    s->data = NULL;
     return PLC_OK;
 }
 
-int com_fetch() { // COMEDI has already fetched them for you
-    return 0;
+int com_fetch(hardware_t hw) { // all the inputs of a scan, in one call
+    struct comedi *s = com_state(hw);
+    if (s->stream.map != NULL && com_consume(s) != PLC_OK) {
+        return PLC_ERR;
+    }
+    if (s->reads.n_insns == 0) {
+        return 0;
+    }
+    return comedi_do_insnlist(s->it, &s->reads);
 }
 
-int com_flush() {
-    return 0;
+int com_flush(hardware_t hw) { // all the outputs of a scan, in one call
+    struct comedi *s = com_state(hw);
+    if (s->writes.n_insns == 0) {
+        return 0;
+    }
+    return comedi_do_insnlist(s->it, &s->writes);
 }
 
-void com_dio_read(unsigned int index, PLC_BYTE *value) { // write input n to bit
+void com_dio_read(hardware_t hw, unsigned int index, PLC_BYTE *value) { // write input n to bit
+    struct comedi *s = com_state(hw);
     unsigned int b;
-    comedi_dio_read(it, Comedi_subdev_i, index, &b);
+    comedi_dio_read(s->it, s->subdev_i, index, &b);
     *value = (PLC_BYTE) b;
 }
 
-void com_dio_write(const PLC_BYTE *value, unsigned int n, unsigned char bit) { // write bit to n output
-    comedi_dio_write(it, Comedi_subdev_q, n, bit);
+void com_dio_write(hardware_t hw, const PLC_BYTE *value, unsigned int n, unsigned char bit) { // write bit to n output
+    struct comedi *s = com_state(hw);
+    comedi_dio_write(s->it, s->subdev_q, n, bit);
+}
+
+/**
+ * @brief pack up to 4 bytes into the channel word of comedi_dio_bitfield2
+ */
+static unsigned int com_pack(const PLC_BYTE *bytes, unsigned int n) {
+    unsigned int w = 0;
+    unsigned int i = 0;
+    for (; i < n && i < sizeof(unsigned int); i++) {
+        w |= (unsigned int) bytes[i] << (i * BYTESIZE);
+    }
+    return w;
+}
+
+static void com_unpack(unsigned int w, PLC_BYTE *bytes, unsigned int n) {
+    unsigned int i = 0;
+    for (; i < n && i < sizeof(unsigned int); i++) {
+        bytes[i] = (PLC_BYTE) (w >> (i * BYTESIZE));
+    }
 }
 
-void com_dio_bitfield(const unsigned char *mask, unsigned char *bits) { // simultaneously write output bits defined my mask and read all inputs
-    /*    FIXME int i;
-     unsigned int w, b;
-     w = (unsigned int) (*mask);
-     b = (unsigned int) (*bits);
-     comedi_dio_bitfield(it, Comedi_subdev_i, w, &b);*/
+void com_dio_bitfield(hardware_t hw, const unsigned char *mask, unsigned char *bits, unsigned int n) { // simultaneously write output bits defined my mask and read all inputs
+    struct comedi *s = com_state(hw);
+    unsigned int i = 0;
+    for (; i < n; i += sizeof(unsigned int)) { // 32 channels per call
+        unsigned int w = com_pack(mask + i, n - i);
+        unsigned int b = com_pack(bits + i, n - i);
+        if (w != 0) {
+            comedi_dio_bitfield2(s->it, s->subdev_q, w, &b, i * BYTESIZE);
+        }
+        b = 0;
+        comedi_dio_bitfield2(s->it, s->subdev_i, 0, &b, i * BYTESIZE);
+        com_unpack(b, bits + i, n - i);
+    }
+}
+
+void com_dio_read_bytes(hardware_t hw, unsigned int n, PLC_BYTE *bytes) { // as fetched
+    struct comedi *s = com_state(hw);
+    const lsampl_t *words = s->reads.insns ? s->reads.insns[0].data : NULL;
+    unsigned int batched = (s->n_di + BYTESIZE - 1) / BYTESIZE;
+    unsigned int i = 0;
+    
+    memset(bytes, 0, n);
+    for (; i < n && i < batched; i += sizeof(lsampl_t)) {
+        com_unpack(words[2 * (i / sizeof(lsampl_t)) + 1], bytes + i, n - i);
+    }
+}
+
+void com_dio_write_bytes(hardware_t hw, unsigned int n, const PLC_BYTE *bytes) { // until flushed
+    struct comedi *s = com_state(hw);
+    unsigned int wq = (s->n_dq + COM_WORD - 1) / COM_WORD;
+    unsigned int w = 0;
+    
+    for (; w < wq; w++) {
+        lsampl_t *data = s->writes.insns[w].data;
+        unsigned int left = s->n_dq - w * COM_WORD;
+        unsigned int i = w * sizeof(lsampl_t);
+        data[0] = (left < COM_WORD) ? (1U << left) - 1 : ~0U;
+        data[1] = (i < n) ? com_pack(bytes + i, n - i) : 0;
+    }
 }
 
-void com_data_read(unsigned int index, uint64_t *value) {
+void com_data_read(hardware_t hw, unsigned int index, uint64_t *value) {
+    struct comedi *s = com_state(hw);
     lsampl_t data;
-    comedi_data_read(it, Comedi_subdev_ai, index, 0, // unsigned int range,
+    if (index < s->n_ai) { // as fetched or streamed
+        *value = s->ai[index];
+        return;
+    }
+    comedi_data_read(s->it, s->subdev_ai, index, 0, // unsigned int range,
             AREF_GROUND, // unsigned int aref,
             &data);
     *value = (uint64_t) data;
 }
 
-void com_data_write(unsigned int index, uint64_t value) {
+void com_data_write(hardware_t hw, unsigned int index, uint64_t value) {
+    struct comedi *s = com_state(hw);
     lsampl_t data = (lsampl_t)(value % 0x100000000);
-    comedi_data_write(it, Comedi_subdev_aq, index, 0, // unsigned int range,
+    if (index < s->n_aq) { // until flushed
+        s->writes.insns[s->writes.n_insns - s->n_aq + index].data[0] = data;
+        return;
+    }
+    comedi_data_write(s->it, s->subdev_aq, index, 0, // unsigned int range,
             AREF_GROUND, // unsigned int aref,
             data);
 }
@@ -122,9 +476,17 @@ struct hardware Comedi = {
         com_dio_read,     // dio_read
         com_dio_write,    // dio_write
         com_dio_bitfield, // dio_bitfield
+        com_dio_read_bytes,  // dio_read_bytes
+        com_dio_write_bytes, // dio_write_bytes
+        NULL,             // dio_edges
+        NULL,             // count
         com_data_read,    // data_read
         com_data_write,   // data_write
         com_config,       // hw_config
+        NULL,             // wait
+        NULL,             // clock
+        com_disable,      // release
+        NULL,             // priv
 };
 
 #endif //COMEDI
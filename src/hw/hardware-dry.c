@@ -16,49 +16,60 @@
  along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <stddef.h>
+#include <string.h>
+
 #include "data.h"
 #include "instruction.h"
 #include "rung.h"
 
 #include "plc_iface.h"
 
-int dry_config(void *conf) {
+int dry_config(hardware_t hw, void *conf) {
     return PLC_OK;
 }
 
-int dry_enable() { // Enable bus communication
+int dry_enable(hardware_t hw) { // Enable bus communication
     return PLC_OK;
 }
 
-int dry_disable() { // Disable bus communication
+int dry_disable(hardware_t hw) { // Disable bus communication
     return PLC_OK;
 }
 
-int dry_fetch() {
+int dry_fetch(hardware_t hw) {
     return 0;
 }
 
-int dry_flush() {
+int dry_flush(hardware_t hw) {
     return 0;
 }
 
-void dry_dio_read(unsigned int n, PLC_BYTE *bit) {
+void dry_dio_read(hardware_t hw, unsigned int n, PLC_BYTE *bit) {
     return;
 }
 
-void dry_dio_write(const unsigned char *buf, unsigned int n, PLC_BYTE bit) {
+void dry_dio_write(hardware_t hw, const unsigned char *buf, unsigned int n, PLC_BYTE bit) {
     return;
 }
 
-void dry_dio_bitfield(const PLC_BYTE *mask, PLC_BYTE *bits) {
+void dry_dio_bitfield(hardware_t hw, const PLC_BYTE *mask, PLC_BYTE *bits, unsigned int n) {
+    memset(bits, 0, n);
+}
+
+void dry_dio_read_bytes(hardware_t hw, unsigned int n, PLC_BYTE *bytes) {
+    memset(bytes, 0, n);
+}
+
+void dry_dio_write_bytes(hardware_t hw, unsigned int n, const PLC_BYTE *bytes) {
     return;
 }
 
-void dry_data_read(unsigned int index, uint64_t *value) {
+void dry_data_read(hardware_t hw, unsigned int index, uint64_t *value) {
     return;
 }
 
-void dry_data_write(unsigned int index, uint64_t value) {
+void dry_data_write(hardware_t hw, unsigned int index, uint64_t value) {
     return;
 }
 
@@ -73,7 +84,15 @@ struct hardware Dry = {
         dry_dio_read,     // dio_read
         dry_dio_write,    // dio_write
         dry_dio_bitfield, // dio_bitfield
+        dry_dio_read_bytes,  // dio_read_bytes
+        dry_dio_write_bytes, // dio_write_bytes
+        NULL,             // dio_edges
+        NULL,             // count
         dry_data_read,    // data_read
         dry_data_write,   // data_write
         dry_config,       // hw_config
+        NULL,             // wait
+        NULL,             // clock
+        NULL,             // release
+        NULL,             // priv
 };
@@ -16,10 +16,15 @@
  along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+
 #ifdef GPIOD
 
 #include <gpiod.h>
 #include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
 #include "data.h"
 #include "instruction.h"
@@ -28,139 +33,630 @@
 #include "util.h"
 #include "plc_iface.h"
 
-static struct gpiod_chip *Chip;
+#ifdef GPIOD_V2
+#define GPIOD_LINE_BULK_MAX_LINES 64 // as many lines as a request can hold
+#endif
 
-static struct gpiod_line **InLines = NULL;
-static uint8_t MaxIn = 0;
+/**
+ * @brief The edges struct
+ * edges of the inputs caught from their events, 
+ * until the next scan takes them
+ */
+struct edges {
+    uint8_t on; // event mode
+    uint8_t requested; // the inputs were requested with edge events
+    uint8_t refused;   // their lines cannot raise them
+    PLC_BYTE rising[GPIOD_LINE_BULK_MAX_LINES / BYTESIZE];
+    PLC_BYTE falling[GPIOD_LINE_BULK_MAX_LINES / BYTESIZE];
+    uint64_t counts[GPIOD_LINE_BULK_MAX_LINES]; // rising edges since enabled
+};
 
-static struct gpiod_line **OutLines = NULL;
-static uint8_t MaxOut = 0;
+#ifdef GPIOD_V2
 
-int gpiod_config(void *conf) {
-    conf_gpiod_t c = (conf_gpiod_t) conf;
-    // Open GPIO chip
-    Chip = gpiod_chip_open_by_name(c->chipname);
-    if (!Chip) {
-        plc_log("Failed to open GPIOD chip");
-        
+/**
+ * @brief The gpio struct
+ * state of a GPIOD (libgpiod v2) hardware instance, 
+ * followed by the offsets of its input and then its output lines.
+ * All inputs are requested at once, and so are all outputs
+ */
+struct gpio {
+    struct gpiod_chip *chip;
+    struct gpiod_line_request *in_req; // inputs, with edge events if wanted
+    struct gpiod_edge_event_buffer *events;
+    unsigned int *in_lines;
+    uint8_t max_in;
+    struct gpiod_line_request *out_req;
+    unsigned int *out_lines;
+    uint8_t max_out;
+    struct edges caught;
+};
+
+#else
+
+/**
+ * @brief The gpio struct
+ * state of a GPIOD (libgpiod v1) hardware instance, 
+ * followed by its input and then its output lines.
+ * All inputs are requested at once, and so are all outputs
+ */
+struct gpio {
+    struct gpiod_chip *chip;
+    struct gpiod_line **in_lines;
+    struct gpiod_line_bulk in_bulk; // inputs, to read or wait for at once
+    uint8_t max_in;
+    struct gpiod_line **out_lines;
+    struct gpiod_line_bulk out_bulk; // outputs, to set them at once
+    uint8_t max_out;
+    struct edges caught;
+};
+
+#endif
+
+static struct gpio *gpio_state(hardware_t hw) {
+    if (hw->priv == NULL) { // not configured, no lines
+        hw->priv = calloc(1, sizeof(struct gpio));
+    }
+    return (struct gpio*) hw->priv;
+}
+
+static void catch_edge(struct edges *e, unsigned int n, int rising) {
+    if (!e->on || n >= GPIOD_LINE_BULK_MAX_LINES) {
+        return;
+    }
+    if (rising) {
+        e->rising[n / BYTESIZE] |= 1 << (n % BYTESIZE);
+        e->counts[n]++;
+    } else {
+        e->falling[n / BYTESIZE] |= 1 << (n % BYTESIZE);
+    }
+}
+
+#ifdef GPIOD_V2
+
+static int open_chip(struct gpio *s, const char *name) {
+    char path[MEDSTR];
+    
+    if (strchr(name, '/') == NULL) { // eg. gpiochip0
+        snprintf(path, MEDSTR, "/dev/%s", name);
+        name = path;
+    }
+    s->chip = gpiod_chip_open(name);
+    s->in_lines = (unsigned int*) (s + 1);
+    s->out_lines = s->in_lines + s->max_in;
+    return (s->chip != NULL) ? PLC_OK : PLC_ERR;
+}
+
+static int get_lines(struct gpio *s, const uint32_t *in, const uint32_t *out) {
+    uint32_t i = 0;
+    uint32_t q = 0;
+    for (; i < s->max_in; i++) { // lines are requested when enabled
+        s->in_lines[i] = in[i];
+        plc_log("IN %d => GPIO %d", i, in[i]);
+    }
+    for (; q < s->max_out; q++) {
+        s->out_lines[q] = out[q];
+        plc_log("OUT %d => GPIO %d", q, out[q]);
+    }
+    return PLC_OK;
+}
+
+/**
+ * @brief request a set of lines with a single call
+ * @param the chip
+ * @param the line offsets
+ * @param the number of lines
+ * @param the direction
+ * @param the edges to detect
+ * @return the request, or NULL on error
+ */
+static struct gpiod_line_request *request_lines(struct gpiod_chip *chip, 
+                                                const unsigned int *lines, 
+                                                unsigned int n, 
+                                                enum gpiod_line_direction dir,
+                                                enum gpiod_line_edge edge) {
+    struct gpiod_line_request *r = NULL;
+    struct gpiod_line_settings *settings = gpiod_line_settings_new();
+    struct gpiod_line_config *lines_cfg = gpiod_line_config_new();
+    struct gpiod_request_config *req_cfg = gpiod_request_config_new();
+    
+    if (settings != NULL && lines_cfg != NULL && req_cfg != NULL
+     && gpiod_line_settings_set_direction(settings, dir) == 0
+     && gpiod_line_settings_set_edge_detection(settings, edge) == 0
+     && gpiod_line_config_add_line_settings(lines_cfg, lines, n, settings) == 0) {
+        gpiod_request_config_set_consumer(req_cfg, "librelogic");
+        // room for the events of fast pulses between scans
+        gpiod_request_config_set_event_buffer_size(req_cfg, 16 * GPIOD_LINE_BULK_MAX_LINES);
+        r = gpiod_chip_request_lines(chip, req_cfg, lines_cfg);
+    }
+    if (req_cfg != NULL) {
+        gpiod_request_config_free(req_cfg);
+    }
+    if (lines_cfg != NULL) {
+        gpiod_line_config_free(lines_cfg);
+    }
+    if (settings != NULL) {
+        gpiod_line_settings_free(settings);
+    }
+    return r;
+}
+
+static int request_outputs(struct gpio *s) {
+    if (s->max_out > 0) {
+        s->out_req = request_lines(s->chip, s->out_lines, s->max_out, 
+                                   GPIOD_LINE_DIRECTION_OUTPUT, GPIOD_LINE_EDGE_NONE);
+        if (s->out_req == NULL) {
+            return PLC_ERR;
+        }
+    }
+    return PLC_OK;
+}
+
+static int request_inputs(struct gpio *s, int edges) {
+    s->in_req = request_lines(s->chip, s->in_lines, s->max_in, GPIOD_LINE_DIRECTION_INPUT, 
+                              edges ? GPIOD_LINE_EDGE_BOTH : GPIOD_LINE_EDGE_NONE);
+    if (s->in_req == NULL) {
         return PLC_ERR;
     }
-    MaxIn = c->in_size;
-    MaxOut = c->out_size;
+    if (edges && s->events == NULL) {
+        s->events = gpiod_edge_event_buffer_new(GPIOD_LINE_BULK_MAX_LINES);
+    }
+    s->caught.requested = edges;
+    return (!edges || s->events != NULL) ? PLC_OK : PLC_ERR;
+}
+
+static void release_inputs(struct gpio *s) {
+    if (s->in_req != NULL) {
+        gpiod_line_request_release(s->in_req);
+        s->in_req = NULL;
+    }
+    if (s->events != NULL) {
+        gpiod_edge_event_buffer_free(s->events);
+        s->events = NULL;
+    }
+    s->caught.requested = 0;
+}
+
+static void release_all(struct gpio *s) {
+    release_inputs(s);
+    if (s->out_req != NULL) {
+        gpiod_line_request_release(s->out_req);
+        s->out_req = NULL;
+    }
+}
+
+static int get_value(struct gpio *s, unsigned int n) {
+    return gpiod_line_request_get_value(s->in_req, s->in_lines[n]);
+}
+
+static void set_value(struct gpio *s, unsigned int n, int v) {
+    gpiod_line_request_set_value(s->out_req, s->out_lines[n], 
+                                 v ? GPIOD_LINE_VALUE_ACTIVE : GPIOD_LINE_VALUE_INACTIVE);
+}
+
+static int get_values(struct gpio *s, int *values) {
+    enum gpiod_line_value v[GPIOD_LINE_BULK_MAX_LINES];
+    unsigned int i = 0;
+    
+    if (s->in_req == NULL || gpiod_line_request_get_values(s->in_req, v) < 0) {
+        return PLC_ERR;
+    }
+    for (; i < s->max_in; i++) {
+        values[i] = (v[i] == GPIOD_LINE_VALUE_ACTIVE);
+    }
+    return PLC_OK;
+}
+
+static void set_values(struct gpio *s, const int *values) {
+    enum gpiod_line_value v[GPIOD_LINE_BULK_MAX_LINES];
+    unsigned int q = 0;
     
-    InLines = calloc(MaxIn, sizeof(void*));
-    OutLines = calloc(MaxOut, sizeof(void*));
+    for (; q < s->max_out; q++) {
+        v[q] = values[q] ? GPIOD_LINE_VALUE_ACTIVE : GPIOD_LINE_VALUE_INACTIVE;
+    }
+    gpiod_line_request_set_values(s->out_req, v);
+}
+
+static unsigned int line_index(const struct gpio *s, unsigned int offset) {
+    unsigned int i = 0;
+    while (i < s->max_in && s->in_lines[i] != offset) {
+        i++;
+    }
+    return i;
+}
+
+/**
+ * @brief read the pending edge events of the inputs, 
+ * after waiting for them
+ * @param the state
+ * @param longest time to wait in msec, negative to wait indefinitely
+ * @return 1 if there were events, 0 on timeout, error code otherwise
+ */
+static int read_events(struct gpio *s, long ms) {
+    int r = 0;
+    int n = 0;
+    int i = 0;
     
+    if (s->in_req == NULL || !s->caught.requested) {
+        return PLC_ERR;
+    }
+    r = gpiod_line_request_wait_edge_events(s->in_req, 
+                                            (ms < 0) ? -1 : (int64_t) ms * 1000000);
+    if (r > 0) { // consume them
+        n = gpiod_line_request_read_edge_events(s->in_req, s->events, 
+                                                GPIOD_LINE_BULK_MAX_LINES);
+    }
+    for (; i < n; i++) {
+        struct gpiod_edge_event *e = gpiod_edge_event_buffer_get_event(s->events, i);
+        catch_edge(&s->caught, 
+                   line_index(s, gpiod_edge_event_get_line_offset(e)),
+                   gpiod_edge_event_get_event_type(e) == GPIOD_EDGE_EVENT_RISING_EDGE);
+    }
+    return r;
+}
+
+#else
+
+static int open_chip(struct gpio *s, const char *name) {
+    s->chip = gpiod_chip_open_by_name(name);
+    s->in_lines = (struct gpiod_line**) (s + 1);
+    s->out_lines = s->in_lines + s->max_in;
+    return (s->chip != NULL) ? PLC_OK : PLC_ERR;
+}
+
+static int get_lines(struct gpio *s, const uint32_t *in, const uint32_t *out) {
     uint32_t i = 0;
     uint32_t q = 0;
-    for (; i < MaxIn; i++) { // Open GPIO lines
+    gpiod_line_bulk_init(&s->in_bulk);
+    for (; i < s->max_in; i++) { // Open GPIO lines
 
-        uint32_t v = c->in_lines[i];
-        InLines[i] = gpiod_chip_get_line(Chip, v);
+        uint32_t v = in[i];
+        s->in_lines[i] = gpiod_chip_get_line(s->chip, v);
         
-        if (!InLines[i]) {
+        if (!s->in_lines[i]) {
             plc_log("Could not get input line %d ", v);
 
             return PLC_ERR;
         }
+        gpiod_line_bulk_add(&s->in_bulk, s->in_lines[i]);
         plc_log("IN %d => GPIO %d", i, v);
     }
     
-    for (; q < MaxOut; q++) {
+    gpiod_line_bulk_init(&s->out_bulk);
+    for (; q < s->max_out; q++) {
 
-        uint32_t v = c->out_lines[q];
-        OutLines[q] = gpiod_chip_get_line(Chip, v);
+        uint32_t v = out[q];
+        s->out_lines[q] = gpiod_chip_get_line(s->chip, v);
         
-        if (!OutLines[q]) {
+        if (!s->out_lines[q]) {
             plc_log("Could not get line %d ", v);
 
             return PLC_ERR;
         }
+        gpiod_line_bulk_add(&s->out_bulk, s->out_lines[q]);
 
         plc_log("OUT %d => GPIO %d", q, v);
     }
+    return PLC_OK;
+}
 
+static int request_outputs(struct gpio *s) {
+    int zeros[GPIOD_LINE_BULK_MAX_LINES];
+    
+    memset(zeros, 0, sizeof(zeros));
+    // Open lines for output
+    if (s->max_out > 0 
+     && gpiod_line_request_bulk_output(&s->out_bulk, "librelogic", zeros) < 0) {
+        return PLC_ERR;
+    }
     return PLC_OK;
 }
 
-int gpiod_enable() { // Enable
+/**
+ * @brief open lines for input: with edge events, 
+ * each line gets a descriptor of its own and is read on its own
+ * @param the state
+ * @param request edge events
+ * @return OK or error
+ */
+static int request_inputs(struct gpio *s, int edges) {
+    int r = edges ? gpiod_line_request_bulk_both_edges_events(&s->in_bulk, "librelogic")
+                  : gpiod_line_request_bulk_input(&s->in_bulk, "librelogic");
+    if (r < 0) {
+        return PLC_ERR;
+    }
+    s->caught.requested = edges;
+    return PLC_OK;
+}
+
+static void release_inputs(struct gpio *s) {
+    if (s->max_in > 0) { // Release GPIO lines
+        gpiod_line_release_bulk(&s->in_bulk);
+    }
+    s->caught.requested = 0;
+}
+
+static void release_all(struct gpio *s) {
+    release_inputs(s);
+    if (s->max_out > 0) {
+        gpiod_line_release_bulk(&s->out_bulk);
+    }
+}
+
+static int get_value(struct gpio *s, unsigned int n) {
+    return gpiod_line_get_value(s->in_lines[n]);
+}
+
+static void set_value(struct gpio *s, unsigned int n, int v) {
+    gpiod_line_set_value(s->out_lines[n], v);
+}
+
+static int get_values(struct gpio *s, int *values) {
+    if (s->max_in == 0 || gpiod_line_get_value_bulk(&s->in_bulk, values) < 0) {
+        return PLC_ERR;
+    }
+    return PLC_OK;
+}
+
+static void set_values(struct gpio *s, const int *values) {
+    gpiod_line_set_value_bulk(&s->out_bulk, values);
+}
+
+static unsigned int line_index(const struct gpio *s, const struct gpiod_line *line) {
     unsigned int i = 0;
-    unsigned int q = 0;
-    int ok = 0;
-    // Open lines for output
-    for (; q < MaxOut; q++) { //
-        ok = gpiod_line_request_output(OutLines[q], "librelogic", 0);
-        if (ok < 0) {
-            plc_log("Could not get output %d ", q);
+    while (i < s->max_in && s->in_lines[i] != line) {
+        i++;
+    }
+    return i;
+}
 
-            return PLC_ERR;
+/**
+ * @brief read the pending edge events of the inputs, 
+ * after waiting for them
+ * @param the state
+ * @param longest time to wait in msec, negative to wait indefinitely
+ * @return 1 if there were events, 0 on timeout, error code otherwise
+ */
+static int read_events(struct gpio *s, long ms) {
+    struct gpiod_line_bulk events;
+    struct gpiod_line_event e[GPIOD_LINE_BULK_MAX_LINES];
+    struct timespec ts;
+    unsigned int i = 0;
+    int r = 0;
+    
+    if (s->max_in == 0 || !s->caught.requested) {
+        return PLC_ERR;
+    }
+    ts.tv_sec = ms / 1000;
+    ts.tv_nsec = (ms % 1000) * 1000000;
+    r = gpiod_line_event_wait_bulk(&s->in_bulk, (ms < 0) ? NULL : &ts, &events);
+    for (; r > 0 && i < gpiod_line_bulk_num_lines(&events); i++) { // consume them
+        struct gpiod_line *line = gpiod_line_bulk_get_line(&events, i);
+        int n = gpiod_line_event_read_multiple(line, e, GPIOD_LINE_BULK_MAX_LINES);
+        int j = 0;
+        for (; j < n; j++) {
+            catch_edge(&s->caught, line_index(s, line), 
+                       e[j].event_type == GPIOD_LINE_EVENT_RISING_EDGE);
         }
     }
+    return r;
+}
 
-    // Open lines for input
-    for (; i < MaxIn; i++) { //
-        ok = gpiod_line_request_input(InLines[i], "librelogic");
-        if (ok < 0) {
-            plc_log("Could not get input %d ", i);
+#endif
 
-            return PLC_ERR;
+/**
+ * @brief request the inputs, with edge events if wanted and the lines
+ * can raise them, else to read their levels only
+ * @param the state
+ * @param edge events are wanted
+ * @return OK or error
+ */
+static int get_inputs(struct gpio *s, int edges) {
+    if (s->max_in == 0) {
+        return PLC_OK;
+    }
+    if (edges && !s->caught.refused) {
+        if (request_inputs(s, TRUE) == PLC_OK) {
+            return PLC_OK;
         }
+        release_inputs(s);
+        plc_log("No edge events on the inputs, reading their levels");
+        s->caught.refused = TRUE;
+    }
+    if (request_inputs(s, FALSE) < PLC_OK) {
+        plc_log("Could not get inputs");
+        
+        return PLC_ERR;
     }
     return PLC_OK;
 }
 
-int gpiod_disable() { // Disable
-    unsigned int i = 0;
-    unsigned int q = 0;
-    for (; i < MaxIn; i++) { // Release GPIO lines
-        gpiod_line_release(InLines[i]);
+int gpiod_release(hardware_t hw) { // the lines and the chip
+    struct gpio *s = gpio_state(hw);
+    
+    if (s->chip != NULL) {
+        release_all(s);
+        gpiod_chip_close(s->chip);
+        s->chip = NULL;
+    }
+    return PLC_OK;
+}
+
+int gpiod_config(hardware_t hw, void *conf) {
+    conf_gpiod_t c = (conf_gpiod_t) conf;
+    struct gpio *s = NULL;
+    
+    if (c->in_size > GPIOD_LINE_BULK_MAX_LINES 
+     || c->out_size > GPIOD_LINE_BULK_MAX_LINES) {
+        plc_log("Too many GPIOD lines, up to %d are supported", 
+                GPIOD_LINE_BULK_MAX_LINES);
+        
+        return PLC_ERR;
+    }
+    if (hw->priv != NULL) { // configured again
+        gpiod_release(hw);
+        free(hw->priv);
+    }
+    hw->priv = calloc(1, sizeof(struct gpio) 
+                       + (c->in_size + c->out_size) * sizeof(void*));
+    s = (struct gpio*) hw->priv;
+    s->max_in = c->in_size;
+    s->max_out = c->out_size;
+    s->caught.on = (c->events != 0);
+    // Open GPIO chip
+    if (open_chip(s, c->chipname) < PLC_OK) {
+        plc_log("Failed to open GPIOD chip");
+        
+        return PLC_ERR;
     }
+    return get_lines(s, c->in_lines, c->out_lines);
+}
+
+int gpiod_enable(hardware_t hw) { // Enable
+    struct gpio *s = gpio_state(hw);
     
-    for (; q < MaxOut; q++) {
-        gpiod_line_release(OutLines[q]);
+    if (s->chip == NULL) {
+        return PLC_ERR;
     }
+    if (request_outputs(s) < PLC_OK) {
+        plc_log("Could not get outputs");
+        
+        return PLC_ERR;
+    }
+    return get_inputs(s, s->caught.on); // read at once, without events
+}
 
+int gpiod_disable(hardware_t hw) { // Disable
+    struct gpio *s = gpio_state(hw);
+    
+    if (s->chip != NULL) {
+        release_all(s);
+    }
     return PLC_OK;
 }
 
-int gpiod_fetch() {
+int gpiod_fetch(hardware_t hw) {
+    struct gpio *s = gpio_state(hw);
+    int rounds = 0;
     
+    while (s->caught.on && s->caught.requested && rounds < BYTESIZE 
+        && read_events(s, 0) > 0) { // drain, without waiting
+        rounds++;
+    }
     return 0;
 }
 
-int gpiod_flush() {
+int gpiod_flush(hardware_t hw) {
     return 0;
 }
 
-void gpiod_dio_read(unsigned int n, PLC_BYTE *bit) {
-    if (n < MaxIn) {
-        int v = gpiod_line_get_value(InLines[n]);
-        *bit = (PLC_BYTE) v;
+void gpiod_dio_read(hardware_t hw, unsigned int n, PLC_BYTE *bit) {
+    struct gpio *s = gpio_state(hw);
+    if (n < s->max_in) {
+        int v = get_value(s, n);
+        *bit = (PLC_BYTE) (v > 0);
     }
     return;
 }
 
-void gpiod_dio_write(const unsigned char *buf, unsigned int n, PLC_BYTE bit) {
+void gpiod_dio_write(hardware_t hw, const unsigned char *buf, unsigned int n, PLC_BYTE bit) {
+    struct gpio *s = gpio_state(hw);
     
-    if (n < MaxOut) {
-        gpiod_line_set_value(OutLines[n], bit);
+    if (n < s->max_out) {
+        set_value(s, n, bit);
     }
     return;
 }
 
-void gpiod_dio_bitfield(const PLC_BYTE *mask, PLC_BYTE *bits) {
-    return;
+void gpiod_dio_read_bytes(hardware_t hw, unsigned int n, PLC_BYTE *bytes) {
+    struct gpio *s = gpio_state(hw);
+    int values[GPIOD_LINE_BULK_MAX_LINES];
+    unsigned int i = 0;
+    
+    memset(bytes, 0, n);
+    if (s->max_in == 0 || get_values(s, values) < PLC_OK) { // a single call
+        return;
+    }
+    for (; i < s->max_in && i < n * BYTESIZE; i++) { // a line per bit
+        bytes[i / BYTESIZE] |= (values[i] != 0) << (i % BYTESIZE);
+    }
+}
+
+void gpiod_dio_write_bytes(hardware_t hw, unsigned int n, const PLC_BYTE *bytes) {
+    struct gpio *s = gpio_state(hw);
+    int values[GPIOD_LINE_BULK_MAX_LINES];
+    unsigned int i = 0;
+    
+    if (s->max_out == 0) {
+        return;
+    }
+    for (; i < s->max_out; i++) { // lines beyond the outputs are reset
+        values[i] = (i < n * BYTESIZE) ? (bytes[i / BYTESIZE] >> (i % BYTESIZE)) & 1 : 0;
+    }
+    set_values(s, values); // a single call
+}
+
+void gpiod_dio_edges(hardware_t hw, unsigned int n, PLC_BYTE *rising, PLC_BYTE *falling) {
+    struct gpio *s = gpio_state(hw);
+    unsigned int i = 0;
+    
+    for (; i < n; i++) { // and start over
+        rising[i] = (i < sizeof(s->caught.rising)) ? s->caught.rising[i] : 0;
+        falling[i] = (i < sizeof(s->caught.falling)) ? s->caught.falling[i] : 0;
+    }
+    memset(s->caught.rising, 0, sizeof(s->caught.rising));
+    memset(s->caught.falling, 0, sizeof(s->caught.falling));
 }
 
-void gpiod_data_read(unsigned int index, uint64_t *value) {
+int gpiod_count(hardware_t hw, unsigned int n, uint64_t *count) {
+    struct gpio *s = gpio_state(hw);
+    
+    if (!s->caught.on || !s->caught.requested || n >= s->max_in) { // counted from the events only
+        return PLC_ERR;
+    }
+    *count = s->caught.counts[n];
+    return PLC_OK;
+}
+
+void gpiod_dio_bitfield(hardware_t hw, const PLC_BYTE *mask, PLC_BYTE *bits, unsigned int n) {
+    struct gpio *s = gpio_state(hw);
+    unsigned int q = 0;
+    
+    for (; q < s->max_out && q < n * BYTESIZE; q++) {
+        if ((mask[q / BYTESIZE] >> (q % BYTESIZE)) & 1) {
+            set_value(s, q, (bits[q / BYTESIZE] >> (q % BYTESIZE)) & 1);
+        }
+    }
+    gpiod_dio_read_bytes(hw, n, bits);
+}
+
+void gpiod_data_read(hardware_t hw, unsigned int index, uint64_t *value) {
     return;
 }
 
-void gpiod_data_write(unsigned int index, uint64_t value) {
+void gpiod_data_write(hardware_t hw, unsigned int index, uint64_t value) {
     
     return;
 }
 
+int gpiod_wait(hardware_t hw, long ms) {
+    struct gpio *s = gpio_state(hw);
+    int r = 0;
+    
+    if (!s->caught.requested && !s->caught.refused && s->max_in > 0) {
+        release_inputs(s); // tickless: the events are wanted from now on
+        if (get_inputs(s, TRUE) < PLC_OK) {
+            
+            return PLC_ERR;
+        }
+    }
+    r = read_events(s, ms); // the edges are kept for the scan
+    if (r < 0) {
+        
+        return PLC_ERR;
+    }
+    return r;
+}
+
 struct hardware Gpiod = {
         HW_GPIOD,
         0,                  // error code
@@ -172,9 +668,17 @@ struct hardware Gpiod = {
         gpiod_dio_read,     // dio_read
         gpiod_dio_write,    // dio_write
         gpiod_dio_bitfield, // dio_bitfield
+        gpiod_dio_read_bytes,  // dio_read_bytes
+        gpiod_dio_write_bytes, // dio_write_bytes
+        gpiod_dio_edges,    // dio_edges
+        gpiod_count,        // count
         gpiod_data_read,    // data_read
         gpiod_data_write,   // data_write
         gpiod_config,       // hw_config
+        gpiod_wait,         // wait
+        NULL,               // clock
+        gpiod_release,      // release
+        NULL,               // priv
 };
 
 #endif
@@ -0,0 +1,464 @@
+/*******************************************************************************
+ LibreLogic : a free PLC library
+ Copyright (C) 2022, Antonis K. (kalamara AT ceid DOT upatras DOT gr)
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef IIO
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "data.h"
+#include "instruction.h"
+#include "rung.h"
+
+#include "util.h"
+#include "plc_iface.h"
+
+#define MAXIIO 64 // channels of each direction
+#define IIO_DEVICES "%s/sys/bus/iio/devices/iio:device%u"
+
+/**
+ * @brief a scan element of the buffered capture, 
+ * as its _index and _type attributes describe it
+ */
+struct iio_channel {
+    char name[TINYSTR];  // eg. in_voltage0
+    unsigned int index;  // order in the scan
+    unsigned int offset; // bytes from the start of the scan
+    unsigned int bytes;  // of its storage
+    unsigned int bits;   // of the sample
+    unsigned int shift;
+    uint8_t sign;
+    uint8_t big;         // big endian
+};
+
+/**
+ * @brief The iio struct
+ * state of a Linux industrial I/O hardware instance.
+ * Analog inputs are captured in scans from the buffer of their device,
+ * analog outputs are written to the raw attributes of theirs
+ */
+struct iio {
+    char root[MEDSTR];   // prefix of /sys and /dev
+    char trigger[SMALLSTR];
+    uint32_t adc_device;
+    uint32_t dac_device;
+    uint32_t buffer;     // scans
+    uint32_t nai;
+    uint32_t dac_size;   // outputs configured, 0 for every out_voltage
+    uint32_t naq;        // outputs open
+    struct iio_channel ai[MAXIIO];
+    unsigned int scan;   // bytes per scan
+    unsigned char *scans;// as read from the buffer
+    int fd;              // of the buffer
+    uint64_t in[MAXIIO]; // of the newest scan
+    int dac[MAXIIO];     // raw attributes of the outputs
+    uint64_t out[MAXIIO];
+    uint64_t written[MAXIIO];
+};
+
+static struct iio *iio_state(hardware_t hw) {
+    if (hw->priv == NULL) {
+        struct iio *s = (struct iio*) calloc(1, sizeof(struct iio));
+        unsigned int i = 0;
+        if (s != NULL) {
+            s->fd = -1;
+            for (; i < MAXIIO; i++) {
+                s->dac[i] = -1; // not open
+            }
+        }
+        hw->priv = s;
+    }
+    return (struct iio*) hw->priv;
+}
+
+int iio_config(hardware_t hw, void *conf) {
+    struct iio *s = iio_state(hw);
+    conf_iio_t c = (conf_iio_t) conf;
+
+    snprintf(s->root, MEDSTR, "%s", c->root ? c->root : "");
+    snprintf(s->trigger, SMALLSTR, "%s", c->trigger ? c->trigger : "");
+    s->adc_device = c->adc_device;
+    s->dac_device = c->dac_device;
+    s->buffer = c->buffer;
+    s->nai = c->adc_size;
+    s->dac_size = c->dac_size;
+    hw->label = c->label;
+    
+    return PLC_OK;
+}
+
+/**
+ * @brief write a value to an attribute of a device
+ * @param the state
+ * @param the device
+ * @param the attribute, relative to the device
+ * @param the value
+ * @return OK or error
+ */
+static int iio_set(const struct iio *s, unsigned int dev, 
+                   const char *attr, const char *val) {
+    char path[MAXSTR];
+    int fd = -1;
+    int r = PLC_OK;
+    
+    snprintf(path, MAXSTR, IIO_DEVICES "/%s", s->root, dev, attr);
+    if ((fd = open(path, O_WRONLY)) < 0) {
+        return PLC_ERR;
+    }
+    if (write(fd, val, strlen(val)) < 0) {
+        r = PLC_ERR;
+    }
+    close(fd);
+    return r;
+}
+
+static int iio_get(const struct iio *s, unsigned int dev, 
+                   const char *attr, char *val, unsigned int len) {
+    char path[MAXSTR];
+    int fd = -1;
+    int n = 0;
+    
+    snprintf(path, MAXSTR, IIO_DEVICES "/%s", s->root, dev, attr);
+    if ((fd = open(path, O_RDONLY)) < 0) {
+        return PLC_ERR;
+    }
+    n = read(fd, val, len - 1);
+    close(fd);
+    if (n < 0) {
+        return PLC_ERR;
+    }
+    val[n] = 0;
+    return PLC_OK;
+}
+
+/**
+ * @brief describe a scan element from its attributes
+ * @param the state
+ * @param the channel, with its name
+ * @return OK or error
+ */
+static int iio_describe(const struct iio *s, struct iio_channel *c) {
+    char attr[MEDSTR];
+    char val[TINYSTR];
+    char endian = 0;
+    char sign = 0;
+    unsigned int storage = 0;
+    const char *shift = NULL;
+    
+    snprintf(attr, MEDSTR, "scan_elements/%s_index", c->name);
+    if (iio_get(s, s->adc_device, attr, val, TINYSTR) != PLC_OK) {
+        return PLC_ERR;
+    }
+    c->index = strtoul(val, NULL, 10);
+    snprintf(attr, MEDSTR, "scan_elements/%s_type", c->name);
+    // eg. le:s12/16>>4
+    if (iio_get(s, s->adc_device, attr, val, TINYSTR) != PLC_OK
+    || sscanf(val, "%ce:%c%u/%u", &endian, &sign, &c->bits, &storage) < 4
+    || storage == 0 || storage > LONG_BYTES * BYTESIZE || storage % BYTESIZE
+    || c->bits == 0 || c->bits > storage) {
+        return PLC_ERR;
+    }
+    shift = strstr(val, ">>");
+    c->shift = shift ? strtoul(shift + 2, NULL, 10) : 0;
+    c->bytes = storage / BYTESIZE;
+    c->sign = (sign == 's');
+    c->big = (endian == 'b');
+    return PLC_OK;
+}
+
+/**
+ * @brief find the input scan elements of the capture device, in scan order
+ * @param the state
+ * @param the channels found
+ * @return how many
+ */
+static unsigned int iio_elements(const struct iio *s, struct iio_channel *found) {
+    char path[MAXSTR];
+    DIR *dir = NULL;
+    struct dirent *e = NULL;
+    unsigned int n = 0;
+    
+    snprintf(path, MAXSTR, IIO_DEVICES "/scan_elements", s->root, s->adc_device);
+    if ((dir = opendir(path)) == NULL) {
+        return 0;
+    }
+    while ((e = readdir(dir)) != NULL && n < MAXIIO) {
+        unsigned int len = strlen(e->d_name);
+        unsigned int i = n;
+        struct iio_channel c;
+        
+        if (strncmp(e->d_name, "in_", 3) || len < 4 || len >= TINYSTR
+        || strcmp(e->d_name + len - 3, "_en")) {
+            continue;
+        }
+        memset(&c, 0, sizeof(struct iio_channel));
+        memcpy(c.name, e->d_name, len - 3);
+        if (iio_describe(s, &c) != PLC_OK) {
+            continue;
+        }
+        for (; i > 0 && found[i - 1].index > c.index; i--) { // by index
+            found[i] = found[i - 1];
+        }
+        found[i] = c;
+        n++;
+    }
+    closedir(dir);
+    return n;
+}
+
+/**
+ * @brief enable the first scan elements, lay out the scan, 
+ * and start the buffered capture
+ * @param the state
+ * @return OK or error
+ */
+static int iio_capture(struct iio *s) {
+    struct iio_channel found[MAXIIO];
+    char attr[MEDSTR];
+    char path[MAXSTR];
+    char val[TINYSTR];
+    unsigned int n = iio_elements(s, found);
+    unsigned int i = 0;
+    unsigned int offset = 0;
+    unsigned int align = 1;
+    
+    if (s->nai == 0 || s->nai > n) {
+        s->nai = n;
+    }
+    for (; i < n; i++) { // the rest are left out of the scan
+        snprintf(attr, MEDSTR, "scan_elements/%s_en", found[i].name);
+        if (iio_set(s, s->adc_device, attr, i < s->nai ? "1" : "0") != PLC_OK) {
+            return PLC_ERR;
+        }
+    }
+    for (i = 0; i < s->nai; i++) { // each sample aligned to its storage
+        s->ai[i] = found[i];
+        offset = (offset + s->ai[i].bytes - 1) / s->ai[i].bytes * s->ai[i].bytes;
+        s->ai[i].offset = offset;
+        offset += s->ai[i].bytes;
+        if (s->ai[i].bytes > align) {
+            align = s->ai[i].bytes;
+        }
+    }
+    s->scan = (offset + align - 1) / align * align;
+    if (s->scan == 0) {
+        return PLC_OK;
+    }
+    if (s->trigger[0] 
+    && iio_set(s, s->adc_device, "trigger/current_trigger", s->trigger) != PLC_OK) {
+        return PLC_ERR;
+    }
+    if (s->buffer > 0) {
+        snprintf(val, TINYSTR, "%u", s->buffer);
+        if (iio_set(s, s->adc_device, "buffer/length", val) != PLC_OK) {
+            return PLC_ERR;
+        }
+    } else if (iio_get(s, s->adc_device, "buffer/length", val, TINYSTR) != PLC_OK
+           || (s->buffer = strtoul(val, NULL, 10)) == 0) {
+        s->buffer = 1;
+    }
+    if ((s->scans = (unsigned char*) calloc(s->buffer, s->scan)) == NULL
+    || iio_set(s, s->adc_device, "buffer/enable", "1") != PLC_OK) {
+        return PLC_ERR;
+    }
+    snprintf(path, MAXSTR, "%s/dev/iio:device%u", s->root, s->adc_device);
+    if ((s->fd = open(path, O_RDONLY | O_NONBLOCK)) < 0) {
+        return PLC_ERR;
+    }
+    return PLC_OK;
+}
+
+/**
+ * @brief open the raw attributes of the analog outputs
+ * @param the state
+ * @return OK or error
+ */
+static int iio_outputs(struct iio *s) {
+    char path[MAXSTR];
+    unsigned int limit = (s->dac_size == 0 || s->dac_size > MAXIIO) ? MAXIIO : s->dac_size;
+    unsigned int i = 0;
+    
+    for (; i < limit; i++) {
+        snprintf(path, MAXSTR, IIO_DEVICES "/out_voltage%u_raw", 
+                 s->root, s->dac_device, i);
+        if ((s->dac[i] = open(path, O_WRONLY)) < 0) {
+            break;
+        }
+        s->written[i] = ~0ULL; // written on the first flush
+    }
+    s->naq = i;
+    return PLC_OK;
+}
+
+int iio_enable(hardware_t hw) { // Enable bus communication
+    struct iio *s = iio_state(hw);
+    
+    if (iio_capture(s) != PLC_OK) {
+        plc_log("Could not capture from iio:device%u", s->adc_device);
+        return PLC_ERR;
+    }
+    return iio_outputs(s);
+}
+
+int iio_disable(hardware_t hw) { // Disable bus communication
+    struct iio *s = iio_state(hw);
+    unsigned int i = 0;
+    
+    if (s->fd >= 0) {
+        close(s->fd);
+        s->fd = -1;
+        iio_set(s, s->adc_device, "buffer/enable", "0");
+    }
+    if (s->scans != NULL) {
+        free(s->scans);
+        s->scans = NULL;
+    }
+    for (; i < s->naq; i++) {
+        if (s->dac[i] >= 0) {
+            close(s->dac[i]);
+            s->dac[i] = -1;
+        }
+    }
+    s->naq = 0;
+    return PLC_OK;
+}
+
+/**
+ * @brief a sample of a scan, sign extended
+ */
+static uint64_t iio_decode(const struct iio_channel *c, const unsigned char *scan) {
+    uint64_t v = 0;
+    unsigned int i = 0;
+    
+    for (; i < c->bytes; i++) {
+        v = (v << BYTESIZE) | scan[c->offset + (c->big ? i : c->bytes - 1 - i)];
+    }
+    v >>= c->shift;
+    if (c->bits < LONG_BYTES * BYTESIZE) {
+        v &= (1ULL << c->bits) - 1;
+        if (c->sign && (v >> (c->bits - 1)) & 1) {
+            v |= ~0ULL << c->bits;
+        }
+    }
+    return v;
+}
+
+int iio_fetch(hardware_t hw) { // the newest of the scans captured since the last one
+    struct iio *s = iio_state(hw);
+    const unsigned char *newest = NULL;
+    unsigned int i = 0;
+    int n = 0;
+    
+    if (s->fd < 0) {
+        return 0;
+    }
+    n = read(s->fd, s->scans, s->buffer * s->scan);
+    if (n < 0) {
+        return (errno == EAGAIN) ? 0 : PLC_ERR;
+    }
+    if (n < s->scan) {
+        return 0;
+    }
+    newest = s->scans + (n / s->scan - 1) * s->scan;
+    for (; i < s->nai; i++) {
+        s->in[i] = iio_decode(&s->ai[i], newest);
+    }
+    return n;
+}
+
+int iio_flush(hardware_t hw) { // only the outputs that changed
+    struct iio *s = iio_state(hw);
+    char val[TINYSTR];
+    unsigned int i = 0;
+    int r = 0;
+    
+    for (; i < s->naq; i++) {
+        if (s->out[i] != s->written[i]) {
+            int len = snprintf(val, TINYSTR, "%lu\n", (unsigned long) s->out[i]);
+            if (pwrite(s->dac[i], val, len, 0) < 0) {
+                r = PLC_ERR;
+            } else {
+                s->written[i] = s->out[i];
+            }
+        }
+    }
+    return r;
+}
+
+void iio_dio_read(hardware_t hw, unsigned int n, PLC_BYTE *bit) { 
+    *bit = 0; // IIO has no digital channels
+}
+
+void iio_dio_write(hardware_t hw, const unsigned char *buf, unsigned int n, PLC_BYTE bit) {
+    return;
+}
+
+void iio_dio_bitfield(hardware_t hw, const PLC_BYTE *mask, PLC_BYTE *bits, unsigned int n) {
+    memset(bits, 0, n);
+}
+
+void iio_dio_read_bytes(hardware_t hw, unsigned int n, PLC_BYTE *bytes) {
+    memset(bytes, 0, n);
+}
+
+void iio_dio_write_bytes(hardware_t hw, unsigned int n, const PLC_BYTE *bytes) {
+    return;
+}
+
+void iio_data_read(hardware_t hw, unsigned int index, uint64_t *value) { // as fetched
+    struct iio *s = iio_state(hw);
+    *value = (index < s->nai) ? s->in[index] : 0;
+}
+
+void iio_data_write(hardware_t hw, unsigned int index, uint64_t value) { // until flushed
+    struct iio *s = iio_state(hw);
+    if (index < s->naq) {
+        s->out[index] = value;
+    }
+}
+
+struct hardware Iio = {
+        HW_IIO,
+        0,                // error code
+        "Linux industrial I/O",
+        iio_enable,       // enable
+        iio_disable,      // disable
+        iio_fetch,        // fetch
+        iio_flush,        // flush
+        iio_dio_read,     // dio_read
+        iio_dio_write,    // dio_write
+        iio_dio_bitfield, // dio_bitfield
+        iio_dio_read_bytes,  // dio_read_bytes
+        iio_dio_write_bytes, // dio_write_bytes
+        NULL,             // dio_edges
+        NULL,             // count
+        iio_data_read,    // data_read
+        iio_data_write,   // data_write
+        iio_config,       // hw_config
+        NULL,             // wait
+        NULL,             // clock
+        iio_disable,      // release
+        NULL,             // priv
+};
+
+#endif //IIO
@@ -19,10 +19,18 @@
 #ifdef SIM
 
 #include <fcntl.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
 
+#include "arena.h"
 #include "data.h"
 #include "instruction.h"
 #include "rung.h"
@@ -32,36 +40,65 @@
 #include "plc_iface.h"
 
 #define ASCIISTART 0x30
+#define SIM_TRIES  64 // reads of the inputs while the plant writes them
 
-FILE *Ifd = NULL;
-FILE *Qfd = NULL;
-char *BufIn = NULL;
-char *BufOut = NULL;
-char *AdcIn = NULL;
-char *AdcOut = NULL;
-
-uint32_t Ni = 0;
-uint32_t Nq = 0;
-uint32_t Nai = 0;
-uint32_t Naq = 0;
+/**
+ * @brief The sim struct
+ * state of a simulated hardware instance
+ */
+struct sim {
+    FILE *ifd;      // input stream
+    FILE *qfd;      // output stream
+    char *buf_in;   // digital input bytes
+    char *buf_out;  // digital output bytes
+    char *adc_in;   // analog input samples
+    char *adc_out;  // analog output samples
+    uint32_t ni;
+    uint32_t nq;
+    uint32_t nai;
+    uint32_t naq;
+    PLC_BYTE zero;           // of a digital byte: ASCII in the files
+    char shm_name[SMALLSTR]; // of the plant's shared memory, if used
+    sim_header_t shm;
+    uint32_t lockstep_ms;
+    uint32_t consumed;       // the last step of the plant taken
+    char *taking;            // inputs being copied from the plant
+    pthread_mutex_t lock;    // the inputs, as fetch replaces them under a poller
+};
 
-struct hardware Sim;
+static struct sim *sim_state(hardware_t hw) {
+    if (hw->priv == NULL) {
+        struct sim *s = (struct sim*) calloc(1, sizeof(struct sim));
+        if (s != NULL) {
+            pthread_mutex_init(&s->lock, NULL);
+        }
+        hw->priv = s;
+    }
+    return (struct sim*) hw->priv;
+}
 
-int sim_config(void *conf) {
+int sim_config(hardware_t hw, void *conf) {
     int r = PLC_OK;
+    struct sim *s = sim_state(hw);
     conf_sim_t c = (conf_sim_t) conf;
-    const char *istr = c->ifname;
+    const char *istr = c->shm ? NULL : c->ifname;
+    const char *ostr = c->shm ? NULL : c->ofname;
+    
+    s->zero = c->shm ? 0 : ASCIISTART;
+    if (c->shm) {
+        snprintf(s->shm_name, SMALLSTR, "%s", c->shm);
+        s->lockstep_ms = c->lockstep_ms;
+    }
     if (istr) {
-        if (!(Ifd = fopen(istr, "r+"))) {
+        if (!(s->ifd = fopen(istr, "r+"))) {
             plc_log("Failed to open simulation input from %s", istr);
             r = PLC_ERR;
         } else {
             plc_log("Opened simulation input from %s", istr);
         }
     }
-    const char *ostr = c->ofname;
     if (ostr) {
-        if (!(Qfd = fopen(ostr, "w+"))) {
+        if (!(s->qfd = fopen(ostr, "w+"))) {
             plc_log("Failed to open simulation output to %s", ostr);
             r = PLC_ERR;
         } else {
@@ -69,154 +106,377 @@ int sim_config(void *conf) {
         }
     }
     
-    Ni = c->in_size;
-    Nq = c->out_size;
-    Nai = c->adc_size;
-    Naq = c->dac_size;
-    Sim.label = c->label;
+    s->ni = c->in_size;
+    s->nq = c->out_size;
+    s->nai = c->adc_size;
+    s->naq = c->dac_size;
+    hw->label = c->label;
 
     return r;
 }
 
-int sim_enable() { // Enable bus communication
+/**
+ * @brief create the shared memory of the plant model, 
+ * laid out as described by struct sim_header
+ * @param the state, with its sizes
+ * @return OK or error
+ */
+static int sim_share(struct sim *s) {
+    size_t inputs = (sizeof(struct sim_header) + CACHELINE - 1) / CACHELINE * CACHELINE;
+    size_t outputs = inputs + (s->ni + CACHELINE - 1) / CACHELINE * CACHELINE;
+    size_t adc = outputs + (s->nq + CACHELINE - 1) / CACHELINE * CACHELINE;
+    size_t dac = adc + (LONG_BYTES * s->nai + CACHELINE - 1) / CACHELINE * CACHELINE;
+    size_t size = dac + LONG_BYTES * s->naq;
+    sim_header_t h = NULL;
+    int fd = shm_open(s->shm_name, O_CREAT | O_RDWR, 0660);
+    
+    if (fd < 0 || ftruncate(fd, size) < 0) {
+        plc_log("Could not create simulation memory %s", s->shm_name);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return PLC_ERR;
+    }
+    h = (sim_header_t) mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (h == MAP_FAILED) {
+        plc_log("Could not map simulation memory %s", s->shm_name);
+        shm_unlink(s->shm_name);
+        return PLC_ERR;
+    }
+    memset(h, 0, size);
+    h->version = SIM_VERSION;
+    h->size = size;
+    h->ni = s->ni;
+    h->nq = s->nq;
+    h->nai = s->nai;
+    h->naq = s->naq;
+    h->inputs = inputs;
+    h->outputs = outputs;
+    h->adc = adc;
+    h->dac = dac;
+    h->lockstep = (s->lockstep_ms > 0);
+    s->shm = h;
+    s->consumed = 0;
+    __atomic_store_n(&h->magic, SIM_MAGIC, __ATOMIC_RELEASE); // ready
+    plc_log("Exchanging simulation I/O through %s", s->shm_name);
+    return PLC_OK;
+}
+
+static long sim_futex(uint32_t *word, int op, uint32_t val, const struct timespec *t) {
+    return syscall(SYS_futex, word, op, val, t, NULL, 0);
+}
+
+/**
+ * @brief in lock step, wait for the plant to publish a step not taken yet
+ * @param the state
+ * @return OK, or error on timeout
+ */
+static int sim_step(struct sim *s) {
+    struct timespec now;
+    uint64_t deadline = 0;
+    
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    deadline = now.tv_sec * 1000000000ULL + now.tv_nsec + s->lockstep_ms * 1000000ULL;
+    for (;;) {
+        uint32_t seq = __atomic_load_n(&s->shm->in_seq, __ATOMIC_ACQUIRE);
+        uint64_t t = 0;
+        struct timespec left;
+        
+        if (seq % 2 == 0 && seq != s->consumed) {
+            return PLC_OK;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        t = now.tv_sec * 1000000000ULL + now.tv_nsec;
+        if (t >= deadline) {
+            return PLC_ERR;
+        }
+        left.tv_sec = (deadline - t) / 1000000000ULL;
+        left.tv_nsec = (deadline - t) % 1000000000ULL;
+        sim_futex(&s->shm->in_seq, FUTEX_WAIT, seq, &left);
+    }
+}
+
+/**
+ * @brief copy the inputs the plant published, 
+ * retrying while it writes them
+ * @param the state
+ * @return bytes read, or error if the plant kept writing them:
+ * the inputs of the last scan are kept
+ */
+static int sim_take(struct sim *s) {
+    sim_header_t h = s->shm;
+    uint32_t seq = 0;
+    int tries = 0;
+    
+    for (; tries < SIM_TRIES; tries++) {
+        seq = __atomic_load_n(&h->in_seq, __ATOMIC_ACQUIRE);
+        if (seq % 2) { // being written
+            continue;
+        }
+        memcpy(s->taking, (char*) h + h->inputs, s->ni);
+        memcpy(s->taking + s->ni, (char*) h + h->adc, LONG_BYTES * s->nai);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (seq == __atomic_load_n(&h->in_seq, __ATOMIC_RELAXED)) { // whole
+            pthread_mutex_lock(&s->lock);
+            memcpy(s->buf_in, s->taking, s->ni);
+            pthread_mutex_unlock(&s->lock);
+            memcpy(s->adc_in, s->taking + s->ni, LONG_BYTES * s->nai);
+            s->consumed = seq;
+            return s->ni + LONG_BYTES * s->nai;
+        }
+    }
+    return PLC_ERR;
+}
+
+/**
+ * @brief publish the outputs of a scan to the plant, and wake it up
+ * @param the state
+ * @return bytes written
+ */
+static int sim_publish(struct sim *s) {
+    sim_header_t h = s->shm;
+    
+    __atomic_add_fetch(&h->out_seq, 1, __ATOMIC_RELAXED); // odd: being written
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy((char*) h + h->outputs, s->buf_out, s->nq);
+    memcpy((char*) h + h->dac, s->adc_out, LONG_BYTES * s->naq);
+    __atomic_add_fetch(&h->out_seq, 1, __ATOMIC_RELEASE);
+    sim_futex(&h->out_seq, FUTEX_WAKE, INT_MAX, NULL);
+    return s->nq + LONG_BYTES * s->naq;
+}
+
+int sim_enable(hardware_t hw) { // Enable bus communication
     int r = PLC_OK;
+    struct sim *s = sim_state(hw);
     // open input and output streams
 
-    if (!(BufIn = (char*) malloc(Ni))) {
+    if (!(s->buf_in = (char*) malloc(s->ni))) {
         r = PLC_ERR;
     } else {
-        memset(BufIn, 0, Ni);
+        memset(s->buf_in, 0, s->ni);
     }
-    if (!(BufOut = (char*) malloc(Nq))) {
+    if (!(s->buf_out = (char*) malloc(s->nq))) {
         r = PLC_ERR;
     } else {
-        memset(BufOut, 0, Nq);
+        memset(s->buf_out, 0, s->nq);
     }
-    if (!(AdcIn = (char*) malloc( LONG_BYTES * Nai))) {
+    if (!(s->adc_in = (char*) malloc( LONG_BYTES * s->nai))) {
         r = PLC_ERR;
     } else {
-        memset(AdcIn, 0, LONG_BYTES * Nai);
+        memset(s->adc_in, 0, LONG_BYTES * s->nai);
     }
-    if (!(AdcOut = (char*) malloc( LONG_BYTES * Naq))) {
+    if (!(s->adc_out = (char*) malloc( LONG_BYTES * s->naq))) {
         r = PLC_ERR;
     } else {
-        memset(AdcOut, 0, LONG_BYTES * Naq);
+        memset(s->adc_out, 0, LONG_BYTES * s->naq);
+    }
+    if (r == PLC_OK && s->shm_name[0] && s->shm == NULL) {
+        r = sim_share(s);
+    }
+    if (r == PLC_OK && s->shm 
+    && !(s->taking = (char*) malloc(s->ni + LONG_BYTES * s->nai))) {
+        r = PLC_ERR;
     }
     return r;
 }
 
-int sim_disable() { // Disable bus communication
+int sim_disable(hardware_t hw) { // Disable bus communication
     int r = PLC_OK;
+    struct sim *s = sim_state(hw);
     // close streams
-    if (Ifd && !fclose(Ifd)) {
-        r = PLC_ERR;
+    if (s->ifd) {
+        if (fclose(s->ifd)) {
+            r = PLC_ERR;
+        }
+        s->ifd = NULL;
+        plc_log("Closed simulation input");
     }
-    plc_log("Closed simulation input");
-    if (Qfd && !fclose(Qfd)) {
-        r = PLC_ERR;
+    if (s->qfd) {
+        if (fclose(s->qfd)) {
+            r = PLC_ERR;
+        }
+        s->qfd = NULL;
+        plc_log("Closed simulation output");
+    }
+    if (s->taking) {
+        free(s->taking);
+        s->taking = NULL;
+    }
+    if (s->buf_in) {
+        free(s->buf_in);
+        s->buf_in = NULL;
+    }
+    if (s->buf_out) {
+        free(s->buf_out);
+        s->buf_out = NULL;
     }
-    plc_log("Closed simulation output");
-    if (BufIn) {
-        free(BufIn);
-        BufIn = NULL;
+    if (s->adc_in) {
+        free(s->adc_in);
+        s->adc_in = NULL;
     }
-    if (BufOut) {
-        free(BufOut);
-        BufOut = NULL;
+    if (s->adc_out) {
+        free(s->adc_out);
+        s->adc_out = NULL;
     }
     return r;
 }
 
-int sim_fetch() {
-    unsigned int digital = Ni;
-    unsigned int analog = Nai;
+int sim_release(hardware_t hw) { // and the region the plant is attached to
+    struct sim *s = sim_state(hw);
+    int r = sim_disable(hw);
+    
+    if (s->shm) {
+        munmap(s->shm, s->shm->size);
+        shm_unlink(s->shm_name);
+        s->shm = NULL;
+    }
+    pthread_mutex_destroy(&s->lock);
+    return r;
+}
+
+int sim_fetch(hardware_t hw) {
+    struct sim *s = sim_state(hw);
+    unsigned int digital = s->ni;
+    unsigned int analog = s->nai;
     int bytes_read = 0;
-    if (Ifd) {
-        bytes_read = fread(BufIn, sizeof(PLC_BYTE), digital, Ifd ? Ifd : stdin);
+    if (s->shm) { // in lock step, a missed step keeps the last inputs
+        if (s->lockstep_ms > 0 && sim_step(s) != PLC_OK) {
+            return PLC_ERR;
+        }
+        return sim_take(s);
+    }
+    pthread_mutex_lock(&s->lock);
+    if (s->ifd) {
+        bytes_read = fread(s->buf_in, sizeof(PLC_BYTE), digital, s->ifd);
         int i = 0;
         for (; i < bytes_read; i++) {
-            if (BufIn[i] >= ASCIISTART) {
-                BufIn[i] -= ASCIISTART;
+            if (s->buf_in[i] >= ASCIISTART) {
+                s->buf_in[i] -= ASCIISTART;
             }
         }
-        bytes_read += fread(AdcIn, sizeof(PLC_BYTE),
-        LONG_BYTES * analog, Ifd ? Ifd : stdin);
+        bytes_read += fread(s->adc_in, sizeof(PLC_BYTE),
+        LONG_BYTES * analog, s->ifd);
 
         if (bytes_read < digital + LONG_BYTES * analog) {
             //plc_log("failed to read from %s, reopening", SimInFile);
-            if (feof(Ifd)) {
-                rewind(Ifd);
+            if (feof(s->ifd)) {
+                rewind(s->ifd);
             } else {
-                sim_disable();
-                sim_enable();
+                sim_disable(hw);
+                sim_enable(hw);
             }
         }
     }
+    pthread_mutex_unlock(&s->lock);
     return bytes_read;
 }
 
-int sim_flush() {
+int sim_flush(hardware_t hw) {
+    struct sim *s = sim_state(hw);
     int bytes_written = 0;
-    unsigned int digital = Nq;
-    unsigned int analog = Naq;
-    if (Qfd) {
-        bytes_written = fwrite(BufOut, sizeof(PLC_BYTE), digital, Qfd);
-        bytes_written += fwrite(AdcOut, sizeof(PLC_BYTE), analog * LONG_BYTES, Qfd);
-        fputc('\n', Qfd);
-        fflush(Qfd);
+    unsigned int digital = s->nq;
+    unsigned int analog = s->naq;
+    if (s->shm) {
+        return sim_publish(s);
+    }
+    if (s->qfd) {
+        bytes_written = fwrite(s->buf_out, sizeof(PLC_BYTE), digital, s->qfd);
+        bytes_written += fwrite(s->adc_out, sizeof(PLC_BYTE), analog * LONG_BYTES, s->qfd);
+        fputc('\n', s->qfd);
+        fflush(s->qfd);
     }
     return bytes_written;
 }
 
-void sim_dio_read(unsigned int n, PLC_BYTE *bit) { // write input n to bit
+void sim_dio_read(hardware_t hw, unsigned int n, PLC_BYTE *bit) { // write input n to bit
+    struct sim *s = sim_state(hw);
     unsigned int b, position;
     position = n / BYTESIZE;
     PLC_BYTE i = 0;
-    if (strlen(BufIn) > position) {
+    pthread_mutex_lock(&s->lock);
+    if (position < s->ni && s->buf_in != NULL) {
         // read a byte from input stream
-        i = BufIn[position];
+        i = s->buf_in[position];
     }
+    pthread_mutex_unlock(&s->lock);
     b = (i >> n % BYTESIZE) % 2;
     *bit = (PLC_BYTE) b;
 }
 
-void sim_dio_write(const unsigned char *buf, unsigned int n, PLC_BYTE bit) { //write bit to n output
+void sim_dio_write(hardware_t hw, const unsigned char *buf, unsigned int n, PLC_BYTE bit) { //write bit to n output
+    struct sim *s = sim_state(hw);
     PLC_BYTE q;
     unsigned int position = n / BYTESIZE;
     q = buf[position];
     q |= bit << n % BYTESIZE;
     // write a byte to output stream
-    q += ASCIISTART; //ASCII
+    q += s->zero; //ASCII
     // plc_log("Send %d to byte %d", q, position);
-    if (strlen(BufOut) >= position) {
-        BufOut[position] = q;
+    if (position < s->nq) {
+        s->buf_out[position] = q;
+    }
+}
+
+void sim_dio_read_bytes(hardware_t hw, unsigned int n, PLC_BYTE *bytes) {
+    struct sim *s = sim_state(hw);
+    unsigned int i = 0;
+    for (; i < n; i++) {
+        bytes[i] = (i < s->ni) ? s->buf_in[i] : 0;
+    }
+}
+
+void sim_dio_write_bytes(hardware_t hw, unsigned int n, const PLC_BYTE *bytes) {
+    struct sim *s = sim_state(hw);
+    unsigned int i = 0;
+    for (; i < n && i < s->nq; i++) {
+        s->buf_out[i] = bytes[i] + s->zero; //ASCII
     }
 }
 
-void sim_dio_bitfield(const PLC_BYTE *mask, PLC_BYTE *bits) { // simultaneously write output bits defined by mask and read all inputs
-    /* FIXME
-     int i=0;
-     unsigned int w = (unsigned int) (*mask);
-     unsigned int b = (unsigned int) (*bits);
-     comedi_dio_bitfield(it, Comedi_subdev_i, w, &b);*/
+void sim_dio_bitfield(hardware_t hw, const PLC_BYTE *mask, PLC_BYTE *bits, unsigned int n) { // simultaneously write output bits defined by mask and read all inputs
+    struct sim *s = sim_state(hw);
+    unsigned int i = 0;
+    for (; i < n && i < s->nq; i++) {
+        if (mask[i] != 0) {
+            PLC_BYTE q = ((PLC_BYTE) s->buf_out[i] >= s->zero) ? s->buf_out[i] - s->zero : 0;
+            q = (q & ~mask[i]) | (bits[i] & mask[i]);
+            s->buf_out[i] = q + s->zero;
+        }
+    }
+    sim_dio_read_bytes(hw, n, bits);
 }
 
-void sim_data_read(unsigned int index, uint64_t *value) {
+void sim_data_read(hardware_t hw, unsigned int index, uint64_t *value) {
+    struct sim *s = sim_state(hw);
     unsigned int pos = index * LONG_BYTES;
     int i = LONG_BYTES - 1;
     *value = 0;
-    if (strlen(AdcIn) > pos) {
+    if (s->shm) { // the plant's words as they are
+        if (index < s->nai) {
+            memcpy(value, s->adc_in + pos, LONG_BYTES);
+        }
+        return;
+    }
+    if (strlen(s->adc_in) > pos) {
         uint64_t mult = 1;
         for (; i >= 0; i--) {
-            *value += (uint64_t) AdcIn[pos + i] * mult;
+            *value += (uint64_t) s->adc_in[pos + i] * mult;
             mult *= 0x100;
         }
     }
 }
 
-void sim_data_write(unsigned int index, uint64_t value) {
+void sim_data_write(hardware_t hw, unsigned int index, uint64_t value) {
+    struct sim *s = sim_state(hw);
     unsigned int pos = index * LONG_BYTES;
-    sprintf(AdcOut + pos, "%lx", value);
+    if (s->shm) {
+        if (index < s->naq) {
+            memcpy(s->adc_out + pos, &value, LONG_BYTES);
+        }
+        return;
+    }
+    sprintf(s->adc_out + pos, "%lx", value);
     return;
 }
 
@@ -231,9 +491,17 @@ struct hardware Sim = {
         sim_dio_read,     // dio_read
         sim_dio_write,    // dio_write
         sim_dio_bitfield, // dio_bitfield
+        sim_dio_read_bytes,  // dio_read_bytes
+        sim_dio_write_bytes, // dio_write_bytes
+        NULL,             // dio_edges
+        NULL,             // count
         sim_data_read,    // data_read
         sim_data_write,   // data_write
         sim_config,       // hw_config
+        NULL,             // wait
+        NULL,             // clock
+        sim_release,      // release
+        NULL,             // priv
 };
 
 #endif
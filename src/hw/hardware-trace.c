@@ -0,0 +1,532 @@
+/*******************************************************************************
+ LibreLogic : a free PLC library
+ Copyright (C) 2022, Antonis K. (kalamara AT ceid DOT upatras DOT gr)
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "data.h"
+#include "instruction.h"
+#include "rung.h"
+
+#include "util.h"
+#include "plc_iface.h"
+
+/*
+ * A trace starts with its header, followed by a record per scan:
+ * the msec since the previous record (or since enabled), 
+ * then the input bytes, the analog inputs, the output bytes and 
+ * the analog outputs that changed since the previous record.
+ * Each section is a count of changes, and per change the distance 
+ * from the previous changed index, and the byte, or the difference 
+ * of the word, zigzag encoded. All numbers are LEB128 varints.
+ */
+#define TRACE_MAGIC   0x4c4c5452 // "LLTR"
+#define TRACE_VERSION 1
+
+struct trace_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t ni;  // bytes
+    uint32_t nq;
+    uint32_t nai; // words
+    uint32_t naq;
+};
+
+/**
+ * @brief The trace struct
+ * state of a trace hardware instance, recording or replaying
+ */
+struct trace {
+    FILE *f;
+    char path[MAXSTR];
+    uint8_t replay;
+    hardware_t device;   // recorded
+    struct trace_header sizes;
+    uint64_t *ain;       // of the scan
+    uint64_t *aout;
+    uint64_t *was_ain;   // as last recorded
+    uint64_t *was_aout;  // as last recorded, or expected in a replay
+    PLC_BYTE *in;
+    PLC_BYTE *out;
+    PLC_BYTE *was_in;
+    PLC_BYTE *was_out;
+    uint64_t base;       // msec when enabled
+    uint64_t now;        // msec of the scan since enabled
+    uint64_t then;       // of the last record
+    uint8_t loaded;      // a record was read ahead for the scan
+    uint8_t pending;     // inputs taken, outputs not yet traced
+    long scans;
+    long diverged;
+};
+
+static struct trace *trace_state(hardware_t hw) {
+    if (hw->priv == NULL) {
+        struct trace *s = (struct trace*) calloc(1, sizeof(struct trace));
+        if (s != NULL) {
+            s->diverged = -1;
+        }
+        hw->priv = s;
+    }
+    return (struct trace*) hw->priv;
+}
+
+static uint64_t trace_ms() {
+    struct timespec ts;
+    
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+int trace_config(hardware_t hw, void *conf) {
+    struct trace *s = trace_state(hw);
+    conf_trace_t c = (conf_trace_t) conf;
+    
+    if (c->path == NULL || (!c->replay && c->device == NULL)) {
+        return PLC_ERR;
+    }
+    snprintf(s->path, MAXSTR, "%s", c->path);
+    s->replay = c->replay;
+    s->device = c->device;
+    s->sizes.ni = c->in_size;
+    s->sizes.nq = c->out_size;
+    s->sizes.nai = c->adc_size;
+    s->sizes.naq = c->dac_size;
+    hw->label = c->label;
+    
+    return PLC_OK;
+}
+
+static void put_varint(FILE *f, uint64_t v) {
+    for (; v >= 0x80; v >>= 7) {
+        fputc((int) (v & 0x7F) | 0x80, f);
+    }
+    fputc((int) v, f);
+}
+
+static int get_varint(FILE *f, uint64_t *v) {
+    int c = 0;
+    int shift = 0;
+    
+    *v = 0;
+    do {
+        if ((c = fgetc(f)) == EOF || shift > 63) {
+            return PLC_ERR;
+        }
+        *v |= (uint64_t) (c & 0x7F) << shift;
+        shift += 7;
+    } while (c & 0x80);
+    return PLC_OK;
+}
+
+static void put_bytes(FILE *f, const PLC_BYTE *now, PLC_BYTE *was, uint32_t n) {
+    uint32_t changed = 0;
+    uint32_t last = 0;
+    uint32_t i = 0;
+    
+    for (; i < n; i++) {
+        changed += (now[i] != was[i]);
+    }
+    put_varint(f, changed);
+    for (i = 0; i < n; i++) {
+        if (now[i] != was[i]) {
+            put_varint(f, i - last);
+            fputc(now[i], f);
+            was[i] = now[i];
+            last = i;
+        }
+    }
+}
+
+static void put_words(FILE *f, const uint64_t *now, uint64_t *was, uint32_t n) {
+    uint32_t changed = 0;
+    uint32_t last = 0;
+    uint32_t i = 0;
+    
+    for (; i < n; i++) {
+        changed += (now[i] != was[i]);
+    }
+    put_varint(f, changed);
+    for (i = 0; i < n; i++) {
+        if (now[i] != was[i]) {
+            int64_t d = (int64_t) (now[i] - was[i]);
+            put_varint(f, i - last);
+            put_varint(f, ((uint64_t) d << 1) ^ (uint64_t) (d >> 63));
+            was[i] = now[i];
+            last = i;
+        }
+    }
+}
+
+static int get_bytes(FILE *f, PLC_BYTE *state, uint32_t n) {
+    uint64_t changed = 0;
+    uint64_t gap = 0;
+    uint64_t i = 0;
+    int c = 0;
+    
+    if (get_varint(f, &changed) != PLC_OK) {
+        return PLC_ERR;
+    }
+    for (; changed > 0; changed--) {
+        if (get_varint(f, &gap) != PLC_OK || (i += gap) >= n 
+        || (c = fgetc(f)) == EOF) {
+            return PLC_ERR;
+        }
+        state[i] = (PLC_BYTE) c;
+    }
+    return PLC_OK;
+}
+
+static int get_words(FILE *f, uint64_t *state, uint32_t n) {
+    uint64_t changed = 0;
+    uint64_t gap = 0;
+    uint64_t z = 0;
+    uint64_t i = 0;
+    
+    if (get_varint(f, &changed) != PLC_OK) {
+        return PLC_ERR;
+    }
+    for (; changed > 0; changed--) {
+        if (get_varint(f, &gap) != PLC_OK || (i += gap) >= n 
+        || get_varint(f, &z) != PLC_OK) {
+            return PLC_ERR;
+        }
+        state[i] += (z >> 1) ^ (~(z & 1) + 1);
+    }
+    return PLC_OK;
+}
+
+/**
+ * @brief claim the I/O images of the trace, in one allocation
+ * @param the state, with its sizes
+ * @return OK or error
+ */
+static int trace_images(struct trace *s) {
+    uint32_t words = s->sizes.nai + s->sizes.naq;
+    uint32_t bytes = s->sizes.ni + s->sizes.nq;
+    uint64_t *w = (uint64_t*) calloc(2 * words + (2 * bytes + 7) / 8 + 1, sizeof(uint64_t));
+    PLC_BYTE *b = (PLC_BYTE*) (w + 2 * words);
+    
+    if (w == NULL) {
+        return PLC_ERR;
+    }
+    s->ain = w;
+    s->was_ain = s->ain + s->sizes.nai;
+    s->aout = s->was_ain + s->sizes.nai;
+    s->was_aout = s->aout + s->sizes.naq;
+    s->in = b;
+    s->was_in = s->in + s->sizes.ni;
+    s->out = s->was_in + s->sizes.ni;
+    s->was_out = s->out + s->sizes.nq;
+    return PLC_OK;
+}
+
+int trace_enable(hardware_t hw) {
+    struct trace *s = trace_state(hw);
+    struct trace_header h;
+    
+    if (s->ain != NULL) { // already
+        return PLC_OK;
+    }
+    if (s->replay) {
+        if ((s->f = fopen(s->path, "rb")) == NULL 
+        || fread(&h, sizeof(struct trace_header), 1, s->f) != 1
+        || h.magic != TRACE_MAGIC || h.version != TRACE_VERSION) {
+            plc_log("Could not replay trace %s", s->path);
+            if (s->f != NULL) {
+                fclose(s->f);
+                s->f = NULL;
+            }
+            return PLC_ERR;
+        }
+        s->sizes = h;
+    } else {
+        if (s->device->enable(s->device) != PLC_OK) {
+            return PLC_ERR;
+        }
+        if ((s->f = fopen(s->path, "wb")) == NULL) {
+            plc_log("Could not record trace %s", s->path);
+            return PLC_ERR;
+        }
+        s->sizes.magic = TRACE_MAGIC;
+        s->sizes.version = TRACE_VERSION;
+        fwrite(&s->sizes, sizeof(struct trace_header), 1, s->f);
+    }
+    if (trace_images(s) != PLC_OK) {
+        fclose(s->f);
+        s->f = NULL;
+        
+        return PLC_ERR;
+    }
+    s->base = trace_ms();
+    s->now = s->then = 0;
+    s->loaded = s->pending = FALSE;
+    s->scans = 0;
+    s->diverged = -1;
+    return PLC_OK;
+}
+
+int trace_disable(hardware_t hw) {
+    struct trace *s = trace_state(hw);
+    
+    if (s->f != NULL) {
+        plc_log("%s %ld scans of trace %s", 
+                s->replay ? "Replayed" : "Recorded", s->scans, s->path);
+        fclose(s->f);
+        s->f = NULL;
+    }
+    if (!s->replay && s->ain != NULL) {
+        s->device->disable(s->device);
+    }
+    if (s->ain != NULL) {
+        free(s->ain);
+        s->ain = NULL;
+    }
+    return PLC_OK;
+}
+
+/**
+ * @brief read the record of the next scan of a replay
+ * @param the state
+ * @return OK, or error at the end of the trace
+ */
+static int trace_load(struct trace *s) {
+    uint64_t dt = 0;
+    
+    if (s->f == NULL
+    || get_varint(s->f, &dt) != PLC_OK
+    || get_bytes(s->f, s->in, s->sizes.ni) != PLC_OK
+    || get_words(s->f, s->ain, s->sizes.nai) != PLC_OK
+    || get_bytes(s->f, s->was_out, s->sizes.nq) != PLC_OK
+    || get_words(s->f, s->was_aout, s->sizes.naq) != PLC_OK) {
+        return PLC_ERR;
+    }
+    s->now += dt;
+    s->loaded = TRUE;
+    return PLC_OK;
+}
+
+uint64_t trace_clock(hardware_t hw) {
+    struct trace *s = trace_state(hw);
+    
+    if (!s->replay) {
+        uint64_t t = trace_ms();
+        s->now = t - s->base;
+        
+        return t;
+    }
+    if (!s->loaded) { // the scan asks for its time before its inputs
+        trace_load(s);
+    }
+    return s->base + s->now;
+}
+
+int trace_fetch(hardware_t hw) {
+    struct trace *s = trace_state(hw);
+    hardware_t d = s->device;
+    uint32_t i = 0;
+    int r = PLC_OK;
+    
+    if (s->ain == NULL) {
+        return PLC_ERR;
+    }
+    if (s->replay) {
+        if (!s->loaded && trace_load(s) != PLC_OK) {
+            if (hw->status == PLC_OK) {
+                plc_log("Trace %s ended after %ld scans", s->path, s->scans);
+            }
+            hw->status = PLC_ERR;
+            
+            return PLC_ERR;
+        }
+        s->loaded = FALSE;
+        s->pending = TRUE;
+        return PLC_OK;
+    }
+    r = d->fetch(d);
+    if (d->dio_read_bytes != NULL) {
+        d->dio_read_bytes(d, s->sizes.ni, s->in);
+    } else {
+        for (; i < BYTESIZE * s->sizes.ni; i++) {
+            PLC_BYTE bit = 0;
+            d->dio_read(d, i, &bit);
+            s->in[i / BYTESIZE] = (s->in[i / BYTESIZE] & ~(1 << i % BYTESIZE)) 
+                                | ((bit & 1) << i % BYTESIZE);
+        }
+    }
+    for (i = 0; i < s->sizes.nai; i++) {
+        d->data_read(d, i, &s->ain[i]);
+    }
+    s->pending = TRUE;
+    return r;
+}
+
+/**
+ * @brief compare the outputs of a replayed scan to the recorded ones,
+ * and report the first difference of the replay
+ * @param the state
+ * @return OK if they match
+ */
+static int trace_compare(struct trace *s) {
+    uint32_t i = 0;
+    
+    for (; i < s->sizes.nq; i++) {
+        if (s->out[i] != s->was_out[i]) {
+            if (s->diverged < 0) {
+                plc_log("Trace %s diverged at scan %ld: output byte %u is 0x%02x, recorded 0x%02x", 
+                        s->path, s->scans, i, s->out[i], s->was_out[i]);
+                s->diverged = s->scans;
+            }
+            return PLC_ERR;
+        }
+    }
+    for (i = 0; i < s->sizes.naq; i++) {
+        if (s->aout[i] != s->was_aout[i]) {
+            if (s->diverged < 0) {
+                plc_log("Trace %s diverged at scan %ld: analog output %u is %lu, recorded %lu", 
+                        s->path, s->scans, i, (unsigned long) s->aout[i], 
+                        (unsigned long) s->was_aout[i]);
+                s->diverged = s->scans;
+            }
+            return PLC_ERR;
+        }
+    }
+    return PLC_OK;
+}
+
+static void trace_record(struct trace *s) {
+    put_varint(s->f, s->now - s->then);
+    s->then = s->now;
+    put_bytes(s->f, s->in, s->was_in, s->sizes.ni);
+    put_words(s->f, s->ain, s->was_ain, s->sizes.nai);
+    put_bytes(s->f, s->out, s->was_out, s->sizes.nq);
+    put_words(s->f, s->aout, s->was_aout, s->sizes.naq);
+}
+
+int trace_flush(hardware_t hw) { // a scan without inputs, eg. when stopped, is not traced
+    struct trace *s = trace_state(hw);
+    hardware_t d = s->device;
+    uint32_t i = 0;
+    int r = PLC_OK;
+    
+    if (s->ain == NULL) {
+        return PLC_ERR;
+    }
+    if (!s->replay) {
+        if (d->dio_write_bytes != NULL) {
+            d->dio_write_bytes(d, s->sizes.nq, s->out);
+        } else {
+            for (; i < BYTESIZE * s->sizes.nq; i++) {
+                d->dio_write(d, s->out, i, (s->out[i / BYTESIZE] >> i % BYTESIZE) & 1);
+            }
+        }
+        for (i = 0; i < s->sizes.naq; i++) {
+            d->data_write(d, i, s->aout[i]);
+        }
+        r = d->flush(d);
+    }
+    if (s->pending) {
+        if (s->replay) {
+            r = trace_compare(s);
+        } else {
+            trace_record(s);
+        }
+        s->pending = FALSE;
+        s->scans++;
+    }
+    return r;
+}
+
+void trace_dio_read(hardware_t hw, unsigned int n, PLC_BYTE *bit) {
+    struct trace *s = trace_state(hw);
+    *bit = (n < BYTESIZE * s->sizes.ni) ? (s->in[n / BYTESIZE] >> n % BYTESIZE) & 1 : 0;
+}
+
+void trace_dio_write(hardware_t hw, const unsigned char *buf, unsigned int n, PLC_BYTE bit) {
+    struct trace *s = trace_state(hw);
+    if (n < BYTESIZE * s->sizes.nq) {
+        s->out[n / BYTESIZE] = (s->out[n / BYTESIZE] & ~(1 << n % BYTESIZE)) 
+                             | ((bit & 1) << n % BYTESIZE);
+    }
+}
+
+void trace_dio_read_bytes(hardware_t hw, unsigned int n, PLC_BYTE *bytes) {
+    struct trace *s = trace_state(hw);
+    unsigned int i = 0;
+    for (; i < n; i++) {
+        bytes[i] = (i < s->sizes.ni) ? s->in[i] : 0;
+    }
+}
+
+void trace_dio_write_bytes(hardware_t hw, unsigned int n, const PLC_BYTE *bytes) {
+    struct trace *s = trace_state(hw);
+    memcpy(s->out, bytes, (n < s->sizes.nq) ? n : s->sizes.nq);
+}
+
+void trace_dio_bitfield(hardware_t hw, const PLC_BYTE *mask, PLC_BYTE *bits, unsigned int n) {
+    struct trace *s = trace_state(hw);
+    unsigned int i = 0;
+    for (; i < n && i < s->sizes.nq; i++) {
+        s->out[i] = (s->out[i] & ~mask[i]) | (bits[i] & mask[i]);
+    }
+    trace_dio_read_bytes(hw, n, bits);
+}
+
+void trace_data_read(hardware_t hw, unsigned int index, uint64_t *value) {
+    struct trace *s = trace_state(hw);
+    *value = (index < s->sizes.nai) ? s->ain[index] : 0;
+}
+
+void trace_data_write(hardware_t hw, unsigned int index, uint64_t value) {
+    struct trace *s = trace_state(hw);
+    if (index < s->sizes.naq) {
+        s->aout[index] = value;
+    }
+}
+
+long plc_trace_divergence(hardware_t hw) {
+    if (hw == NULL || hw->type != HW_TRACE || hw->priv == NULL) {
+        return -1;
+    }
+    return ((struct trace*) hw->priv)->diverged;
+}
+
+struct hardware Trace = {
+        HW_TRACE,
+        0,                // error code
+        "I/O trace",
+        trace_enable,     // enable
+        trace_disable,    // disable
+        trace_fetch,      // fetch
+        trace_flush,      // flush
+        trace_dio_read,   // dio_read
+        trace_dio_write,  // dio_write
+        trace_dio_bitfield, // dio_bitfield
+        trace_dio_read_bytes,  // dio_read_bytes
+        trace_dio_write_bytes, // dio_write_bytes
+        NULL,             // dio_edges
+        NULL,             // count
+        trace_data_read,  // data_read
+        trace_data_write, // data_write
+        trace_config,     // hw_config
+        NULL,             // wait
+        trace_clock,      // clock
+        trace_disable,    // release
+        NULL,             // priv
+};
@@ -22,6 +22,7 @@
 #include <sys/io.h>
 #include <sys/types.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "data.h"
 #include "instruction.h"
@@ -29,23 +30,36 @@
 #include "util.h"
 #include "plc_iface.h"
 
-uint32_t Io_base = 0;
-uint8_t Wr_offs = 0;
-uint8_t Rd_offs = 0;
+/**
+ * @brief The uspace struct
+ * state of a user space i/o port instance
+ */
+struct uspace {
+    uint32_t io_base;
+    uint8_t wr_offs;
+    uint8_t rd_offs;
+};
 
-struct hardware Uspace;
+static struct uspace *usp_state(hardware_t hw) {
+    if (hw->priv == NULL) {
+        hw->priv = calloc(1, sizeof(struct uspace));
+    }
+    return (struct uspace*) hw->priv;
+}
 
-int usp_config(void *conf) {
+int usp_config(hardware_t hw, void *conf) {
+    struct uspace *s = usp_state(hw);
     conf_uspace_t u = (conf_uspace_t) conf;
-    Io_base = u->base;
-    Wr_offs = u->write;
-    Rd_offs = u->read;
-    Uspace.label = u->label;
+    s->io_base = u->base;
+    s->wr_offs = u->write;
+    s->rd_offs = u->read;
+    hw->label = u->label;
 
     return PLC_OK;
 }
 
-int usp_enable() { // Enable bus communication
+int usp_enable(hardware_t hw) { // Enable bus communication
+    struct uspace *s = usp_state(hw);
     int uid = getuid(); // get User id
     int r = seteuid(0); // set User Id to root (0)
     if (r < 0 || geteuid() != 0) {
@@ -60,12 +74,12 @@ int usp_enable() { // Enable bus communication
         return PLC_ERR;
     }
     r = seteuid(uid); // reset User Id
-    outb(0, Io_base + Wr_offs); // clear outputs port
+    outb(0, s->io_base + s->wr_offs); // clear outputs port
     printf("io card enabled\n");
     return PLC_OK;
 }
 
-int usp_disable() { // Disable bus communication
+int usp_disable(hardware_t hw) { // Disable bus communication
     int uid = getuid(); // get User id
     int r = setuid(0); // set User Id to root (0)
     if (r < 0 || getuid() != 0) {
@@ -81,43 +95,66 @@ int usp_disable() { // Disable bus communication
     return PLC_OK;
 }
 
-int usp_fetch() {
+int usp_fetch(hardware_t hw) {
     return 0;
 }
 
-int usp_flush() {
+int usp_flush(hardware_t hw) {
     return 0;
 }
 
-void usp_dio_read(unsigned int n, PLC_BYTE *bit) { // write input n to bit
+void usp_dio_read(hardware_t hw, unsigned int n, PLC_BYTE *bit) { // write input n to bit
+    struct uspace *s = usp_state(hw);
     unsigned int b;
     PLC_BYTE i;
-    i = inb(Io_base + Rd_offs + n / BYTESIZE);
+    i = inb(s->io_base + s->rd_offs + n / BYTESIZE);
     b = (i >> n % BYTESIZE) % 2;
     *bit = (PLC_BYTE) b;
 }
 
-void usp_dio_write(const PLC_BYTE *buf, unsigned int n, unsigned char bit) { // write bit to n output
+void usp_dio_write(hardware_t hw, const PLC_BYTE *buf, unsigned int n, unsigned char bit) { // write bit to n output
+    struct uspace *s = usp_state(hw);
     PLC_BYTE q;
     q = buf[n / BYTESIZE];
     q |= bit << n % BYTESIZE;
-    outb(q, Io_base + Wr_offs + n / BYTESIZE);
+    outb(q, s->io_base + s->wr_offs + n / BYTESIZE);
 }
 
-void usp_dio_bitfield(const PLC_BYTE *write_mask, PLC_BYTE *bits) { // simultaneously write output bits defined my mask and read all inputs
-    /*FIXME
-     int i;
-     for (i = 0; i < Dq; i++)
-     outb(bits[i] & write_mask[i], Base + Wr_offs + i);
-     for (i = 0; i < Di; i++)
-     bits[i] = inb(Base + Rd_offs + i);*/
+void usp_dio_bitfield(hardware_t hw, const PLC_BYTE *write_mask, PLC_BYTE *bits, unsigned int n) { // simultaneously write output bits defined my mask and read all inputs
+    struct uspace *s = usp_state(hw);
+    unsigned int i = 0;
+    PLC_BYTE q = 0;
+    for (; i < n; i++) {
+        if (write_mask[i] != 0) {
+            q = inb(s->io_base + s->wr_offs + i); // the latched outputs
+            q = (q & ~write_mask[i]) | (bits[i] & write_mask[i]);
+            outb(q, s->io_base + s->wr_offs + i);
+        }
+        bits[i] = inb(s->io_base + s->rd_offs + i);
+    }
+}
+
+void usp_dio_read_bytes(hardware_t hw, unsigned int n, PLC_BYTE *bytes) { // a port per byte
+    struct uspace *s = usp_state(hw);
+    unsigned int i = 0;
+    for (; i < n; i++) {
+        bytes[i] = inb(s->io_base + s->rd_offs + i);
+    }
+}
+
+void usp_dio_write_bytes(hardware_t hw, unsigned int n, const PLC_BYTE *bytes) {
+    struct uspace *s = usp_state(hw);
+    unsigned int i = 0;
+    for (; i < n; i++) {
+        outb(bytes[i], s->io_base + s->wr_offs + i);
+    }
 }
 
-void usp_data_read(unsigned int index, uint64_t *value) {
+void usp_data_read(hardware_t hw, unsigned int index, uint64_t *value) {
     return; // unimplemented for user space
 }
 
-void usp_data_write(unsigned int index, uint64_t value) {
+void usp_data_write(hardware_t hw, unsigned int index, uint64_t value) {
     return; // unimplemented for user space
 }
 
@@ -132,9 +169,17 @@ struct hardware Uspace = {
         usp_dio_read,     // dio_read
         usp_dio_write,    // dio_write
         usp_dio_bitfield, // dio_bitfield
+        usp_dio_read_bytes,  // dio_read_bytes
+        usp_dio_write_bytes, // dio_write_bytes
+        NULL,             // dio_edges
+        NULL,             // count
         usp_data_read,    // data_read
         usp_data_write,   // data_write
         usp_config,       // hw_config
+        NULL,             // wait
+        NULL,             // clock
+        NULL,             // release
+        NULL,             // priv
 };
 
 #endif
@@ -18,6 +18,7 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <stdlib.h>
 
 #include "plc_iface.h"
 #include "util.h"
@@ -34,11 +35,15 @@ extern struct hardware Sim;
 #ifdef GPIOD
 extern struct hardware Gpiod;
 #endif
+#ifdef IIO
+extern struct hardware Iio;
+#endif
 #ifdef HW_EXTERNAL
 extern struct hardware HW_EXTERNAL;
 #endif
 
 extern struct hardware Dry;
+extern struct hardware Trace;
 
 hardware_t plc_get_hardware(int type) {
     switch (type) {
@@ -61,6 +66,12 @@ hardware_t plc_get_hardware(int type) {
 #else
             return NULL;
 #endif             
+        case HW_IIO:
+#ifdef IIO        
+            return &Iio;
+#else
+            return NULL;
+#endif             
 
         case HW_SIM:
 #ifdef SIM        
@@ -73,10 +84,40 @@ hardware_t plc_get_hardware(int type) {
 #ifdef HW_EXTERNAL
             return &HW_EXTERNAL;
 #else
-            return NULL;
+            return plc_load_hardware(NULL, NULL);
 #endif
 
+        case HW_TRACE:
+            return &Trace;
+
         default:
             return &Dry;
     }
 }
+
+hardware_t plc_new_hardware(int type) {
+    hardware_t shared = plc_get_hardware(type);
+    hardware_t hw = NULL;
+    
+    if (shared == NULL) {
+        return NULL;
+    }
+    hw = (hardware_t) malloc(sizeof(struct hardware));
+    if (hw != NULL) {
+        *hw = *shared; // the hooks, with a state of its own
+        hw->priv = NULL;
+    }
+    return hw;
+}
+
+void plc_free_hardware(hardware_t hw) {
+    if (hw != NULL) {
+        if (hw->release != NULL && hw->priv != NULL) {
+            hw->release(hw);
+        }
+        if (hw->priv != NULL) {
+            free(hw->priv);
+        }
+        free(hw);
+    }
+}
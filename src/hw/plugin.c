@@ -0,0 +1,107 @@
+/*******************************************************************************
+ LibreLogic : a free PLC library
+ Copyright (C) 2022, Antonis K. (kalamara AT ceid DOT upatras DOT gr)
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <dlfcn.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "data.h"
+#include "plc_iface.h"
+#include "util.h"
+
+#define PLUGIN_ENV    "PLC_HARDWARE" // path of the plugin of HW_EXT, if not built in
+#define PLUGIN_SYMBOL "Hardware"     // the struct hardware a plugin exports
+#define PLUGIN_ABI    "HardwareAbi"  // the PLC_HW_ABI it was built against
+#define MAXPLUGIN     8
+
+/**
+ * @brief The plugin struct
+ * a backend loaded for good, found again by where it was loaded from
+ */
+struct plugin {
+    char path[MAXSTR];
+    char symbol[SMALLSTR];
+    hardware_t hw;
+};
+
+// the plugins are shared by all the PLCs of the process
+static struct plugin Plugins[MAXPLUGIN];
+static unsigned int Loaded = 0;
+static pthread_mutex_t PluginLock = PTHREAD_MUTEX_INITIALIZER;
+
+static hardware_t plugin_load(const char *path, const char *symbol) {
+    void *lib = NULL;
+    hardware_t hw = NULL;
+    const uint32_t *abi = NULL;
+    
+    if ((lib = dlopen(path, RTLD_NOW | RTLD_LOCAL)) == NULL) {
+        plc_log("Could not load hardware from %s: %s", path, dlerror());
+        return NULL;
+    }
+    abi = (const uint32_t*) dlsym(lib, PLUGIN_ABI);
+    if (abi == NULL || *abi != PLC_HW_ABI) { // a struct hardware of another layout
+        plc_log("Hardware in %s is built for interface %d, not %d", 
+                path, abi ? (int) *abi : 0, PLC_HW_ABI);
+        dlclose(lib);
+        return NULL;
+    }
+    hw = (hardware_t) dlsym(lib, symbol);
+    if (hw == NULL 
+    || hw->enable == NULL || hw->disable == NULL 
+    || hw->fetch == NULL || hw->flush == NULL
+    || hw->dio_read == NULL || hw->dio_write == NULL
+    || hw->data_read == NULL || hw->data_write == NULL) {
+        plc_log("No hardware %s in %s", symbol, path);
+        dlclose(lib);
+        return NULL;
+    }
+    plc_log("Using %s from %s", hw->label ? hw->label : "hardware", path);
+    return hw; // loaded for good: its instances may outlive any caller
+}
+
+hardware_t plc_load_hardware(const char *path, const char *symbol) {
+    hardware_t hw = NULL;
+    unsigned int i = 0;
+    
+    if (path == NULL && (path = getenv(PLUGIN_ENV)) == NULL) {
+        return NULL;
+    }
+    if (symbol == NULL) {
+        symbol = PLUGIN_SYMBOL;
+    }
+    pthread_mutex_lock(&PluginLock);
+    for (; i < Loaded && hw == NULL; i++) { // once per process
+        if (strcmp(Plugins[i].path, path) == 0 
+         && strcmp(Plugins[i].symbol, symbol) == 0) {
+            hw = Plugins[i].hw;
+        }
+    }
+    if (hw == NULL && Loaded == MAXPLUGIN) {
+        plc_log("Too many hardware plugins, up to %d are supported", MAXPLUGIN);
+    } else if (hw == NULL && (hw = plugin_load(path, symbol)) != NULL) {
+        snprintf(Plugins[Loaded].path, MAXSTR, "%s", path);
+        snprintf(Plugins[Loaded].symbol, SMALLSTR, "%s", symbol);
+        Plugins[Loaded++].hw = hw;
+    }
+    pthread_mutex_unlock(&PluginLock);
+    return hw;
+}
@@ -31,10 +31,11 @@ struct config_gpiod GpiodConf = {
 };
 #endif //GPIOD
 
-const char * Usage = "Usage: plclite [-p config file] \n \
+const char * Usage = "Usage: plclite [-p config file] [-t] \n \
     Options:\n \
     -h displays this help message\n \
-    -p uses a program fle";
+    -p uses a program fle\n \
+    -t tickless: sleep until an input or timer event when idle";
 plc_t Plc;
 
 void dump(){
@@ -43,13 +44,15 @@ void dump(){
     int i = 0;
     printf("\n%s\n" , "inputs:");
     while(i <  N_GPIO_IN){
-        printf("%d", Plc->di[i++].I);
+        printf("%d", (int) BIT_GET(Plc->di.I, i));
+        i++;
     }
 
     i = 0;
     printf("\n%s\n" , "outputs:");
     while(i <  N_GPIO_OUT){
-        printf("%d", Plc->dq[i++].Q);
+        printf("%d", (int) BIT_GET(Plc->dq.Q, i));
+        i++;
     }
 
     i = 0;
@@ -61,7 +64,8 @@ void dump(){
     i = 0;
     printf("\n%s\n" , "timers:");
     while(i <  N_TIM){
-        printf("%ld %d \n", Plc->t[i].V, Plc->t[i++].Q);
+        printf("%u %d \n", plc_get_t_val(Plc, i), Plc->t[i].Q);
+        i++;
     }
 }
 
@@ -82,11 +86,12 @@ int main(int argc, char **argv)
     char * cvalue = NULL;
     opterr = 0;
     int c;
+    int tickless = 0;
 
     signal(SIGINT, sigkill);
     signal(SIGTERM, sigkill);
 
-    while ((c = getopt (argc, argv, "hp:")) != -1){
+    while ((c = getopt (argc, argv, "hp:t")) != -1){
         switch (c) {
         case 'h':
          printf("%s\n", Usage);
@@ -95,6 +100,9 @@ int main(int argc, char **argv)
         case 'p':
         cvalue = optarg;
         break;
+        case 't':
+        tickless = 1;
+        break;
         case '?':
          printf("%s\n", Usage);
         if (optopt == 'p'){
@@ -120,8 +128,8 @@ int main(int argc, char **argv)
 
     hardware_t hw = NULL;
 #ifdef GPIOD
-    hw = plc_get_hardware(HW_GPIOD); 
-    hw->configure(&GpiodConf);
+    hw = plc_new_hardware(HW_GPIOD);
+    hw->configure(hw, &GpiodConf);
 #endif // GPIOD
     Plc = plc_new(
     1, 
@@ -139,6 +147,7 @@ int main(int argc, char **argv)
 //initialize PLC
     Plc = plc_load_program_file(cvalue, Plc);
 //init cli
+    Plc = plc_set_tickless(Plc, tickless);
     Plc = plc_start(Plc);
     for(;;){
         if(Plc->update){
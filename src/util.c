@@ -20,59 +20,64 @@
 #include <stdarg.h>
 #include <time.h>
 #include <string.h>
+#include <pthread.h>
 
 #include "data.h" 
 #include "util.h"
 
-FILE *ErrLog = NULL;
+// the log is shared by all the PLCs of the process
+static FILE *ErrLog = NULL;
+static pthread_mutex_t LogLock = PTHREAD_MUTEX_INITIALIZER;
 
 void plc_log(const char *msg, ...) {
     va_list arg;
     time_t now;
     time(&now);
     char msgstr[MAXSTR];
+    char timestr[MAXSTR];
     memset(msgstr, 0, MAXSTR);
     va_start(arg, msg);
-    vsprintf(msgstr, msg, arg);
+    vsnprintf(msgstr, MAXSTR, msg, arg);
     va_end(arg);
+    pthread_mutex_lock(&LogLock);
     if (!ErrLog)
         ErrLog = fopen(LOG, "w+");
     if (ErrLog) {
         fprintf(ErrLog, "%s", msgstr);
-        fprintf(ErrLog, ":%s", ctime(&now));
+        fprintf(ErrLog, ":%s", ctime_r(&now, timestr));
         fflush(ErrLog);
     }
     printf("%s\n", msgstr);
+    pthread_mutex_unlock(&LogLock);
 }
 
 void plc_close_log() {
+    pthread_mutex_lock(&LogLock);
     if (ErrLog)
         fclose(ErrLog);
+    ErrLog = NULL;
+    pthread_mutex_unlock(&LogLock);
 }
 
 /*******************debugging tools***************/
 
-double Mean = 0;
-double M2 = 0;
-unsigned long Loop = 0;
-
-void compute_variance(double x) {
-    if (Loop == 0) { // overflow
-        Mean = 0;
-        M2 = 0;
+void compute_variance(variance_t v, double x) {
+    if (v->loop == 0) { // overflow
+        v->mean = 0;
+        v->m2 = 0;
     }
-    Loop++;
-    double delta = x - Mean;
-    Mean += delta / (double) Loop;
-    M2 += delta * (x - Mean);
+    v->loop++;
+    double delta = x - v->mean;
+    v->mean += delta / (double) v->loop;
+    v->m2 += delta * (x - v->mean);
 }
 
-void get_variance(double *mean, double *var) {
-    *mean = Mean;
-    if (Loop > 1)
-        *var = M2 / (double) (Loop - 1);
+void get_variance(const variance_t v, double *mean, double *var) {
+    *mean = v->mean;
+    if (v->loop > 1)
+        *var = v->m2 / (double) (v->loop - 1);
 }
 
-unsigned long get_loop() {
-    return Loop;
+unsigned long get_loop(const variance_t v) {
+    return v->loop;
 }
@@ -26,9 +26,20 @@ void plc_log(const char *msg, ...);
 void plc_close_log();
 
 /*******************debugging tools****************/
+
+/**
+ * @brief running mean and variance of a sample, 
+ * (Welford's algorithm)
+ */
+typedef struct variance {
+    double mean;
+    double m2;          // sum of squares of differences from the mean
+    unsigned long loop; // number of samples
+} *variance_t;
+
 void dump_label(char *label, char *dump);
-void compute_variance(double x);
-void get_variance(double *mean, double *var);
-unsigned long get_loop();
+void compute_variance(variance_t v, double x);
+void get_variance(const variance_t v, double *mean, double *var);
+unsigned long get_loop(const variance_t v);
 
 #endif /* _UTIL_H */
@@ -0,0 +1,109 @@
+/*******************************************************************************
+ LibreLogic : a free PLC library
+ Copyright (C) 2022, Antonis K. (kalamara AT ceid DOT upatras DOT gr)
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "data.h"
+#include "instruction.h"
+#include "rung.h"
+#include "arena.h"
+#include "plc_iface.h"
+#include "util.h"
+
+#define ALIGN(x, a) (((x) + (a) - 1) & ~((size_t) (a) - 1))
+
+int arena_reserve(arena_t a, size_t size, int mode) {
+    if (a == NULL) {
+        return PLC_ERR;
+    }
+    memset(a, 0, sizeof(struct arena));
+    a->mode = mode;
+    a->size = ALIGN(size > 0 ? size : CACHELINE, CACHELINE);
+
+    if (mode & MEM_HUGEPAGE) {
+        size_t huge = ALIGN(a->size, HUGEPAGE);
+        void *m = mmap(NULL, huge, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (m == MAP_FAILED) { // no reserved huge pages, ask for transparent ones
+            m = mmap(NULL, huge, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (m != MAP_FAILED) {
+                madvise(m, huge, MADV_HUGEPAGE);
+            }
+        }
+        if (m != MAP_FAILED) {
+            a->base = (unsigned char*) m;
+            a->size = huge;
+            a->mapped = TRUE;
+        } else {
+            plc_log("Could not map %zu bytes of huge pages", huge);
+        }
+    }
+    if (a->base == NULL) {
+        void *m = NULL;
+        if (posix_memalign(&m, CACHELINE, a->size) != 0) {
+
+            return PLC_ERR;
+        }
+        memset(m, 0, a->size);
+        a->base = (unsigned char*) m;
+    }
+    if (mode & MEM_LOCKED) {
+        if (mlock(a->base, a->size) == 0) {
+            a->locked = TRUE;
+        } else {
+            plc_log("Could not lock %zu bytes in memory", a->size);
+        }
+    }
+    return PLC_OK;
+}
+
+void *arena_take(arena_t a, size_t size) {
+    void *r = NULL;
+    size_t slice = ALIGN(size, CACHELINE);
+    
+    if (a == NULL) {
+        return NULL;
+    }
+    if (a->base != NULL) {
+        if (a->used + slice > a->size) {
+
+            return NULL;
+        }
+        r = a->base + a->used;
+    }
+    a->used += slice;
+    return r;
+}
+
+void arena_release(arena_t a) {
+    if (a == NULL || a->base == NULL) {
+        return;
+    }
+    if (a->locked) {
+        munlock(a->base, a->size);
+    }
+    if (a->mapped) {
+        munmap(a->base, a->size);
+    } else {
+        free(a->base);
+    }
+    memset(a, 0, sizeof(struct arena));
+}
@@ -0,0 +1,193 @@
+/*******************************************************************************
+ LibreLogic : a free PLC library
+ Copyright (C) 2022, Antonis K. (kalamara AT ceid DOT upatras DOT gr)
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#include "data.h"
+#include "instruction.h"
+#include "rung.h"
+#include "plclib.h"
+#include "codec.h"
+
+#define RAW_RANGE 18446744073709551616.0 // UINT64_MAX + 1 as double
+
+/**
+ * @brief load a word from a byte buffer, first byte in the lowest bits
+ * @param buffer padded to whole words
+ * @param word index
+ * @return the word
+ */
+static uint64_t load_word(const PLC_BYTE *bytes, unsigned int w) {
+    uint64_t r = 0;
+    int b = LONG_BYTES - 1;
+    for (; b >= 0; b--) {
+        r = (r << BYTESIZE) | bytes[w * LONG_BYTES + b];
+    }
+    return r;
+}
+
+/**
+ * @brief store a word to a byte buffer, lowest bits in the first byte
+ * @param buffer padded to whole words
+ * @param word index
+ * @param the word
+ */
+static void store_word(PLC_BYTE *bytes, unsigned int w, uint64_t val) {
+    unsigned int b = 0;
+    for (; b < LONG_BYTES; b++) {
+        bytes[w * LONG_BYTES + b] = (PLC_BYTE) (val >> (BYTESIZE * b));
+    }
+}
+
+uint64_t decode_bits(const PLC_BYTE *raw,
+                     const uint64_t *prev,
+                     di_t di,
+                     unsigned int words) {
+    uint64_t delta = 0;
+    unsigned int w = 0;
+#ifdef __AVX2__ // 256 contacts at a time, x86 is little endian
+    __m256i acc = _mm256_setzero_si256();
+    for (; w + 4 <= words; w += 4) {
+        __m256i in = _mm256_loadu_si256((const __m256i *) (raw + w * LONG_BYTES));
+        __m256i mask = _mm256_loadu_si256((const __m256i *) (di->MASK + w));
+        __m256i n_mask = _mm256_loadu_si256((const __m256i *) (di->N_MASK + w));
+        __m256i old = _mm256_loadu_si256((const __m256i *) (prev + w));
+// negative mask has precedence
+        __m256i val = _mm256_andnot_si256(n_mask, _mm256_or_si256(in, mask));
+        __m256i edge = _mm256_xor_si256(val, old);
+        _mm256_storeu_si256((__m256i *) (di->I + w), val);
+        _mm256_storeu_si256((__m256i *) (di->EDGE + w), edge);
+        _mm256_storeu_si256((__m256i *) (di->RE + w), _mm256_and_si256(val, edge));
+        _mm256_storeu_si256((__m256i *) (di->FE + w), _mm256_andnot_si256(val, edge));
+        acc = _mm256_or_si256(acc, edge);
+    }
+    delta = !_mm256_testz_si256(acc, acc);
+#endif
+    for (; w < words; w++) {
+// negative mask has precedence
+        uint64_t val = (load_word(raw, w) | di->MASK[w]) & ~di->N_MASK[w];
+        uint64_t edge = val ^ prev[w];
+        di->I[w] = val;
+        di->EDGE[w] = edge;
+        di->RE[w] = val & edge;
+        di->FE[w] = ~val & edge;
+        delta |= edge;
+    }
+    return delta;
+}
+
+uint64_t latch_edges(const PLC_BYTE *rising,
+                     const PLC_BYTE *falling,
+                     di_t di,
+                     unsigned int words) {
+    uint64_t caught = 0;
+    unsigned int w = 0;
+    for (; w < words; w++) {
+        uint64_t unforced = ~(di->MASK[w] | di->N_MASK[w]);
+        uint64_t re = load_word(rising, w) & unforced;
+        uint64_t fe = load_word(falling, w) & unforced;
+        di->RE[w] |= re;
+        di->FE[w] |= fe;
+        di->EDGE[w] |= re | fe;
+        caught |= re | fe;
+    }
+    return caught;
+}
+
+void encode_bits(PLC_BYTE *raw, const do_t dq, unsigned int words) {
+    unsigned int w = 0;
+#ifdef __AVX2__
+    for (; w + 4 <= words; w += 4) {
+        __m256i out = _mm256_loadu_si256((const __m256i *) (raw + w * LONG_BYTES));
+        __m256i q = _mm256_loadu_si256((const __m256i *) (dq->Q + w));
+        __m256i set = _mm256_loadu_si256((const __m256i *) (dq->SET + w));
+        __m256i reset = _mm256_loadu_si256((const __m256i *) (dq->RESET + w));
+        __m256i mask = _mm256_loadu_si256((const __m256i *) (dq->MASK + w));
+        __m256i n_mask = _mm256_loadu_si256((const __m256i *) (dq->N_MASK + w));
+        __m256i val = _mm256_or_si256(q, _mm256_andnot_si256(reset, set));
+// negative mask has precedence
+        val = _mm256_andnot_si256(n_mask, _mm256_or_si256(val, mask));
+        _mm256_storeu_si256((__m256i *) (raw + w * LONG_BYTES), 
+                            _mm256_or_si256(out, val));
+    }
+#endif
+    for (; w < words; w++) {
+// negative mask has precedence
+        uint64_t val = (dq->Q[w] 
+                     | (dq->SET[w] & ~dq->RESET[w]) 
+                     | dq->MASK[w]) & ~dq->N_MASK[w];
+        store_word(raw, w, load_word(raw, w) | val);
+    }
+}
+
+void decode_analog(const uint64_t *raw,
+                   const conv_t conv,
+                   double *val,
+                   unsigned int n) {
+    unsigned int i = 0;
+#ifdef __AVX2__
+/* AVX2 has no unsigned 64 bit to double conversion:
+ * build both 32 bit halves as exact doubles through the 2^52 / 2^84 
+ * exponent trick, so one rounding happens on the final sum */
+    const __m256i lo_mask = _mm256_set1_epi64x(0xffffffff);
+    const __m256i lo_exp = _mm256_set1_epi64x(0x4330000000000000); // 2^52
+    const __m256i hi_exp = _mm256_set1_epi64x(0x4530000000000000); // 2^84
+    const __m256d bias = _mm256_set1_pd(19342813118337666422669312.0); // 2^84 + 2^52
+    for (; i + 4 <= n; i += 4) {
+        __m256i in = _mm256_loadu_si256((const __m256i *) (raw + i));
+        __m256i lo = _mm256_or_si256(_mm256_and_si256(in, lo_mask), lo_exp);
+        __m256i hi = _mm256_or_si256(_mm256_srli_epi64(in, 32), hi_exp);
+        __m256d d = _mm256_add_pd(
+            _mm256_sub_pd(_mm256_castsi256_pd(hi), bias),
+            _mm256_castsi256_pd(lo));
+        __m256d v = _mm256_add_pd(_mm256_loadu_pd(conv->offset + i),
+            _mm256_mul_pd(d, _mm256_loadu_pd(conv->scale + i)));
+        _mm256_storeu_pd(val + i, v);
+    }
+#endif
+    for (; i < n; i++) {
+        val[i] = conv->offset[i] + (double) raw[i] * conv->scale[i];
+    }
+}
+
+void encode_analog(const double *val,
+                   const conv_t conv,
+                   uint64_t *raw,
+                   unsigned int n) {
+    unsigned int i = 0;
+// no vector double to unsigned conversion below AVX-512, 
+// the multiply-add is left to the compiler
+    for (; i < n; i++) {
+        raw[i] = (uint64_t) ((val[i] - conv->offset[i]) * conv->scale[i]);
+    }
+}
+
+void scale_analog(conv_t conv, unsigned int i, const aio_t io, PLC_BYTE input) {
+    double range = io->max - io->min;
+    
+    conv->offset[i] = io->min;
+    if (input) {
+        conv->scale[i] = range / RAW_RANGE;
+    } else {
+        conv->scale[i] = range != 0.0 ? RAW_RANGE / range : 0.0;
+    }
+}
@@ -0,0 +1,141 @@
+/*******************************************************************************
+ LibreLogic : a free PLC library
+ Copyright (C) 2022, Antonis K. (kalamara AT ceid DOT upatras DOT gr)
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <time.h>
+
+#include "plclib.h"
+
+int counter_add(counters_t c, unsigned char reg, unsigned int input) {
+    unsigned int k = 0;
+    
+    while (k < c->n && c->reg[k] != reg) {
+        k++;
+    }
+    if (k == MAXCOUNTER) {
+        return PLC_ERR;
+    }
+    c->reg[k] = reg;
+    c->input[k] = input;
+    c->source[k] = COUNT_SCAN;
+    if (k == c->n) {
+        c->n++;
+    }
+    return PLC_OK;
+}
+
+static void *poller(void *arg) {
+    counters_t c = (counters_t) arg;
+    struct timespec ts;
+    
+    ts.tv_sec = c->poll / MILLION;
+    ts.tv_nsec = (c->poll % MILLION) * THOUSAND;
+    while (__atomic_load_n(&c->running, __ATOMIC_ACQUIRE)) {
+        unsigned int k = 0;
+        for (; k < c->n; k++) {
+            PLC_BYTE bit = 0;
+            if (c->source[k] != COUNT_POLL) {
+                continue;
+            }
+            pthread_mutex_lock(&c->lock);
+            c->hw->dio_read(c->hw, c->input[k], &bit);
+            pthread_mutex_unlock(&c->lock);
+            if (bit && !c->level[k]) {
+                __atomic_fetch_add(&c->count[k], 1, __ATOMIC_RELAXED);
+            }
+            c->level[k] = bit;
+        }
+        nanosleep(&ts, NULL);
+    }
+    return NULL;
+}
+
+void counter_start(counters_t c, hardware_t hw) {
+    unsigned int k = 0;
+    unsigned int polled = 0;
+    
+    c->hw = hw;
+    for (; k < c->n; k++) {
+        uint64_t now = 0;
+        if (hw->count != NULL && hw->count(hw, c->input[k], &now) == PLC_OK) {
+            c->source[k] = COUNT_HARDWARE;
+            c->seen[k] = now;
+        } else if (c->poll > 0) {
+            c->source[k] = COUNT_POLL;
+            c->seen[k] = __atomic_load_n(&c->count[k], __ATOMIC_RELAXED);
+            c->level[k] = 0;
+            polled++;
+        } else {
+            c->source[k] = COUNT_SCAN;
+        }
+    }
+    if (polled > 0 && !c->running) {
+        pthread_mutex_init(&c->lock, NULL);
+        c->running = TRUE;
+        if (pthread_create(&c->thread, NULL, poller, c) != 0) {
+            plc_log("Could not start the counter poller");
+            c->running = FALSE;
+            pthread_mutex_destroy(&c->lock);
+            for (k = 0; k < c->n; k++) { // fall back to the scan
+                if (c->source[k] == COUNT_POLL) {
+                    c->source[k] = COUNT_SCAN;
+                }
+            }
+        }
+    }
+}
+
+void counter_stop(counters_t c) {
+    if (c->running) {
+        __atomic_store_n(&c->running, FALSE, __ATOMIC_RELEASE);
+        pthread_join(c->thread, NULL);
+        pthread_mutex_destroy(&c->lock);
+    }
+}
+
+void counter_lock(counters_t c) {
+    if (c->running) {
+        pthread_mutex_lock(&c->lock);
+    }
+}
+
+void counter_unlock(counters_t c) {
+    if (c->running) {
+        pthread_mutex_unlock(&c->lock);
+    }
+}
+
+uint64_t counter_take(counters_t c, unsigned int k, const uint64_t *re) {
+    uint64_t now = 0;
+    uint64_t d = 0;
+    
+    switch (c->source[k]) {
+        case COUNT_HARDWARE:
+            if (c->hw->count(c->hw, c->input[k], &now) < PLC_OK) {
+                return 0;
+            }
+            break;
+        case COUNT_POLL:
+            now = __atomic_load_n(&c->count[k], __ATOMIC_RELAXED);
+            break;
+        default:
+            return BIT_GET(re, c->input[k]);
+    }
+    d = now - c->seen[k];
+    c->seen[k] = now;
+    return d;
+}
@@ -0,0 +1,240 @@
+/*******************************************************************************
+ LibreLogic : a free PLC library
+ Copyright (C) 2022, Antonis K. (kalamara AT ceid DOT upatras DOT gr)
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "plclib.h"
+#include "host.h"
+
+/**
+ * @brief monotonic time
+ * @return microseconds since an arbitrary point
+ */
+static uint64_t host_now() {
+    struct timespec ts;
+    
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * MILLION + ts.tv_nsec / THOUSAND;
+}
+
+/**
+ * @brief take the PLC of a queue that is due first, if it is due
+ * @param the host
+ * @param the queue
+ * @param now
+ * @param the earliest deadline seen, lowered to those of the queue
+ * @return index of the PLC, or -1 if none is due
+ */
+static int take_due(host_t h, struct host_queue *q, uint64_t now, uint64_t *next) {
+    unsigned int i = 0;
+    unsigned int first = 0;
+    int slot = -1;
+    
+    pthread_mutex_lock(&q->lock);
+    for (; i < q->size; i++) {
+        if (h->plcs[q->slots[i]].due < h->plcs[q->slots[first]].due) {
+            first = i;
+        }
+    }
+    if (q->size > 0) {
+        if (h->plcs[q->slots[first]].due <= now) {
+            slot = q->slots[first];
+            q->slots[first] = q->slots[--q->size];
+        } else if (h->plcs[q->slots[first]].due < *next) {
+            *next = h->plcs[q->slots[first]].due;
+        }
+    }
+    pthread_mutex_unlock(&q->lock);
+    return slot;
+}
+
+static void put(struct host_queue *q, unsigned int slot) {
+    pthread_mutex_lock(&q->lock);
+    q->slots[q->size++] = slot;
+    pthread_mutex_unlock(&q->lock);
+}
+
+/**
+ * @brief scan a PLC and set its next deadline. 
+ * Missed deadlines are skipped, keeping the phase of the cycle
+ * @param the PLC
+ */
+static void scan(struct hosted *e) {
+    uint64_t period = (e->plc->step > 0) ? e->plc->step * THOUSAND : THOUSAND;
+    uint64_t now = 0;
+    
+    plc_scan(e->plc);
+    e->scans++;
+    now = host_now();
+    e->due += period;
+    if (e->due <= now) {
+        e->overruns++;
+        e->due += ((now - e->due) / period + 1) * period;
+    }
+}
+
+/**
+ * @brief sleep until a deadline or until the host stops
+ * @param the host
+ * @param the deadline, UINT64_MAX for none
+ */
+static void idle(host_t h, uint64_t until) {
+    struct timespec ts;
+    
+    pthread_mutex_lock(&h->lock);
+    if (!h->quit) {
+        if (until == UINT64_MAX) {
+            pthread_cond_wait(&h->wake, &h->lock);
+        } else {
+            ts.tv_sec = until / MILLION;
+            ts.tv_nsec = (until % MILLION) * THOUSAND;
+            pthread_cond_timedwait(&h->wake, &h->lock, &ts);
+        }
+    }
+    pthread_mutex_unlock(&h->lock);
+}
+
+static void *host_worker(void *arg) {
+    struct host_queue *q = (struct host_queue*) arg;
+    host_t h = q->host;
+    
+    while (!__atomic_load_n(&h->quit, __ATOMIC_ACQUIRE)) {
+        uint64_t next = UINT64_MAX;
+        uint64_t now = host_now();
+        unsigned int k = 1;
+        int slot = take_due(h, q, now, &next);
+        
+        for (; slot < 0 && k < h->n; k++) { // steal
+            slot = take_due(h, &h->queues[(q->self + k) % h->n], now, &next);
+        }
+        if (slot < 0) {
+            idle(h, next);
+        } else {
+            scan(&h->plcs[slot]);
+            put(q, slot); // a stolen PLC stays with the thief
+        }
+    }
+    return NULL;
+}
+
+host_t plc_new_host(unsigned int threads) {
+    host_t h = NULL;
+    pthread_condattr_t attr;
+    unsigned int i = 0;
+    
+    if (threads == 0) {
+        return NULL;
+    }
+    h = (host_t) calloc(1, sizeof(struct host));
+    h->n = threads;
+    h->threads = (pthread_t*) calloc(threads, sizeof(pthread_t));
+    h->queues = (struct host_queue*) calloc(threads, sizeof(struct host_queue));
+    for (; i < threads; i++) {
+        pthread_mutex_init(&h->queues[i].lock, NULL);
+        h->queues[i].host = h;
+        h->queues[i].self = i;
+    }
+    pthread_mutex_init(&h->lock, NULL);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&h->wake, &attr);
+    pthread_condattr_destroy(&attr);
+    return h;
+}
+
+int plc_host_add(host_t h, plc_t p) {
+    unsigned int i = 0;
+    
+    if (h == NULL || p == NULL || h->started > 0) {
+        return PLC_ERR;
+    }
+    h->plcs = (struct hosted*) realloc(h->plcs, (h->size + 1) * sizeof(struct hosted));
+    memset(&h->plcs[h->size], 0, sizeof(struct hosted));
+    h->plcs[h->size].plc = p;
+    for (; i < h->n; i++) { // any worker may end up with all of them
+        h->queues[i].slots = (unsigned int*) realloc(h->queues[i].slots, 
+                                    (h->size + 1) * sizeof(unsigned int));
+    }
+    h->queues[h->size % h->n].slots[h->queues[h->size % h->n].size++] = h->size;
+    h->size++;
+    return PLC_OK;
+}
+
+int plc_host_start(host_t h) {
+    uint64_t now = host_now();
+    unsigned int i = 0;
+    
+    if (h == NULL || h->started > 0) {
+        return PLC_ERR;
+    }
+    for (; i < h->size; i++) {
+        h->plcs[i].due = now;
+    }
+    h->quit = 0;
+    for (; h->started < h->n; h->started++) {
+        if (pthread_create(&h->threads[h->started], NULL, 
+                           host_worker, &h->queues[h->started]) != 0) {
+            break;
+        }
+    }
+    if (h->started == 0) {
+        return PLC_ERR;
+    }
+    return PLC_OK;
+}
+
+void plc_host_stop(host_t h) {
+    unsigned int i = 0;
+    
+    if (h == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&h->lock);
+    __atomic_store_n(&h->quit, 1, __ATOMIC_RELEASE);
+    pthread_cond_broadcast(&h->wake);
+    pthread_mutex_unlock(&h->lock);
+    for (; i < h->started; i++) {
+        pthread_join(h->threads[i], NULL);
+    }
+    h->started = 0;
+}
+
+void plc_free_host(host_t h) {
+    unsigned int i = 0;
+    
+    if (h == NULL) {
+        return;
+    }
+    plc_host_stop(h);
+    for (; i < h->n; i++) {
+        pthread_mutex_destroy(&h->queues[i].lock);
+        if (h->queues[i].slots != NULL) {
+            free(h->queues[i].slots);
+        }
+    }
+    pthread_mutex_destroy(&h->lock);
+    pthread_cond_destroy(&h->wake);
+    if (h->plcs != NULL) {
+        free(h->plcs);
+    }
+    free(h->queues);
+    free(h->threads);
+    free(h);
+}
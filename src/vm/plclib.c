@@ -17,7 +17,10 @@
  */
 
 #include <fcntl.h>
+#include <math.h>
 #include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/time.h>
 #include <unistd.h>
 
@@ -25,6 +28,7 @@
 #include "instruction.h"
 #include "rung.h"
 #include "plclib.h"
+#include "codec.h"
 #include "util.h"
 
 const char *LibErrors[N_IE] = {
@@ -37,11 +41,9 @@ const char *LibErrors[N_IE] = {
         "Unreadable character"   //
 };
 
-struct timeval Curtime;
-
 int plc_init(plc_t p) {
     
-    gettimeofday(&Curtime, NULL);
+    gettimeofday(&p->last, NULL);
     
     return PLC_OK;
 }
@@ -58,7 +60,7 @@ static int re(const plc_t p, int type, int idx) {
 
     switch (type) {
         case BOOL_DI:
-            return (p->di[idx].RE);
+            return BIT_GET(p->di.RE, idx);
             break;
         case BOOL_COUNTER:
             return (p->m[idx].PULSE) && (p->m[idx].EDGE);
@@ -80,7 +82,7 @@ static int fe(const plc_t p, int type, int idx) {
 
     switch (type) {
         case BOOL_DI:
-            return (p->di[idx].FE);
+            return BIT_GET(p->di.FE, idx);
             break;
         case BOOL_COUNTER:
             return (!p->m[idx].PULSE) && (p->m[idx].EDGE);
@@ -90,6 +92,126 @@ static int fe(const plc_t p, int type, int idx) {
     }
 }
 
+/**
+ * @brief monotonic time
+ * @return milliseconds since an arbitrary point
+ */
+static uint64_t monotonic_ms() {
+    struct timespec ts;
+    
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * THOUSAND + ts.tv_nsec / (THOUSAND * THOUSAND);
+}
+
+/**
+ * @brief monotonic time, for the watchdogs
+ * @return microseconds since an arbitrary point
+ */
+static uint64_t monotonic_us() {
+    struct timespec ts;
+    
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * MILLION + ts.tv_nsec / THOUSAND;
+}
+
+/**
+ * @brief milliseconds per timer increment
+ * @param the timer
+ * @return the time base S, at least 1
+ */
+static long timer_base(const dt_t t) {
+    return t->S > 0 ? t->S : 1;
+}
+
+/**
+ * @brief value of a timer at a point in time, derived from the time 
+ * it started counting instead of incrementing it every cycle
+ * @param pointer to PLC registers
+ * @param index
+ * @param the time in msec, not before the timer started counting
+ * @param where to store the msec counted towards the next increment, or NULL
+ * @return the timer value
+ */
+static long timer_at(const plc_t p, int idx, uint64_t ms, long *sn) {
+    dt_t t = &p->t[idx];
+    long v = t->V;
+    long n = t->sn;
+    
+    if (t->START && t->V < t->P) {
+        uint64_t total = t->sn + (ms - t->since);
+        uint64_t inc = total / timer_base(t);
+        if (inc >= (uint64_t) (t->P - t->V)) {
+            v = t->P;
+            n = 0;
+        } else {
+            v = t->V + inc;
+            n = total % timer_base(t);
+        }
+    }
+    if (sn != NULL) {
+        *sn = n;
+    }
+    return v;
+}
+
+/**
+ * @brief value of a timer at the current cycle
+ * @param pointer to PLC registers
+ * @param index
+ * @return the timer value
+ */
+static long timer_value(const plc_t p, int idx) {
+    return timer_at(p, idx, p->clock, NULL);
+}
+
+/**
+ * @brief store the current value of a timer, and count on from now
+ * @param pointer to PLC registers
+ * @param index
+ */
+static void hold_timer(plc_t p, int idx) {
+    dt_t t = &p->t[idx];
+    
+    t->V = timer_at(p, idx, p->clock, &t->sn);
+    t->since = p->clock;
+}
+
+/**
+ * @brief update the output of a running timer, 
+ * and schedule it for when it reaches its preset
+ * @param pointer to PLC registers
+ * @param index
+ */
+static void arm_timer(plc_t p, int idx) {
+    dt_t t = &p->t[idx];
+    
+    if (!t->START) {
+        return;
+    }
+    BIT_PUT(p->chg.t_dirty, idx, 1);
+    if (timer_value(p, idx) < t->P) {
+        t->Q = (t->ONDELAY) ? 0 : 1; // on delay
+        wheel_arm(&p->t_wheel, &p->t_node[idx], 
+                  t->since + (t->P - t->V) * timer_base(t) - t->sn);
+    } else {
+        t->Q = (t->ONDELAY) ? 1 : 0; // on delay
+        wheel_disarm(&p->t_wheel, &p->t_node[idx]);
+    }
+}
+
+/**
+ * @brief schedule the next toggle of a blinker, if it is set up
+ * @param pointer to PLC registers
+ * @param index
+ */
+static void arm_blinker(plc_t p, int idx) {
+    if (p->s[idx].S > 0) {
+        wheel_arm(&p->s_wheel, &p->s_node[idx], p->clock + p->s[idx].S);
+    } else {
+        wheel_disarm(&p->s_wheel, &p->s_node[idx]);
+    }
+}
+
 /**
  * @brief set output
  * @param pointer to PLC registers
@@ -103,8 +225,8 @@ static int set(plc_t p, int type, int idx) {
         case BOOL_DQ:
             if (idx / BYTESIZE >= p->nq)
                 return PLC_ERR_BADOPERAND;
-            p->dq[idx].SET = TRUE;
-            p->dq[idx].RESET = FALSE;
+            BIT_ASSIGN(p->dq.SET, idx, TRUE);
+            BIT_ASSIGN(p->dq.RESET, idx, FALSE);
             break;
         case BOOL_COUNTER:
             if (idx >= p->nm)
@@ -113,11 +235,16 @@ static int set(plc_t p, int type, int idx) {
             p->m[idx].RESET = FALSE;
             if (!p->m[idx].PULSE)
                 p->m[idx].EDGE = TRUE;
+            BIT_PUT(p->m_dirty, idx, 1);
             break;
         case BOOL_TIMER:
             if (idx >= p->nt)
                 return PLC_ERR_BADOPERAND;
-            p->t[idx].START = TRUE;
+            if (!p->t[idx].START) {
+                hold_timer(p, idx);
+                p->t[idx].START = TRUE;
+                arm_timer(p, idx);
+            }
             break;
         default:
             return PLC_ERR;
@@ -139,8 +266,8 @@ static int reset(plc_t p, int type, int idx) {
             if (idx / BYTESIZE >= p->nq)
                 return PLC_ERR_BADOPERAND;
             
-            p->dq[idx].RESET = TRUE;
-            p->dq[idx].SET = FALSE;
+            BIT_ASSIGN(p->dq.RESET, idx, TRUE);
+            BIT_ASSIGN(p->dq.SET, idx, FALSE);
             break;
         case BOOL_COUNTER:
             if (idx >= p->nm)
@@ -150,12 +277,15 @@ static int reset(plc_t p, int type, int idx) {
             p->m[idx].SET = FALSE;
             if (p->m[idx].PULSE)
                 p->m[idx].EDGE = TRUE;
+            BIT_PUT(p->m_dirty, idx, 1);
             break;
         case BOOL_TIMER:
             if (idx >= p->nt)
                 return PLC_ERR_BADOPERAND;
             
+            hold_timer(p, idx);
             p->t[idx].START = FALSE;
+            wheel_disarm(&p->t_wheel, &p->t_node[idx]);
             break;
         default:
             return PLC_ERR;
@@ -178,7 +308,7 @@ static int contact(plc_t p, int type, int idx, PLC_BYTE val) {
             if (idx / BYTESIZE >= p->nq)
                 return PLC_ERR_BADOPERAND;
             
-            p->dq[idx].Q = val;
+            BIT_ASSIGN(p->dq.Q, idx, val);
             break;
         case BOOL_COUNTER:
             if (idx >= p->nm)
@@ -189,12 +319,17 @@ static int contact(plc_t p, int type, int idx, PLC_BYTE val) {
             else
                 p->m[idx].EDGE = FALSE;
             p->m[idx].PULSE = val;
+            BIT_PUT(p->m_dirty, idx, 1);
             break;
         case BOOL_TIMER:
             if (idx >= p->nt)
                 return PLC_ERR_BADOPERAND;
             
-            p->t[idx].START = TRUE;
+            if (!p->t[idx].START) {
+                hold_timer(p, idx);
+                p->t[idx].START = TRUE;
+                arm_timer(p, idx);
+            }
             break;
         default:
             return PLC_ERR;
@@ -213,13 +348,14 @@ static int resolve(plc_t p, int type, int idx) {
 // return an operand value
     switch (type) {
         case BOOL_DQ:
-            return p->dq[idx].Q || (p->dq[idx].SET && !p->dq[idx].RESET);
+            return BIT_GET(p->dq.Q, idx) 
+                || (BIT_GET(p->dq.SET, idx) && !BIT_GET(p->dq.RESET, idx));
 
         case BOOL_COUNTER:
             return p->m[idx].PULSE;
 
         case BOOL_DI:
-            return p->di[idx].I;
+            return BIT_GET(p->di.I, idx);
 
         case BOOL_BLINKER:
             return p->s[idx].Q;
@@ -240,9 +376,11 @@ static int resolve(plc_t p, int type, int idx) {
  */
 static int down_timer(plc_t p, int idx) {
 // RESET timer
+    wheel_disarm(&p->t_wheel, &p->t_node[idx]);
     p->t[idx].START = FALSE;
     p->t[idx].V = 0;
     p->t[idx].Q = 0;
+    BIT_PUT(p->chg.t_dirty, idx, 1);
     return 0;
 }
 
@@ -431,6 +569,7 @@ int st_mem_r(const instruction_t op, double val, plc_t p) {
         return PLC_ERR_BADOPERAND;
 
     p->mr[op->byte].V = val;
+    BIT_PUT(p->chg.mr_dirty, op->byte, 1);
     //plc_log("store %lf to m%d", val, op->byte);
     return PLC_OK;
 }
@@ -460,6 +599,7 @@ int st_mem(const instruction_t op, uint64_t val, plc_t p) {
         case T_DWORD:
         case T_LWORD:
             p->m[op->byte].V = val & ((compl << (BYTESIZE * offs)) - 1);
+            BIT_PUT(p->m_dirty, op->byte, 1);
             //plc_log("store 0x%lx to m%d", val, op->byte);
             break;
 
@@ -754,7 +894,7 @@ static int ld_timer(const instruction_t op, uint64_t *val, plc_t p) {
         case T_WORD:
         case T_DWORD:
         case T_LWORD:
-            *val = p->t[op->byte].V & ((compl << offs * BYTESIZE) - 1);
+            *val = timer_value(p, op->byte) & ((compl << offs * BYTESIZE) - 1);
             
             if (op->modifier == IL_NEG)
                 *val = (compl << offs * BYTESIZE) - *val;
@@ -963,11 +1103,7 @@ int instruct(plc_t p, rung_t r, unsigned int *pc) {
 int task(long timeout, plc_t p, rung_t r) {
     unsigned int i = 0;
     unsigned int pc = 0;
-    struct timeval start;
-    struct timeval lapse;
-    
-    gettimeofday(&start, NULL);
-
+    uint64_t start = monotonic_us();
     long delta = 0;
     
     if (r == NULL || p == NULL)
@@ -1008,8 +1144,7 @@ int task(long timeout, plc_t p, rung_t r) {
                     break;
             }
         }
-        gettimeofday(&lapse, NULL);
-        delta = lapse.tv_usec - start.tv_usec;
+        delta = (long) (monotonic_us() - start);
         //plc_log("Instruction %d : OK", i);
         i = pc;
     }
@@ -1028,6 +1163,317 @@ int all_tasks(long timeout, plc_t p) {
     return rv;
 }
 
+/**
+ * @brief the registers an instruction accesses, at the granularity 
+ * they are updated at: a word of packed bits, a channel, 
+ * or all timers, which share the wheel
+ * @param the instruction
+ * @param where to store the keys: register << 1 | written
+ * @return number of keys stored, up to 2
+ */
+static unsigned int access_keys(const instruction_t ins, uint32_t *key) {
+    int reg = -1;
+    unsigned int first = 0;
+    unsigned int last = 0;
+    PLC_BYTE write = FALSE;
+    int t = get_type(ins);
+    unsigned int bytes = (t > T_BOOL && t < T_REAL) ? 1 << (t - T_BYTE) : 1;
+    
+    if (ins->operation == IL_JMP || !(OP_VALID(ins->operand))) {
+        return 0;
+    }
+    switch (ins->operand) {
+        case OP_CONTACT:
+            write = TRUE; // fall through
+        case OP_INPUT:
+        case OP_FALLING:
+        case OP_RISING:
+        case OP_OUTPUT:
+            reg = (ins->operand == OP_CONTACT || ins->operand == OP_OUTPUT) 
+                ? REG_DQ : REG_DI;
+            first = ins->byte / BYTESIZE; // a word is 8 bytes of bits
+            last = (ins->byte + bytes - 1) / BYTESIZE;
+            break;
+        case OP_PULSEIN:
+            write = TRUE; // fall through
+        case OP_MEMORY:
+            reg = REG_M; // counters are marked dirty a word at a time
+            first = last = ins->byte / LWORDSIZE;
+            break;
+        case OP_REAL_MEMIN:
+            write = TRUE; // fall through
+        case OP_REAL_MEMORY:
+            reg = REG_MR;
+            first = last = ins->byte / LWORDSIZE;
+            break;
+        case OP_REAL_CONTACT:
+            write = TRUE; // fall through
+        case OP_REAL_OUTPUT:
+            reg = REG_AQ;
+            first = last = ins->byte;
+            break;
+        case OP_REAL_INPUT:
+            reg = REG_AI;
+            first = last = ins->byte;
+            break;
+        case OP_START:
+            write = TRUE; // fall through
+        case OP_TIMEOUT:
+            reg = REG_T;
+            break;
+        case OP_BLINKOUT:
+            reg = REG_S;
+            break;
+        case OP_WRITE:
+            write = TRUE; // fall through
+        case OP_COMMAND:
+            reg = N_REG;
+            break;
+        default:
+            return 0;
+    }
+    key[0] = ((reg << 16 | first) << 1) | write;
+    key[1] = ((reg << 16 | last) << 1) | write;
+    return (first == last) ? 1 : 2;
+}
+
+static int compare_keys(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t*) a;
+    uint32_t y = *(const uint32_t*) b;
+    
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief the registers a rung accesses, sorted, 
+ * each once and marked written if any instruction writes it
+ * @param the rung
+ * @param where to store the keys, room for 2 per instruction
+ * @return number of keys
+ */
+static unsigned int rung_access(const rung_t r, uint32_t *key) {
+    unsigned int n = 0;
+    unsigned int i = 0;
+    unsigned int j = 0;
+    
+    for (; i < r->insno; i++) {
+        n += access_keys(r->instructions[i], key + n);
+    }
+    qsort(key, n, sizeof(uint32_t), compare_keys);
+    for (i = 0; i < n; i++) { // merge duplicates
+        if (j > 0 && key[j - 1] >> 1 == key[i] >> 1) {
+            key[j - 1] |= key[i] & 1;
+        } else {
+            key[j++] = key[i];
+        }
+    }
+    return j;
+}
+
+/**
+ * @brief do two rungs conflict: does one write what the other accesses
+ * @param sorted keys of one rung
+ * @param their number
+ * @param sorted keys of the other
+ * @param their number
+ * @return true if they have to run in scan order
+ */
+static PLC_BYTE conflict(const uint32_t *a, unsigned int na, 
+                         const uint32_t *b, unsigned int nb) {
+    unsigned int i = 0;
+    unsigned int j = 0;
+    
+    while (i < na && j < nb) {
+        if (a[i] >> 1 < b[j] >> 1) {
+            i++;
+        } else if (a[i] >> 1 > b[j] >> 1) {
+            j++;
+        } else if ((a[i] | b[j]) & 1) {
+            return TRUE;
+        } else {
+            i++;
+            j++;
+        }
+    }
+    return FALSE;
+}
+
+/**
+ * @brief level the rungs of each task: a rung runs after every earlier 
+ * rung of its task it conflicts with, so rungs of the same level 
+ * can run concurrently and the result is that of the scan order
+ * @param pointer to PLC registers
+ */
+static void level_rungs(plc_t p) {
+    uint32_t *keys = (uint32_t*) malloc((p->rungno + 1) * 2 * MAXSTACK * sizeof(uint32_t));
+    unsigned int n[MAXRUNG];
+    unsigned int i = 0;
+    int k = 0;
+    
+    for (; i < (unsigned int) p->rungno; i++) {
+        n[i] = rung_access(p->rungs[i], keys + i * 2 * MAXSTACK);
+    }
+    for (; k < MAXTASK; k++) {
+        plc_task_t t = &p->tasks[k];
+        unsigned int a = 0;
+        unsigned int depth = 0;
+        unsigned int pos = t->first;
+        
+        for (; a < t->rungs; a++) {
+            int x = p->task_rung[t->first + a];
+            unsigned int b = 0;
+            
+            p->rung_level[x] = 0;
+            for (; b < a; b++) {
+                int y = p->task_rung[t->first + b];
+                if (p->rung_level[y] >= p->rung_level[x] 
+                 && conflict(keys + x * 2 * MAXSTACK, n[x], 
+                             keys + y * 2 * MAXSTACK, n[y])) {
+                    p->rung_level[x] = p->rung_level[y] + 1;
+                }
+            }
+            if (p->rung_level[x] + 1 > depth) {
+                depth = p->rung_level[x] + 1;
+            }
+        }
+        for (i = 0; i < depth; i++) { // group by level, in scan order
+            for (a = 0; a < t->rungs; a++) {
+                if (p->rung_level[p->task_rung[t->first + a]] == i) {
+                    p->par_rung[pos++] = p->task_rung[t->first + a];
+                }
+            }
+        }
+    }
+    free(keys);
+}
+
+/**
+ * @brief group the rungs by task, keeping their scan order, 
+ * and order the tasks by priority, then rate monotonic: 
+ * the shorter the period, the sooner a task runs
+ * @param pointer to PLC registers
+ */
+static void plan_tasks(plc_t p) {
+    unsigned int n = 0;
+    int k = 0;
+    
+    for (; k < MAXTASK; k++) {
+        plc_task_t t = &p->tasks[k];
+        int i = 0;
+        int j = k;
+        
+        t->first = n;
+        for (; i < p->rungno; i++) {
+            if (p->rungs[i]->task == k) {
+                p->task_rung[n++] = i;
+            }
+        }
+        t->rungs = n - t->first;
+        t->due = p->clock;
+        for (; j > 0; j--) { // insertion sort
+            plc_task_t o = &p->tasks[p->task_order[j - 1]];
+            if (o->priority < t->priority 
+            || (o->priority == t->priority && o->period <= t->period)) {
+                break;
+            }
+            p->task_order[j] = p->task_order[j - 1];
+        }
+        p->task_order[j] = k;
+    }
+    level_rungs(p);
+}
+
+/**
+ * @brief The level struct
+ * rungs of a level of a task, run by the pool
+ */
+struct level {
+    plc_t p;
+    const PLC_BYTE *rungs; // indices of the rungs
+    long timeout;          // usec left to the watchdog
+    int rv;                // error of any of the rungs
+};
+
+static void run_rung(void *arg, unsigned int i) {
+    struct level *l = (struct level*) arg;
+    int rv = task(l->timeout, l->p, l->p->rungs[l->rungs[i]]);
+    
+    if (rv < PLC_OK) {
+        __atomic_store_n(&l->rv, rv, __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * @brief run the rungs of a task within its watchdog
+ * @param pointer to PLC registers
+ * @param the task
+ * @return OK or error
+ */
+static int run_task(plc_t p, plc_task_t t) {
+    long budget = (t->watchdog > 0) ? t->watchdog : p->step * THOUSAND;
+    long spent = 0;
+    unsigned int i = 0;
+    int rv = PLC_OK;
+    uint64_t start = monotonic_us();
+    
+    while (i < t->rungs && rv != PLC_ERR_TIMEOUT) {
+        if (p->pool == NULL) {
+            rv = task(budget - spent, p, p->rungs[p->task_rung[t->first + i]]);
+            i++;
+        } else { // a level at a time
+            struct level l;
+            unsigned int j = i + 1;
+            
+            while (j < t->rungs && p->rung_level[p->par_rung[t->first + j]] 
+                                == p->rung_level[p->par_rung[t->first + i]]) {
+                j++;
+            }
+            l.p = p;
+            l.rungs = &p->par_rung[t->first + i];
+            l.timeout = budget - spent;
+            l.rv = PLC_OK;
+            if (j - i > 1) {
+                pool_run(p->pool, run_rung, &l, j - i);
+            } else {
+                run_rung(&l, 0);
+            }
+            rv = l.rv;
+            i = j;
+        }
+        spent = (long) (monotonic_us() - start);
+    }
+    return rv;
+}
+
+/**
+ * @brief the executive: run every task that is due, in order.
+ * The process image is latched once per cycle, 
+ * so all tasks of a cycle see the same inputs
+ * @param pointer to PLC registers
+ * @return OK or error
+ */
+int run_tasks(plc_t p) {
+    int rv = PLC_OK;
+    int k = 0;
+    
+    for (; k < MAXTASK && rv != PLC_ERR_TIMEOUT; k++) {
+        plc_task_t t = &p->tasks[p->task_order[k]];
+        
+        if (t->rungs == 0 || p->clock < t->due) {
+            continue;
+        }
+        rv = run_task(p, t);
+        if (t->period > 0) {
+            t->due += t->period;
+            if (t->due <= p->clock) { // skip the runs that were missed
+                t->overruns++;
+                t->due = p->clock + t->period;
+            }
+        }
+    }
+    return rv;
+}
+
 rung_t plc_mk_rung(const char *name, plc_t p) {
     rung_t r = (rung_t) calloc(1, sizeof(struct rung));
     
@@ -1092,21 +1538,30 @@ void read_inputs(plc_t p) {
     if (p == NULL || p->hw == NULL)
         return;
     
-    p->hw->fetch(); // for simulation
+    p->hw->fetch(p->hw); // for simulation, may block: not under the poller's lock
+    counter_lock(&p->hsc);
     
-    for (i = 0; i < p->ni; i++) { // for each input byte
-        p->inputs[i] = 0;
-        for (j = 0; j < BYTESIZE; j++) { // read n bit into in
-            n = i * BYTESIZE + j;
-            i_bit = 0;
-            p->hw->dio_read(n, &i_bit);
-            p->inputs[i] |= i_bit << j;
-        } // mask them
+    if (p->hw->dio_read_bytes != NULL) { // a transaction per byte or less
+        p->hw->dio_read_bytes(p->hw, p->ni, p->inputs);
+    } else {
+        for (i = 0; i < p->ni; i++) { // for each input byte
+            p->inputs[i] = 0;
+            for (j = 0; j < BYTESIZE; j++) { // read n bit into in
+                n = i * BYTESIZE + j;
+                i_bit = 0;
+                p->hw->dio_read(p->hw, n, &i_bit);
+                p->inputs[i] |= i_bit << j;
+            } // mask them
+        }
     }
     
+    if (p->hw->dio_edges != NULL && p->rising != NULL) {
+        p->hw->dio_edges(p->hw, p->ni, p->rising, p->falling);
+    }
     for (i = 0; i < p->nai; i++) { // for each input sample
-        p->hw->data_read(i, &p->real_in[i]);
+        p->hw->data_read(p->hw, i, &p->real_in[i]);
     }
+    counter_unlock(&p->hsc);
 }
 
 void write_outputs(plc_t p) {
@@ -1118,60 +1573,71 @@ void write_outputs(plc_t p) {
     if (p == NULL || p->hw == NULL)
         return;
     
-    for (i = 0; i < p->nq; i++) {
-        for (j = 0; j < BYTESIZE; j++) { // write n bit out
-            n = BYTESIZE * i + j;
-            q_bit = (p->outputs[i] >> j) % 2;
-            p->hw->dio_write(p->outputs, n, q_bit);
+    counter_lock(&p->hsc);
+    if (p->hw->dio_write_bytes != NULL) {
+        p->hw->dio_write_bytes(p->hw, p->nq, p->outputs);
+    } else {
+        for (i = 0; i < p->nq; i++) {
+            for (j = 0; j < BYTESIZE; j++) { // write n bit out
+                n = BYTESIZE * i + j;
+                q_bit = (p->outputs[i] >> j) % 2;
+                p->hw->dio_write(p->hw, p->outputs, n, q_bit);
+            }
         }
     }
     for (i = 0; i < p->naq; i++) { // for each output sample
-        p->hw->data_write(i, p->real_out[i]);
+        p->hw->data_write(p->hw, i, p->real_out[i]);
     }
-    p->hw->flush(); // for simulation
+    counter_unlock(&p->hsc);
+    p->hw->flush(p->hw); // for simulation
 }
 // TODO: how is force implemented for variables and timers?
-plc_t plc_force(plc_t p, int op, PLC_BYTE i, char *val) {
-    if (p == NULL || val == NULL) {
-        return NULL;
-    }
+/**
+ * @brief force operand with a parsed value
+ * @param the plc
+ * @param the operand type
+ * @param the operand index
+ * @param the value of a digital operand
+ * @param the value of an analog operand
+ * @return new plc state, or NULL in error
+ */
+static plc_t force(plc_t p, int op, PLC_BYTE i, uint64_t u, double f_val) {
+    p->quiet = FALSE; // scan before waiting again
     plc_t r = NULL;
     switch (op) {
         case OP_REAL_INPUT:
             if (i < p->nai) {
                 r = p;
-                double f_val = atof(val);
                 if (f_val > r->ai[i].min && f_val < r->ai[i].max) {
                     r->ai[i].mask = f_val;
                 }
             }
             break;
         case OP_INPUT:
-            if (i < p->ni) {
+            if (i < BYTESIZE * p->ni) {
                 r = p;
-                if (atoi(val)) {
-                    r->di[i].MASK = 1;
+                if (u) {
+                    BIT_PUT(r->di.MASK, i, 1);
                 } else {
-                    r->di[i].N_MASK = 1;
+                    BIT_PUT(r->di.N_MASK, i, 1);
                 }
             }
             break;
         case OP_REAL_OUTPUT:
             if (i < p->naq) {
                 r = p;
-                double f_val = atof(val);
                 if (f_val > r->aq[i].min && f_val < r->aq[i].max) {
                     r->aq[i].mask = f_val;
                 }
             }
             break;
         case OP_OUTPUT:
-            if (i < p->nq) {
+            if (i < BYTESIZE * p->nq) {
                 r = p;
-                if (atoi(val)) {
-                    r->dq[i].MASK = 1;
+                if (u) {
+                    BIT_PUT(r->dq.MASK, i, 1);
                 } else {
-                    r->dq[i].N_MASK = 1;
+                    BIT_PUT(r->dq.N_MASK, i, 1);
                 }
             }
             break;
@@ -1181,10 +1647,18 @@ plc_t plc_force(plc_t p, int op, PLC_BYTE i, char *val) {
     return r;
 }
 
+plc_t plc_force(plc_t p, int op, PLC_BYTE i, char *val) {
+    if (p == NULL || val == NULL) {
+        return NULL;
+    }
+    return force(p, op, i, atoi(val), atof(val));
+}
+
 plc_t plc_unforce(plc_t p, int op, PLC_BYTE i) {
     if (p == NULL) {
         return NULL;
     }
+    p->quiet = FALSE;
     plc_t r = NULL;
     switch (op) {
         case OP_REAL_INPUT:
@@ -1194,10 +1668,10 @@ plc_t plc_unforce(plc_t p, int op, PLC_BYTE i) {
             }
             break;
         case OP_INPUT:
-            if (i < p->ni) {
+            if (i < BYTESIZE * p->ni) {
                 r = p;
-                r->di[i].MASK = 0;
-                r->di[i].N_MASK = 0;
+                BIT_ASSIGN(r->di.MASK, i, 0);
+                BIT_ASSIGN(r->di.N_MASK, i, 0);
             }
             break;
         case OP_REAL_OUTPUT:
@@ -1207,10 +1681,10 @@ plc_t plc_unforce(plc_t p, int op, PLC_BYTE i) {
             }
             break;
         case OP_OUTPUT:
-            if (i < p->nq) {
+            if (i < BYTESIZE * p->nq) {
                 r = p;
-                r->dq[i].MASK = 0;
-                r->dq[i].N_MASK = 0;
+                BIT_ASSIGN(r->dq.MASK, i, 0);
+                BIT_ASSIGN(r->dq.N_MASK, i, 0);
             }
             break;
         default:
@@ -1219,113 +1693,313 @@ plc_t plc_unforce(plc_t p, int op, PLC_BYTE i) {
     return r;
 }
 
-int plc_is_forced(const plc_t p, int op, PLC_BYTE i) {
-    int r = PLC_ERR;
-    switch (op) {
-        case OP_INPUT:
-            if (i < p->ni) {
-                r = p->di[i].MASK || p->di[i].N_MASK;
-            }
-            break;
-        case OP_OUTPUT:
-            if (i < p->nq) {
-                r = p->dq[i].MASK || p->dq[i].N_MASK;
-                ;
-            }
-            break;
-        case OP_REAL_INPUT:
-            if (i < p->nai) {
-                r = p->ai[i].mask < p->ai[i].max && p->ai[i].mask > p->ai[i].min;
+/**
+ * @brief assign a parsed value to a plc register variable
+ * @param plc instance   
+ * @param the type of variable (IL_OPERANDS enum value)
+ * @param variable index
+ * @param the value of a counter
+ * @param the value of a real register
+ * @return plc instance with saved change or updated error status
+ */
+static plc_t init_variable(const plc_t p, int var, PLC_BYTE idx, uint64_t u, double f_val) {
+    plc_t r = p;
+    PLC_BYTE len = 0;
+
+    switch (var) {
+        case OP_REAL_MEMORY:
+            len = r->nmr;
+            if (idx >= len) {
+                r->status = PLC_ERR_BADINDEX;
+            } else {
+                r->mr[idx].V = f_val;
+                BIT_PUT(r->chg.mr_dirty, idx, 1);
             }
             break;
-        case OP_REAL_OUTPUT:
-            if (i < p->naq) {
-                r = p->aq[i].mask < p->aq[i].max && p->aq[i].mask > p->aq[i].min;
+            
+        case OP_MEMORY:
+            len = r->nm;
+            if (idx >= len) {
+                r->status = PLC_ERR_BADINDEX;
+            } else {
+                r->m[idx].V = u;
+                BIT_PUT(r->m_dirty, idx, 1);
             }
             break;
+
         default:
+            r->status = PLC_ERR_BADOPERAND;
             break;
     }
     return r;
 }
 
 /**
- * @brief decode inputs
+ * @brief size of the published image: the packed digital inputs 
+ * and outputs, a word per analog value, register and timer, 
+ * and then the packed timer and blinker outputs
  * @param pointer to PLC registers
- * @return true if input changed
+ * @return number of words
  */
-PLC_BYTE dec_inp(plc_t p) { // decode input bytes
-    PLC_BYTE i = 0;
-    PLC_BYTE j = 0;
-    PLC_BYTE i_changed = FALSE;
-
-    for (; i < p->ni; i++) {
-        if (p->inputs[i] != p->old->inputs[i]) {
-            i_changed = TRUE;
-        }
-        for (; j < BYTESIZE; j++) {
-            unsigned int n = BYTESIZE * i + j;
-// negative mask has precedence
-            p->di[n].I = (((p->inputs[i] >> j) % 2) || p->di[n].MASK) && !p->di[n].N_MASK;
-            PLC_BYTE edge = p->di[n].I ^ p->old->di[n].I;
-            p->di[n].RE = p->di[n].I && edge;
-            p->di[n].FE = !p->di[n].I && edge;
-        }
-    }
-    for (i = 0; i < p->nai; i++) {
-        if (plc_is_forced(p, OP_REAL_INPUT, i)) {
-            p->ai[i].V = p->ai[i].mask;
-        } else {
-            double denom = (double) UINT64_MAX;
-            double v = p->real_in[i];
-            double min = p->ai[i].min;
-            double max = p->ai[i].max;
-            p->ai[i].V = min + ((max - min) * (v / denom));
-        }
-        if (abs(p->ai[i].V - p->old->ai[i].V) > FLOAT_PRECISION) {
-            i_changed = TRUE;
-        }
-    }
-    memset(p->outputs, 0, p->nq);
-    return i_changed;
+static unsigned int image_words(const plc_t p) {
+    
+    return BITWORDS(BYTESIZE * p->ni) + BITWORDS(BYTESIZE * p->nq) 
+         + p->nai + p->naq + p->nm + p->nmr + p->nt 
+         + BITWORDS(p->nt) + BITWORDS(p->ns);
 }
 
 /**
- * @brief encode outputs
+ * @brief describe the sizes and the image of a PLC in a header
  * @param pointer to PLC registers
- * @return true if output changed
+ * @param the header
  */
-PLC_BYTE enc_out(plc_t p) { // encode digital outputs to output bytes
-    PLC_BYTE i = 0;
-    PLC_BYTE j = 0;
-    PLC_BYTE o_changed = FALSE;
-    PLC_BYTE out[p->nq];
+static void describe(const plc_t p, shared_header_t h) {
+    h->words = image_words(p);
+    h->ni = p->ni;
+    h->nq = p->nq;
+    h->nai = p->nai;
+    h->naq = p->naq;
+    h->nt = p->nt;
+    h->ns = p->ns;
+    h->nm = p->nm;
+    h->nmr = p->nmr;
+}
 
-    memcpy(out, p->outputs, p->nq);
+/**
+ * @brief check and parse a request
+ * @param the sizes of the PLC
+ * @param the request (enum REQUESTS)
+ * @param the operand type
+ * @param the operand index
+ * @param the value, serialized
+ * @param the parsed request
+ * @return OK or error
+ */
+static int make_request(const shared_header_t h, int req, int op, 
+                        unsigned char i, const char *val, struct request *r) {
+    unsigned int len = 0;
+    
+    if (val == NULL && req != REQ_UNFORCE) {
+        return PLC_ERR;
+    }
+    switch (op) {
+        case OP_INPUT:
+            len = (req != REQ_WRITE) ? BYTESIZE * h->ni : 0;
+            break;
+        case OP_OUTPUT:
+            len = (req != REQ_WRITE) ? BYTESIZE * h->nq : 0;
+            break;
+        case OP_REAL_INPUT:
+            len = (req != REQ_WRITE) ? h->nai : 0;
+            break;
+        case OP_REAL_OUTPUT:
+            len = (req != REQ_WRITE) ? h->naq : 0;
+            break;
+        case OP_MEMORY:
+            len = (req == REQ_WRITE) ? h->nm : 0;
+            break;
+        case OP_REAL_MEMORY:
+            len = (req == REQ_WRITE) ? h->nmr : 0;
+            break;
+        default:
+            break;
+    }
+    if (req < REQ_FORCE || req >= N_REQ || len == 0) {
+        return PLC_ERR_BADOPERAND;
+    }
+    if (i >= len) {
+        return PLC_ERR_BADINDEX;
+    }
+    r->req = req;
+    r->op = op;
+    r->index = i;
+    r->u = (val != NULL) ? atol(val) : 0; // parsed here, off the scan
+    r->r = (val != NULL) ? atof(val) : 0;
+    return PLC_OK;
+}
 
-    for (; i < p->nq; i++) { // write masked outputs
-        for (; j < BYTESIZE; j++) {
-            unsigned int n = BYTESIZE * i + j;
-            
-            out[i] |= ((p->dq[n].Q || (p->dq[n].SET && !p->dq[n].RESET) || p->dq[n].MASK) && !p->dq[n].N_MASK) << j;
-// negative mask has precedence
+int plc_post(plc_t p, int req, int op, unsigned char i, const char *val) {
+    struct shared_header h;
+    struct request r;
+    int rv = PLC_ERR;
+    
+    if (p == NULL) {
+        return PLC_ERR;
+    }
+    describe(p, &h); // sizes are fixed once allocated, so they are safe to read
+    rv = make_request(&h, req, op, i, val, &r);
+    if (rv < PLC_OK) {
+        return rv;
+    }
+    return queue_push(p->requests, &r) ? PLC_OK : PLC_ERR;
+}
+
+int plc_shared_post(shared_header_t h, int req, int op, unsigned char i, const char *val) {
+    struct request r;
+    int rv = PLC_ERR;
+    
+    if (h == NULL) {
+        return PLC_ERR;
+    }
+    rv = make_request(h, req, op, i, val, &r);
+    if (rv < PLC_OK) {
+        return rv;
+    }
+    return queue_push((queue_t) ((char*) h + h->requests), &r) ? PLC_OK : PLC_ERR;
+}
+
+/**
+ * @brief apply the requests posted since the last cycle
+ * @param pointer to PLC registers
+ */
+static void apply_requests(plc_t p) {
+    struct request r;
+    
+    while (queue_pop(p->requests, &r)) {
+        switch (r.req) {
+            case REQ_FORCE:
+                force(p, r.op, r.index, r.u, r.r);
+                break;
+            case REQ_UNFORCE:
+                plc_unforce(p, r.op, r.index);
+                break;
+            case REQ_WRITE:
+                init_variable(p, r.op, r.index, r.u, r.r);
+                p->quiet = FALSE;
+                break;
+            default:
+                break;
         }
-        p->outputs[i] = out[i];
-        if (p->outputs[i] != p->old->outputs[i]) {
+    }
+}
+
+int plc_is_forced(const plc_t p, int op, PLC_BYTE i) {
+    int r = PLC_ERR;
+    switch (op) {
+        case OP_INPUT:
+            if (i < BYTESIZE * p->ni) {
+                r = BIT_GET(p->di.MASK, i) || BIT_GET(p->di.N_MASK, i);
+            }
+            break;
+        case OP_OUTPUT:
+            if (i < BYTESIZE * p->nq) {
+                r = BIT_GET(p->dq.MASK, i) || BIT_GET(p->dq.N_MASK, i);
+            }
+            break;
+        case OP_REAL_INPUT:
+            if (i < p->nai) {
+                r = p->ai[i].mask < p->ai[i].max && p->ai[i].mask > p->ai[i].min;
+            }
+            break;
+        case OP_REAL_OUTPUT:
+            if (i < p->naq) {
+                r = p->aq[i].mask < p->aq[i].max && p->aq[i].mask > p->aq[i].min;
+            }
+            break;
+        default:
+            break;
+    }
+    return r;
+}
+
+/**
+ * @brief compare two packed arrays word by word
+ * @param current words
+ * @param previous words
+ * @param number of words
+ * @return true if any bit differs
+ */
+static PLC_BYTE differ(const uint64_t *cur, const uint64_t *prev, unsigned int words) {
+    uint64_t delta = 0;
+    unsigned int w = 0;
+    for (; w < words; w++) {
+        delta |= cur[w] ^ prev[w];
+    }
+    return delta != 0;
+}
+
+/**
+ * @brief decode inputs, a word of contacts 
+ * and a batch of analog channels at a time
+ * @param pointer to PLC registers
+ * @return true if input changed
+ */
+PLC_BYTE dec_inp(plc_t p) { // decode input bytes
+    unsigned int i = 0;
+    PLC_BYTE i_changed = FALSE;
+    
+    i_changed = decode_bits(p->inputs, p->prev->di, &p->di, 
+                            BITWORDS(BYTESIZE * p->ni)) != 0;
+    if (p->hw != NULL && p->hw->dio_edges != NULL && p->rising != NULL) {
+        // pulses that came and went between scans
+        i_changed |= latch_edges(p->rising, p->falling, &p->di, 
+                                 BITWORDS(BYTESIZE * p->ni)) != 0;
+    }
+    
+    decode_analog(p->real_in, &p->ai_conv, p->cur->ai, p->nai);
+    for (i = 0; i < p->nai; i++) {
+        if (plc_is_forced(p, OP_REAL_INPUT, i)) {
+            p->cur->ai[i] = p->ai[i].mask;
+        } 
+        p->ai[i].V = p->cur->ai[i];
+        if (fabs(p->cur->ai[i] - p->prev->ai[i]) > FLOAT_PRECISION) {
+            i_changed = TRUE;
+        }
+    }
+    memset(p->outputs, 0, p->nq);
+    return i_changed;
+}
+
+/**
+ * @brief add the edges fast counters accumulated between scans 
+ * to their registers
+ * @param pointer to PLC registers
+ * @return true if a counter changed
+ */
+static PLC_BYTE count_fast(plc_t p) {
+    unsigned int k = 0;
+    PLC_BYTE changed = FALSE;
+    
+    counter_lock(&p->hsc); // the count hook is a hardware access
+    for (; k < p->hsc.n; k++) {
+        PLC_BYTE idx = p->hsc.reg[k];
+        uint64_t d = counter_take(&p->hsc, k, p->di.RE);
+        if (d == 0) {
+            continue;
+        }
+        p->m[idx].V = p->m[idx].DOWN ? p->m[idx].V - d : p->m[idx].V + d;
+        BIT_PUT(p->m_dirty, idx, 1);
+        changed = TRUE;
+    }
+    counter_unlock(&p->hsc);
+    return changed;
+}
+
+/**
+ * @brief encode outputs
+ * @param pointer to PLC registers
+ * @return true if output changed
+ */
+PLC_BYTE enc_out(plc_t p) { // encode digital outputs to output bytes
+    unsigned int i = 0;
+    PLC_BYTE o_changed = FALSE;
+    unsigned int words = BITWORDS(BYTESIZE * p->nq);
+
+    encode_bits(p->outputs, &p->dq, words); // write masked outputs
+    o_changed = differ((uint64_t*) p->cur->outputs, (uint64_t*) p->prev->outputs, 
+                       words);
+    
+    for (i = 0; i < p->naq; i++) {
+        p->cur->aq[i] = p->aq[i].V;
+        if (fabs(p->cur->aq[i] - p->prev->aq[i]) > FLOAT_PRECISION) {
             o_changed = TRUE;
         }
     }
+    encode_analog(p->cur->aq, &p->aq_conv, p->real_out, p->naq);
     for (i = 0; i < p->naq; i++) {
-        double min = p->aq[i].min;
-        double max = p->aq[i].max;
-        double val = p->aq[i].V;
         if (plc_is_forced(p, OP_REAL_OUTPUT, i)) {
-            val = p->aq[i].mask;
-        }
-        p->real_out[i] = UINT64_MAX * ((val - min) / (max - min));
-        
-        if (abs(p->aq[i].V - p->old->aq[i].V) > FLOAT_PRECISION) {
-            o_changed = TRUE;
+            p->real_out[i] = (uint64_t) ((p->aq[i].mask - p->aq_conv.offset[i]) 
+                                       * p->aq_conv.scale[i]);
         }
     }
     return o_changed;
@@ -1333,103 +2007,364 @@ PLC_BYTE enc_out(plc_t p) { // encode digital outputs to output bytes
 
 /**
  * @brief read_mvars
+ * only counters marked dirty by the previous cycle can differ from
+ * their set / reset latch; those that do not change stay clean
  * @param pointer to PLC registers
  */
-static void read_mvars(plc_t p) {
-    int i;
-    for (i = 0; i < p->nm; i++) {
-        if (p->m[i].SET || p->m[i].RESET)
-            p->m[i].PULSE = p->m[i].SET && !p->m[i].RESET;
+void read_mvars(plc_t p) {
+    unsigned int w = 0;
+    for (; w < BITWORDS(p->nm); w++) {
+        uint64_t dirty = p->m_dirty[w];
+        while (dirty) {
+            uint64_t bit = dirty & -dirty;
+            mvar_t m = &p->m[w * LWORDSIZE + __builtin_ctzll(dirty)];
+            PLC_BYTE pulse = m->PULSE;
+            if (m->SET || m->RESET)
+                pulse = m->SET && !m->RESET;
+            if (pulse == m->PULSE)
+                p->m_dirty[w] &= ~bit;
+            m->PULSE = pulse;
+            dirty &= dirty - 1;
+        }
     }
 }
 
 /**
- * @brief write values to memory variables
+ * @brief write values to dirty memory variables
  * @param pointer to PLC registers
  */
-static void write_mvars(plc_t p) {
-    int i;
-    for (i = 0; i < p->nm; i++) {
-        if (!p->m[i].RO) {
-            if (p->m[i].PULSE && p->m[i].EDGE) { // up/down counting
-                p->m[i].V += (p->m[i].DOWN) ? -1 : 1;
-                p->m[i].EDGE = FALSE;
+void write_mvars(plc_t p) {
+    unsigned int w = 0;
+    for (; w < BITWORDS(p->nm); w++) {
+        uint64_t dirty = p->m_dirty[w];
+        while (dirty) {
+            mvar_t m = &p->m[w * LWORDSIZE + __builtin_ctzll(dirty)];
+            if (!m->RO) {
+                if (m->PULSE && m->EDGE) { // up/down counting
+                    m->V += (m->DOWN) ? -1 : 1;
+                    m->EDGE = FALSE;
+                }
             }
+            dirty &= dirty - 1;
         }
     }
 }
 
+/**
+ * @brief carry counter pulses over from the previous cycle,
+ * update the dirty ones and mark their edges
+ * @param pointer to PLC registers
+ * @return true if a pulse changed
+ */
 PLC_BYTE check_pulses(plc_t p) {
-    PLC_BYTE changed = 0;
-    int i = 0;
-    for (i = 0; i < p->nm; i++) { // check counter pulses
-        if (p->m[i].PULSE != p->old->m[i].PULSE) {
+    PLC_BYTE changed = FALSE;
+    unsigned int i = 0;
+    unsigned int w = 0;
+    
+    for (; w < BITWORDS(p->nm); w++) { // check counter pulses
+        uint64_t dirty = p->m_dirty[w];
+        uint64_t edges = 0;
+        
+        p->cur->pulses[w] = p->prev->pulses[w];
+        while (dirty) {
+            i = w * LWORDSIZE + __builtin_ctzll(dirty);
+            BIT_ASSIGN(p->cur->pulses, i, p->m[i].PULSE);
+            dirty &= dirty - 1;
+        }
+        edges = (p->cur->pulses[w] ^ p->prev->pulses[w]) & p->m_dirty[w];
+        while (edges) {
+            i = w * LWORDSIZE + __builtin_ctzll(edges);
             p->m[i].EDGE = TRUE;
             changed = TRUE;
+            edges &= edges - 1;
         }
     }
     return changed;
 }
 
+/**
+ * @brief append a change to the list of the cycle
+ * @param pointer to PLC registers
+ * @param the register (enum REGISTERS)
+ * @param index
+ * @param new integer value
+ * @param new real value
+ */
+static void note_change(plc_t p, int reg, unsigned int idx, uint64_t u, double r) {
+    change_t c = &p->chg.list[p->chg.size++];
+    
+    c->reg = reg;
+    c->index = idx;
+    c->u = u;
+    c->r = r;
+}
+
+/**
+ * @brief list the bits that differ between two packed arrays
+ * @param pointer to PLC registers
+ * @param the register (enum REGISTERS)
+ * @param current words
+ * @param previous words
+ * @param number of words
+ */
+static void note_bits(plc_t p, int reg, const uint64_t *cur, 
+                      const uint64_t *prev, unsigned int words) {
+    unsigned int w = 0;
+    for (; w < words; w++) {
+        uint64_t delta = cur[w] ^ prev[w];
+        while (delta) {
+            unsigned int i = w * LWORDSIZE + __builtin_ctzll(delta);
+            note_change(p, reg, i, BIT_GET(cur, i), 0);
+            delta &= delta - 1;
+        }
+    }
+}
+
+/**
+ * @brief list a timer or blinker output if it differs from the one 
+ * last reported
+ * @param pointer to PLC registers
+ * @param the register (enum REGISTERS)
+ * @param the outputs last reported, packed
+ * @param index
+ * @param the output
+ */
+static void note_flag(plc_t p, int reg, uint64_t *seen, 
+                      unsigned int idx, PLC_BYTE q) {
+    if (BIT_GET(seen, idx) != q) {
+        BIT_ASSIGN(seen, idx, q);
+        note_change(p, reg, idx, q, 0);
+    }
+}
+
+/**
+ * @brief build the list of registers the cycle changed.
+ * Inputs and outputs are diffed a word at a time against the previous bank,
+ * memory, timers and blinkers are only checked where the cycle touched them
+ * @param pointer to PLC registers
+ */
+void collect_changes(plc_t p) {
+    unsigned int i = 0;
+    unsigned int w = 0;
+    
+    p->chg.size = 0;
+    note_bits(p, REG_DI, p->cur->di, p->prev->di, BITWORDS(BYTESIZE * p->ni));
+    note_bits(p, REG_DQ, (uint64_t*) p->cur->outputs, 
+              (uint64_t*) p->prev->outputs, BITWORDS(BYTESIZE * p->nq));
+    for (; i < p->nai; i++) {
+        if (fabs(p->cur->ai[i] - p->prev->ai[i]) > FLOAT_PRECISION) {
+            note_change(p, REG_AI, i, 0, p->cur->ai[i]);
+        }
+    }
+    for (i = 0; i < p->naq; i++) {
+        if (fabs(p->cur->aq[i] - p->prev->aq[i]) > FLOAT_PRECISION) {
+            note_change(p, REG_AQ, i, 0, p->cur->aq[i]);
+        }
+    }
+    for (w = 0; w < BITWORDS(p->nm); w++) { // read_mvars clears the marks
+        uint64_t dirty = p->m_dirty[w];
+        while (dirty) {
+            i = w * LWORDSIZE + __builtin_ctzll(dirty);
+            if (p->m[i].V != p->chg.m_seen[i]) {
+                p->chg.m_seen[i] = p->m[i].V;
+                note_change(p, REG_M, i, p->m[i].V, 0);
+            }
+            dirty &= dirty - 1;
+        }
+    }
+    for (w = 0; w < BITWORDS(p->nmr); w++) {
+        uint64_t dirty = p->chg.mr_dirty[w];
+        while (dirty) {
+            i = w * LWORDSIZE + __builtin_ctzll(dirty);
+            if (p->mr[i].V != p->chg.mr_seen[i]) {
+                p->chg.mr_seen[i] = p->mr[i].V;
+                note_change(p, REG_MR, i, 0, p->mr[i].V);
+            }
+            dirty &= dirty - 1;
+        }
+        p->chg.mr_dirty[w] = 0;
+    }
+    for (w = 0; w < BITWORDS(p->nt); w++) {
+        uint64_t dirty = p->chg.t_dirty[w];
+        while (dirty) {
+            i = w * LWORDSIZE + __builtin_ctzll(dirty);
+            note_flag(p, REG_T, p->chg.t_seen, i, p->t[i].Q);
+            dirty &= dirty - 1;
+        }
+        p->chg.t_dirty[w] = 0;
+    }
+    for (w = 0; w < BITWORDS(p->ns); w++) {
+        uint64_t dirty = p->chg.s_dirty[w];
+        while (dirty) {
+            i = w * LWORDSIZE + __builtin_ctzll(dirty);
+            note_flag(p, REG_S, p->chg.s_seen, i, p->s[i].Q);
+            dirty &= dirty - 1;
+        }
+        p->chg.s_dirty[w] = 0;
+    }
+}
+
+/**
+ * @brief swap current and previous state.
+ * the new current bank still holds the state of two cycles ago,
+ * which the new cycle overwrites entirely
+ * @param pointer to PLC registers
+ */
+void swap_banks(plc_t p) {
+    bank_t b = p->prev;
+    p->prev = p->cur;
+    p->cur = b;
+    p->inputs = b->inputs;
+    p->outputs = b->outputs;
+    p->di.I = b->di;
+}
+
 plc_t save_state(PLC_BYTE mask, plc_t p) {
     if (mask & CHANGED_I) { // Input changed!
-        memcpy(p->old->inputs, p->inputs, p->ni);
         plc_log("%s", "input updated");
     }
     if (mask & CHANGED_O) { // Output changed!"
-        memcpy(p->old->outputs, p->outputs, p->nq);
         plc_log("%s", "output updated");
     }
     if (mask & CHANGED_M) {
-        memcpy(p->old->m, p->m, p->nm * sizeof(struct mvar));
         plc_log("%s", "regs updated");
     }
     if (mask & CHANGED_T) {
-        memcpy(p->old->t, p->t, p->nt * sizeof(struct timer));
         plc_log("%s", "timers updated");
     }
     if (mask & CHANGED_S) {
-        memcpy(p->old->s, p->s, p->ns * sizeof(struct blink));
         plc_log("%s", "pulses updated");
     }
     p->update = mask;
     return p;
 }
 
+/**
+ * @brief advance the timers to the time of the current cycle, 
+ * touching only those that reached their preset.
+ * Values are derived on demand, outputs change when counting 
+ * starts and when the preset is reached.
+ * @param pointer to PLC registers
+ * @return true if a timer output was updated
+ */
 PLC_BYTE manage_timers(plc_t p) {
-    int i = 0;
     PLC_BYTE t_changed = 0;
-    for (i = 0; i < p->nt; i++) {
-        if (p->t[i].V < p->t[i].P && p->t[i].START) {
-            if (p->t[i].sn < p->t[i].S)
-                p->t[i].sn++;
-            else {
-                t_changed = TRUE;
-                p->t[i].V++;
-                p->t[i].sn = 0;
-            }
-            p->t[i].Q = (p->t[i].ONDELAY) ? 0 : 1; // on delay
-        } else if (p->t[i].START) {
-            p->t[i].Q = (p->t[i].ONDELAY) ? 1 : 0; // on delay
-        }
+    wheel_node_t n = wheel_advance(&p->t_wheel, p->clock);
+    
+    while (n != NULL) {
+        wheel_node_t next = n->next;
+        
+        t_changed = TRUE;
+        arm_timer(p, n - p->t_node);
+        n = next;
     }
     return t_changed;
 }
 
+/**
+ * @brief advance the blinkers to the time of the current cycle, 
+ * toggling those that are due. 
+ * A blinker keeps its phase however long the cycle was.
+ * @param pointer to PLC registers
+ * @return true if a blinker toggled
+ */
 PLC_BYTE manage_blinkers(plc_t p) {
     PLC_BYTE s_changed = 0;
+    wheel_node_t n = wheel_advance(&p->s_wheel, p->clock);
+    
+    while (n != NULL) {
+        wheel_node_t next = n->next;
+        int i = n - p->s_node;
+        uint64_t periods = (p->clock - n->expiry) / p->s[i].S + 1;
+        
+        s_changed = TRUE;
+        if (periods % 2) {
+            p->s[i].Q = (p->s[i].Q) ? 0 : 1; // toggle
+            BIT_PUT(p->chg.s_dirty, i, 1);
+        }
+        wheel_arm(&p->s_wheel, n, n->expiry + periods * p->s[i].S);
+        n = next;
+    }
+    return s_changed;
+}
+
+/**
+ * @brief rebuild the wheels at the current time: 
+ * running timers count on from now, blinkers restart their period
+ * @param pointer to PLC registers
+ */
+static void schedule(plc_t p) {
     int i = 0;
+    
+    memset(&p->t_wheel, 0, sizeof(struct wheel));
+    memset(&p->s_wheel, 0, sizeof(struct wheel));
+    memset(p->t_node, 0, p->nt * sizeof(struct wheel_node));
+    memset(p->s_node, 0, p->ns * sizeof(struct wheel_node));
+    p->t_wheel.now = p->clock;
+    p->s_wheel.now = p->clock;
+    for (; i < p->nt; i++) {
+        p->t[i].since = p->clock;
+        arm_timer(p, i);
+    }
     for (i = 0; i < p->ns; i++) {
-        if (p->s[i].S > 0) { // if set up
-            if (p->s[i].sn > p->s[i].S) {
-                s_changed = TRUE;
-                p->s[i].Q = (p->s[i].Q) ? 0 : 1; // toggle
-                p->s[i].sn = 0;
-            } else
-                p->s[i].sn++;
+        arm_blinker(p, i);
+    }
+}
+
+/**
+ * @brief does the program read values that change with time alone, 
+ * without an input event or a deadline: analog inputs and timer values
+ * @param pointer to PLC registers
+ * @return true if it does
+ */
+static PLC_BYTE samples_time(plc_t p) {
+    int i = 0;
+    
+    for (; i < p->rungno; i++) {
+        unsigned int pc = 0;
+        for (; pc < p->rungs[i]->insno; pc++) {
+            instruction_t ins = p->rungs[i]->instructions[pc];
+            if (ins->operand == OP_REAL_INPUT 
+            || (ins->operand == OP_TIMEOUT && get_type(ins) != T_BOOL)) {
+                return TRUE;
+            }
         }
     }
-    return s_changed;
+    return FALSE;
+}
+
+/**
+ * @brief in tickless mode, when the last cycle changed nothing, 
+ * the next one can only differ after an input event or a deadline:
+ * block on the hardware until either happens
+ * @param pointer to PLC registers
+ * @return true if it waited
+ */
+static PLC_BYTE wait_event(plc_t p) {
+    uint64_t t_next = 0;
+    uint64_t s_next = 0;
+    uint64_t next = 0;
+    long ms = -1; // nothing due: wait for an input
+    int k = 0;
+    
+    if (!p->tickless || !p->quiet || p->periodic || p->hw->wait == NULL
+    || p->hsc.running) { // polled edges do not wake the hardware
+        return FALSE;
+    }
+    t_next = wheel_next(&p->t_wheel);
+    s_next = wheel_next(&p->s_wheel);
+    next = (t_next && (!s_next || t_next < s_next)) ? t_next : s_next;
+    for (; k < MAXTASK; k++) { // slower tasks still have to catch up
+        plc_task_t t = &p->tasks[k];
+        if (t->period > 0 && t->rungs > 0 && (!next || t->due < next)) {
+            next = t->due;
+        }
+    }
+    if (next > 0) {
+        uint64_t now = monotonic_ms();
+        ms = (next > now) ? (long) (next - now) : 0;
+    }
+    return ms == 0 || p->hw->wait(p->hw, ms) >= PLC_OK;
 }
 
 plc_t plc_load_program_file(const char *path, plc_t plc) {
@@ -1487,11 +2422,27 @@ plc_t plc_start(plc_t p) {
         return p;
     }
     
-    if (p->hw == NULL || p->hw->status != PLC_OK || p->hw->enable() != PLC_OK) {
+    if (p->hw == NULL || p->hw->status != PLC_OK || p->hw->enable(p->hw) != PLC_OK) {
         p->status = PLC_ERR_HARDWARE;
         //p->hw->status = PLC_ERR;
     }
     if (p->status == ST_STOPPED) {
+        int i = 0;
+        for (; i < p->nai; i++) { // limits may have been written directly
+            scale_analog(&p->ai_conv, i, &p->ai[i], TRUE);
+        }
+        for (i = 0; i < p->naq; i++) {
+            scale_analog(&p->aq_conv, i, &p->aq[i], FALSE);
+        }
+        p->clock = monotonic_ms();
+        schedule(p);
+        plan_tasks(p);
+        if (p->workers > 1 && p->pool == NULL) {
+            p->pool = pool_new(p->workers);
+        }
+        counter_start(&p->hsc, p->hw);
+        p->periodic = samples_time(p);
+        p->quiet = FALSE;
         p->update = CHANGED_STATUS;
         p->status = ST_RUNNING;
     }
@@ -1509,26 +2460,104 @@ plc_t plc_stop(plc_t p) {
         return p;
     }
     if (p->status == ST_RUNNING) {
+        int i = 0;
+        p->clock = monotonic_ms();
+        for (; i < p->nt; i++) { // timers do not count while stopped
+            hold_timer(p, i);
+        }
         memset(p->outputs, 0, p->nq);
         memset(p->real_out, 0, 8 * p->naq);
         write_outputs(p);
         
-        p->hw->disable();
+        counter_stop(&p->hsc); // before the poller loses its hardware
+        p->hw->disable(p->hw);
+        pool_free(p->pool);
+        p->pool = NULL;
         p->update = CHANGED_STATUS;
         p->status = ST_STOPPED;
     }
     return p;
 }
 
-plc_t plc_func(plc_t p) { // TODO: this is a callback, supposed to be
-    // called every T msec
+static void put_word(image_t img, unsigned int *k, uint64_t w) {
+    __atomic_store_n(&img->words[(*k)++], w, __ATOMIC_RELAXED);
+}
+
+static void put_real(image_t img, unsigned int *k, double r) {
+    uint64_t w = 0;
+    
+    memcpy(&w, &r, sizeof(uint64_t));
+    put_word(img, k, w);
+}
+
+/**
+ * @brief publish the process image for readers on other threads
+ * (a seqlock: readers retry if the sequence number was odd or moved)
+ * @param pointer to PLC registers
+ */
+static void publish(plc_t p) {
+    image_t img = &p->image;
+    unsigned int k = 0;
+    unsigned int i = 0;
+    uint64_t w = 0;
+    
+    if (img->words == NULL) {
+        return;
+    }
+    __atomic_store_n(img->seq, *img->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    for (i = 0; i < BITWORDS(BYTESIZE * p->ni); i++) {
+        put_word(img, &k, p->di.I[i]);
+    }
+    for (i = 0; i < BITWORDS(BYTESIZE * p->nq); i++) {
+        put_word(img, &k, p->dq.Q[i]);
+    }
+    for (i = 0; i < p->nai; i++) {
+        put_real(img, &k, p->ai[i].V);
+    }
+    for (i = 0; i < p->naq; i++) {
+        put_real(img, &k, p->aq[i].V);
+    }
+    for (i = 0; i < p->nm; i++) {
+        put_word(img, &k, p->m[i].V);
+    }
+    for (i = 0; i < p->nmr; i++) {
+        put_real(img, &k, p->mr[i].V);
+    }
+    for (i = 0; i < p->nt; i++) {
+        put_word(img, &k, timer_value(p, i));
+    }
+    for (i = 0; i < p->nt; i++) {
+        w |= (uint64_t) (p->t[i].Q != 0) << (i % LWORDSIZE);
+        if (i % LWORDSIZE == LWORDSIZE - 1 || i == p->nt - 1) {
+            put_word(img, &k, w);
+            w = 0;
+        }
+    }
+    for (i = 0; i < p->ns; i++) {
+        w |= (uint64_t) (p->s[i].Q != 0) << (i % LWORDSIZE);
+        if (i % LWORDSIZE == LWORDSIZE - 1 || i == p->ns - 1) {
+            put_word(img, &k, w);
+            w = 0;
+        }
+    }
+    __atomic_store_n(img->seq, *img->seq + 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief a scan cycle
+ * @param pointer to PLC registers
+ * @param true to pace the cycle: sleep for what is left of the cycle time, 
+ * or wait for an event when tickless
+ * @return PLC with updated state
+ */
+static plc_t cycle(plc_t p, PLC_BYTE paced) {
     struct timeval tp; // time for poll
     struct timeval tn; // time since beginning of last output
     struct timeval dt;
     long timeout = p->step * THOUSAND; // timeout in usec
     long poll_time = 0;
     long io_time = 0;
-    static long run_time = 0;
 
     int r = PLC_OK;
     PLC_BYTE change_mask = p->update;
@@ -1537,12 +2566,19 @@ plc_t plc_func(plc_t p) { // TODO: this is a callback, supposed to be
     PLC_BYTE m_changed = FALSE;
     PLC_BYTE t_changed = FALSE;
     PLC_BYTE s_changed = FALSE;
+    PLC_BYTE woke = FALSE;
     
     dt.tv_sec = 0;
     dt.tv_usec = 0;
     if ((p->status) == ST_RUNNING) { // run
+        woke = !paced || wait_event(p); // tickless: idle until something can change
 // remaining time = step
+        swap_banks(p); // last cycle becomes the previous state
+        counter_lock(&p->hsc);
+        p->clock = p->hw->clock ? p->hw->clock(p->hw) : monotonic_ms();
+        counter_unlock(&p->hsc);
         read_inputs(p);
+        apply_requests(p);
         t_changed = manage_timers(p);
         s_changed = manage_blinkers(p);
         read_mvars(p);
@@ -1550,13 +2586,15 @@ plc_t plc_func(plc_t p) { // TODO: this is a callback, supposed to be
         gettimeofday(&tn, NULL);
 // dt = time for input + output
 // how much time passed since previous cycle?
-        timeval_subtract(&dt, &tn, &Curtime);
+        timeval_subtract(&dt, &tn, &p->last);
         dt.tv_usec = dt.tv_usec % (THOUSAND * p->step);
         io_time = dt.tv_usec; // THOUSAND;
         timeout -= io_time;
-        timeout -= run_time;
+        timeout -= p->run_time;
         //plc_log("I/O time approx:%d microseconds",dt.tv_usec);
-        usleep(timeout);
+        if (!woke) {
+            usleep(timeout);
+        }
         gettimeofday(&tp, NULL); // how much time did sleep wait?
         timeval_subtract(&dt, &tp, &tn);
         poll_time = dt.tv_usec;
@@ -1564,19 +2602,20 @@ plc_t plc_func(plc_t p) { // TODO: this is a callback, supposed to be
         //dt = time(input) + time(sleep)
         
         i_changed = dec_inp(p); // decode inputs
+        i_changed |= count_fast(p);
 // TODO: a better user plugin system when function blocks are implemented
         // plc_project_task(p); // plugin code
 
         if (r >= PLC_OK) {
-            r = all_tasks(p->step * THOUSAND, p);
+            r = run_tasks(p);
         }
-        gettimeofday(&Curtime, NULL); // start timing next cycle
-        timeval_subtract(&dt, &Curtime, &tp);
-        run_time = dt.tv_usec;
-        compute_variance((double) (run_time + poll_time + io_time));
+        gettimeofday(&p->last, NULL); // start timing next cycle
+        timeval_subtract(&dt, &p->last, &tp);
+        p->run_time = dt.tv_usec;
+        compute_variance(&p->jitter, (double) (p->run_time + poll_time + io_time));
         
         if (r == PLC_ERR_TIMEOUT) {
-            plc_log("timeout! i/o: %d us, poll: %d us, run: %d us", io_time, poll_time, run_time);
+            plc_log("timeout! i/o: %d us, poll: %d us, run: %d us", io_time, poll_time, p->run_time);
         }
         o_changed = enc_out(p);
         p->command = 0;
@@ -1585,6 +2624,9 @@ plc_t plc_func(plc_t p) { // TODO: this is a callback, supposed to be
 
         m_changed = check_pulses(p);
         write_mvars(p);
+        collect_changes(p);
+        publish(p);
+        p->quiet = p->chg.size == 0;
         change_mask |= CHANGED_I * i_changed;
         change_mask |= CHANGED_O * o_changed;
         change_mask |= CHANGED_M * m_changed;
@@ -1592,7 +2634,11 @@ plc_t plc_func(plc_t p) { // TODO: this is a callback, supposed to be
         change_mask |= CHANGED_S * s_changed;
         p = save_state(change_mask, p);
     } else {
-        usleep(p->step * THOUSAND);
+        apply_requests(p); // so that the queue does not fill while stopped
+        p->chg.size = 0;
+        if (paced) {
+            usleep(p->step * THOUSAND);
+        }
         timeout = 0;
     }
     if (r < PLC_OK) {
@@ -1601,29 +2647,186 @@ plc_t plc_func(plc_t p) { // TODO: this is a callback, supposed to be
     return p;
 }
 
-static plc_t allocate(plc_t plc) {
-    /*******************initialize***************/
+plc_t plc_func(plc_t p) { // TODO: this is a callback, supposed to be
+    // called every T msec
+    return cycle(p, TRUE);
+}
+
+plc_t plc_scan(plc_t p) {
+    
+    return cycle(p, FALSE);
+}
+
+/**
+ * @brief claim a zeroed register array, from the arena or the heap
+ * @param pointer to PLC registers
+ * @param number of members
+ * @param size of a member
+ * @return the array, or NULL while the arena is measured
+ */
+static void *claim(plc_t plc, size_t n, size_t size) {
+    if (plc->arena.mode & MEM_ARENA) {
+        
+        return arena_take(&plc->arena, n * size);
+    }
+    return calloc(n, size);
+}
+
+/**
+ * @brief carve both state banks out of one allocation
+ * every array is a multiple of 8 bytes, so doubles and words stay aligned
+ * @param pointer to PLC registers
+ * @return PLC with allocated banks
+ */
+static plc_t allocate_banks(plc_t plc) {
+    size_t in = BITWORDS(BYTESIZE * plc->ni) * LONG_BYTES;
+    size_t out = BITWORDS(BYTESIZE * plc->nq) * LONG_BYTES;
+    size_t pulses = BITWORDS(plc->nm) * LONG_BYTES;
+    size_t ai = plc->nai * sizeof(double);
+    size_t aq = plc->naq * sizeof(double);
+    size_t size = ai + aq + 2 * in + pulses + out;
+    int b = 0;
+    
+    plc->bank_mem = (PLC_BYTE*) claim(plc, 2, size);
+    for (; plc->bank_mem && b < 2; b++) {
+        PLC_BYTE *mem = plc->bank_mem + b * size;
+        plc->bank[b].ai = (double*) mem;
+        mem += ai;
+        plc->bank[b].aq = (double*) mem;
+        mem += aq;
+        plc->bank[b].di = (uint64_t*) mem;
+        mem += in;
+        plc->bank[b].pulses = (uint64_t*) mem;
+        mem += pulses;
+        plc->bank[b].inputs = mem;
+        mem += in;
+        plc->bank[b].outputs = mem;
+    }
+    plc->cur = &plc->bank[0];
+    plc->prev = &plc->bank[1];
+    plc->inputs = plc->cur->inputs;
+    plc->outputs = plc->cur->outputs;
+    plc->di.I = plc->cur->di;
+    
+    return plc;
+}
+
+/**
+ * @brief carve the packed flags of digital inputs and outputs,
+ * each flag array of a kind sits next to the others
+ * @param pointer to PLC registers
+ * @return PLC with allocated flags
+ */
+static plc_t allocate_bits(plc_t plc) {
+    size_t in = BITWORDS(BYTESIZE * plc->ni);
+    size_t out = BITWORDS(BYTESIZE * plc->nq);
+    uint64_t *mem = (uint64_t*) claim(plc, 7 * in + 5 * out, sizeof(uint64_t));
+    
+    if (mem == NULL) { // measuring
+        memset(&plc->dq, 0, sizeof(struct digital_output));
+        plc->di.RE = plc->di.FE = plc->di.EDGE = NULL;
+        plc->di.MASK = plc->di.N_MASK = NULL;
+        plc->rising = plc->falling = NULL;
+        
+        return plc;
+    }
+    plc->di.RE = mem;
+    plc->di.FE = mem + in;
+    plc->di.EDGE = mem + 2 * in;
+    plc->di.MASK = mem + 3 * in;
+    plc->di.N_MASK = mem + 4 * in;
+    plc->rising = (PLC_BYTE*) (mem + 5 * in);
+    plc->falling = (PLC_BYTE*) (mem + 6 * in);
+    mem += 7 * in;
+    plc->dq.Q = mem;
+    plc->dq.SET = mem + out;
+    plc->dq.RESET = mem + 2 * out;
+    plc->dq.MASK = mem + 3 * out;
+    plc->dq.N_MASK = mem + 4 * out;
+    
+    return plc;
+}
 
-    plc->inputs = (PLC_BYTE*) calloc(1, plc->ni);
-    plc->outputs = (PLC_BYTE*) calloc(1, plc->nq);
-    plc->real_in = (uint64_t*) calloc(plc->nai, sizeof(uint64_t));
-    plc->real_out = (uint64_t*) calloc(plc->naq, sizeof(uint64_t));
-    plc->di = (di_t) calloc(BYTESIZE * plc->ni, sizeof(struct digital_input));
-    plc->dq = (do_t) calloc(BYTESIZE * plc->nq, sizeof(struct digital_output));
+/**
+ * @brief lay out all registers, hottest first
+ * @param pointer to PLC registers
+ * @return PLC with allocated registers
+ */
+static plc_t layout(plc_t plc) {
+    plc = allocate_banks(plc);
+    plc->real_in = (uint64_t*) claim(plc, plc->nai, sizeof(uint64_t));
+    plc->real_out = (uint64_t*) claim(plc, plc->naq, sizeof(uint64_t));
+    plc = allocate_bits(plc);
+    
+    plc->m = (mvar_t) claim(plc, plc->nm, sizeof(struct mvar));
+    plc->m_dirty = (uint64_t*) claim(plc, BITWORDS(plc->nm), sizeof(uint64_t));
+    plc->t = (dt_t) claim(plc, plc->nt, sizeof(struct timer));
+    plc->s = (blink_t) claim(plc, plc->ns, sizeof(struct blink));
+    plc->t_node = (wheel_node_t) claim(plc, plc->nt, sizeof(struct wheel_node));
+    plc->s_node = (wheel_node_t) claim(plc, plc->ns, sizeof(struct wheel_node));
+
+    plc->ai = (aio_t) claim(plc, plc->nai, sizeof(struct analog_io));
+    plc->aq = (aio_t) claim(plc, plc->naq, sizeof(struct analog_io));
+    plc->mr = (mreal_t) claim(plc, plc->nmr, sizeof(struct mreal));
+    plc->ai_conv.offset = (double*) claim(plc, plc->nai, sizeof(double));
+    plc->ai_conv.scale = (double*) claim(plc, plc->nai, sizeof(double));
+    plc->aq_conv.offset = (double*) claim(plc, plc->naq, sizeof(double));
+    plc->aq_conv.scale = (double*) claim(plc, plc->naq, sizeof(double));
     
-    plc->t = (dt_t) calloc(plc->nt, sizeof(struct timer));
-    plc->s = (blink_t) calloc(plc->ns, sizeof(struct blink));
-    plc->m = (mvar_t) calloc(plc->nm, sizeof(struct mvar));
-    plc->mr = (mreal_t) calloc(plc->nmr, sizeof(struct mreal));
+    plc->sym.di = (char**) claim(plc, BYTESIZE * plc->ni, sizeof(char*));
+    plc->sym.dq = (char**) claim(plc, BYTESIZE * plc->nq, sizeof(char*));
+    
+    plc->chg.mr_dirty = (uint64_t*) claim(plc, BITWORDS(plc->nmr), sizeof(uint64_t));
+    plc->chg.t_dirty = (uint64_t*) claim(plc, BITWORDS(plc->nt), sizeof(uint64_t));
+    plc->chg.s_dirty = (uint64_t*) claim(plc, BITWORDS(plc->ns), sizeof(uint64_t));
+    plc->chg.m_seen = (uint64_t*) claim(plc, plc->nm, sizeof(uint64_t));
+    plc->chg.mr_seen = (double*) claim(plc, plc->nmr, sizeof(double));
+    plc->chg.t_seen = (uint64_t*) claim(plc, BITWORDS(plc->nt), sizeof(uint64_t));
+    plc->chg.s_seen = (uint64_t*) claim(plc, BITWORDS(plc->ns), sizeof(uint64_t));
+    plc->chg.list = (struct change*) claim(plc, 
+        BYTESIZE * (plc->ni + plc->nq) + plc->nai + plc->naq 
+        + plc->nm + plc->nmr + plc->nt + plc->ns, sizeof(struct change));
+    plc->requests = (queue_t) claim(plc, 1, sizeof(struct queue));
+    plc->image.size = image_words(plc);
+    plc->image.seq = (uint64_t*) claim(plc, plc->image.size + 1, sizeof(uint64_t));
+    plc->image.words = (plc->image.seq != NULL) ? plc->image.seq + 1 : NULL;
 
-    plc->ai = (aio_t) calloc(plc->nai, sizeof(struct analog_io));
-    plc->aq = (aio_t) calloc(plc->naq, sizeof(struct analog_io));
+    return plc;
+}
 
+/**
+ * @brief allocate all registers of a plc whose sizes are set.
+ * in MEM_ARENA mode the layout is measured first, 
+ * and then carved out of one arena of the measured size 
+ * @param pointer to PLC registers
+ * @return PLC with allocated registers
+ */
+plc_t allocate(plc_t plc) {
+    /*******************initialize***************/
+    int mode = plc->arena.mode;
+    
+    if (mode & MEM_ARENA) {
+        plc = layout(plc);
+        if (arena_reserve(&plc->arena, plc->arena.used, mode) < PLC_OK) {
+            plc_log("Could not reserve arena, allocating from heap");
+            plc->arena.mode = MEM_HEAP;
+        }
+    }
+    plc = layout(plc);
+    if (plc->requests != NULL) {
+        queue_init(plc->requests);
+    }
+    
     return plc;
 }
 
 /***************construct*******************/
 plc_t plc_new(int di, int dq, int ai, int aq, int nt, int ns, int nm, int nr, int step, hardware_t hw) {
+    
+    return plc_new_mem(di, dq, ai, aq, nt, ns, nm, nr, step, hw, MEM_ARENA);
+}
+
+plc_t plc_new_mem(int di, int dq, int ai, int aq, int nt, int ns, int nm, int nr, int step, hardware_t hw, int mem) {
 
     plc_t plc = (plc_t) calloc(1, sizeof(struct PLC_regs));
 
@@ -1641,10 +2844,9 @@ plc_t plc_new(int di, int dq, int ai, int aq, int nt, int ns, int nm, int nr, in
     
     plc->command = 0;
     plc->status = ST_STOPPED;
+    plc->arena.mode = mem;
 
     plc = allocate(plc);
-    
-    plc->old = plc_copy(plc);
 
     return plc;
 }
@@ -1652,6 +2854,7 @@ plc_t plc_new(int di, int dq, int ai, int aq, int nt, int ns, int nm, int nr, in
 plc_t plc_copy(const plc_t plc) {
     
     plc_t p = (plc_t) calloc(1, sizeof(struct PLC_regs));
+    int i = 0;
 
     p->ni = plc->ni;
     p->nq = plc->nq;
@@ -1661,6 +2864,7 @@ plc_t plc_copy(const plc_t plc) {
     p->ns = plc->ns;
     p->nm = plc->nm;
     p->nmr = plc->nmr;
+    p->arena.mode = plc->arena.mode;
     
     p = allocate(p);
     
@@ -1670,16 +2874,71 @@ plc_t plc_copy(const plc_t plc) {
     memset(p->real_out, 0, plc->naq * sizeof(uint64_t));
     
     memcpy(p->m, plc->m, plc->nm * sizeof(struct mvar));
+    for (i = 0; i < plc->nm; i++) { // recheck all counters
+        BIT_PUT(p->m_dirty, i, 1);
+    }
     memcpy(p->mr, plc->mr, plc->nmr * sizeof(struct mreal));
     memcpy(p->t, plc->t, plc->nt * sizeof(struct timer));
     memcpy(p->s, plc->s, plc->ns * sizeof(struct blink));
+    for (i = 0; i < plc->nmr; i++) { // report what was copied
+        BIT_PUT(p->chg.mr_dirty, i, 1);
+    }
+    for (i = 0; i < plc->nt; i++) {
+        BIT_PUT(p->chg.t_dirty, i, 1);
+    }
+    for (i = 0; i < plc->ns; i++) {
+        BIT_PUT(p->chg.s_dirty, i, 1);
+    }
+    for (i = 0; i < plc->nt; i++) { // running timers count on in the copy
+        p->t[i].V = timer_at(plc, i, plc->clock, &p->t[i].sn);
+    }
+    p->clock = plc->clock;
+    schedule(p);
     
     return p;
 }
 
-// destroy
-void plc_clear(plc_t plc) {
+/**
+ * @brief unmap and unlink the shared segment of a PLC, if it has one.
+ * The image and the requests go with it
+ * @param pointer to PLC registers
+ */
+static void unshare(plc_t p) {
+    if (p->shm.header == NULL) {
+        return;
+    }
+    munmap(p->shm.header, p->shm.header->size);
+    shm_unlink(p->shm.name);
+    free(p->shm.name);
+    p->shm.header = NULL;
+    p->shm.name = NULL;
+    p->image.seq = NULL;
+    p->image.words = NULL;
+    p->requests = NULL;
+}
+
+/**
+ * @brief free all registers, but not the plc itself
+ * @param pointer to PLC registers
+ */
+void deallocate(plc_t plc) {
+    int i = 0;
+    
+    for (; plc != NULL && plc->sym.di && i < BYTESIZE * plc->ni; i++) {
+        free(plc->sym.di[i]);
+    }
+    for (i = 0; plc != NULL && plc->sym.dq && i < BYTESIZE * plc->nq; i++) {
+        free(plc->sym.dq[i]);
+    }
     if (plc != NULL) {
+        counter_stop(&plc->hsc);
+        pool_free(plc->pool);
+        plc->pool = NULL;
+        unshare(plc);
+    }
+    if (plc != NULL && (plc->arena.mode & MEM_ARENA)) {
+        arena_release(&plc->arena);
+    } else if (plc != NULL) {
         if (plc->ai != NULL) {
             free(plc->ai);
         }
@@ -1689,20 +2948,74 @@ void plc_clear(plc_t plc) {
         if (plc->mr != NULL) {
             free(plc->mr);
         }
+        if (plc->ai_conv.offset != NULL) {
+            free(plc->ai_conv.offset);
+        }
+        if (plc->ai_conv.scale != NULL) {
+            free(plc->ai_conv.scale);
+        }
+        if (plc->aq_conv.offset != NULL) {
+            free(plc->aq_conv.offset);
+        }
+        if (plc->aq_conv.scale != NULL) {
+            free(plc->aq_conv.scale);
+        }
         if (plc->m != NULL) {
             free(plc->m);
         }
+        if (plc->m_dirty != NULL) {
+            free(plc->m_dirty);
+        }
         if (plc->s != NULL) {
             free(plc->s);
         }
         if (plc->t != NULL) {
             free(plc->t);
         }
-        if (plc->dq != NULL) {
-            free(plc->dq);
+        if (plc->t_node != NULL) {
+            free(plc->t_node);
+        }
+        if (plc->s_node != NULL) {
+            free(plc->s_node);
+        }
+        if (plc->chg.mr_dirty != NULL) {
+            free(plc->chg.mr_dirty);
+        }
+        if (plc->chg.t_dirty != NULL) {
+            free(plc->chg.t_dirty);
+        }
+        if (plc->chg.s_dirty != NULL) {
+            free(plc->chg.s_dirty);
+        }
+        if (plc->chg.m_seen != NULL) {
+            free(plc->chg.m_seen);
+        }
+        if (plc->chg.mr_seen != NULL) {
+            free(plc->chg.mr_seen);
+        }
+        if (plc->chg.t_seen != NULL) {
+            free(plc->chg.t_seen);
+        }
+        if (plc->chg.s_seen != NULL) {
+            free(plc->chg.s_seen);
+        }
+        if (plc->chg.list != NULL) {
+            free(plc->chg.list);
+        }
+        if (plc->requests != NULL) {
+            free(plc->requests);
+        }
+        if (plc->image.seq != NULL) { // heads the image
+            free(plc->image.seq);
+        }
+        if (plc->sym.dq != NULL) {
+            free(plc->sym.dq);
+        }
+        if (plc->sym.di != NULL) {
+            free(plc->sym.di);
         }
-        if (plc->di != NULL) {
-            free(plc->di);
+        if (plc->di.RE != NULL) { // heads the packed flags
+            free(plc->di.RE);
         }
         if (plc->real_out != NULL) {
             free(plc->real_out);
@@ -1710,14 +3023,17 @@ void plc_clear(plc_t plc) {
         if (plc->real_in != NULL) {
             free(plc->real_in);
         }
-        if (plc->outputs != NULL) {
-            free(plc->outputs);
-        }
-        if (plc->inputs != NULL) {
-            free(plc->inputs);
+        if (plc->bank_mem != NULL) {
+            free(plc->bank_mem);
         }
+    }
+}
+
+// destroy
+void plc_clear(plc_t plc) {
+    if (plc != NULL) {
+        deallocate(plc);
         plc_destroy_rungs(plc);
-        plc_clear(plc->old);
         free(plc);
     }
 }
@@ -1730,12 +3046,12 @@ plc_t plc_declare_variable(const plc_t p, int var, PLC_BYTE idx, const char *val
     switch (var) {
         case OP_INPUT:
             max = p->ni * BYTESIZE;
-            nick = &(r->di[idx].nick);
+            nick = &(r->sym.di[idx]);
             break;
             
         case OP_OUTPUT:
             max = p->nq * BYTESIZE;
-            nick = &(r->dq[idx].nick);
+            nick = &(r->sym.dq[idx]);
             break;
             
         case OP_REAL_INPUT:
@@ -1787,33 +3103,8 @@ plc_t plc_declare_variable(const plc_t p, int var, PLC_BYTE idx, const char *val
 }
 
 plc_t plc_init_variable(const plc_t p, int var, PLC_BYTE idx, const char *val) {
-    plc_t r = p;
-    PLC_BYTE len = 0;
-
-    switch (var) {
-        case OP_REAL_MEMORY:
-            len = r->nmr;
-            if (idx >= len) {
-                r->status = PLC_ERR_BADINDEX;
-            } else {
-                r->mr[idx].V = atof(val);
-            }
-            break;
-            
-        case OP_MEMORY:
-            len = r->nm;
-            if (idx >= len) {
-                r->status = PLC_ERR_BADINDEX;
-            } else {
-                r->m[idx].V = atol(val);
-            }
-            break;
-
-        default:
-            r->status = PLC_ERR_BADOPERAND;
-            break;
-    }
-    return r;
+    
+    return init_variable(p, var, idx, atol(val), atof(val));
 }
 
 plc_t plc_configure_variable_readonly(const plc_t p, int var, PLC_BYTE idx, const char *val) {
@@ -1870,12 +3161,14 @@ plc_t plc_configure_io_limit(const plc_t p, int var, PLC_BYTE idx, const char *v
     } else if (idx >= len) {
         
         r->status = PLC_ERR_BADINDEX;
-    } else if (upper) {
-        
-        io[idx].max = atof(val);
     } else {
-        
-        io[idx].min = atof(val);
+        if (upper) {
+            io[idx].max = atof(val);
+        } else {
+            io[idx].min = atof(val);
+        }
+        scale_analog(var == OP_REAL_INPUT ? &r->ai_conv : &r->aq_conv, 
+                     idx, &io[idx], var == OP_REAL_INPUT);
     }
     return r;
 }
@@ -1892,6 +3185,30 @@ plc_t plc_configure_counter_direction(const plc_t p, PLC_BYTE idx, const char *v
     return r;
 }
 
+plc_t plc_configure_fast_counter(const plc_t p, PLC_BYTE idx, const char *val) {
+    plc_t r = p;
+    long input = atol(val);
+    
+    if (idx >= r->nm || input < 0 || input >= BYTESIZE * r->ni) {
+        r->status = PLC_ERR_BADINDEX;
+    } else if (counter_add(&r->hsc, idx, input) < PLC_OK) {
+        r->status = PLC_ERR;
+    }
+    return r;
+}
+
+plc_t plc_configure_counter_poll(const plc_t p, const char *val) {
+    plc_t r = p;
+    long poll = atol(val);
+    
+    if (poll < 0) {
+        r->status = PLC_ERR;
+    } else {
+        r->hsc.poll = poll;
+    }
+    return r;
+}
+
 plc_t plc_configure_timer_scale(const plc_t p, PLC_BYTE idx, const char *val) {
     plc_t r = p;
     PLC_BYTE len = r->nt;
@@ -1899,7 +3216,9 @@ plc_t plc_configure_timer_scale(const plc_t p, PLC_BYTE idx, const char *val) {
     if (idx >= len) {
         r->status = PLC_ERR_BADINDEX;
     } else {
+        hold_timer(r, idx);
         r->t[idx].S = atol(val);
+        arm_timer(r, idx);
     }
     return r;
 }
@@ -1911,7 +3230,9 @@ plc_t plc_configure_timer_preset(const plc_t p, PLC_BYTE idx, const char *val) {
     if (idx >= len) {
         r->status = PLC_ERR_BADINDEX;
     } else {
+        hold_timer(r, idx);
         r->t[idx].P = atol(val);
+        arm_timer(r, idx);
     }
     return r;
 }
@@ -1935,6 +3256,62 @@ plc_t plc_configure_pulse_scale(const plc_t p, PLC_BYTE idx, const char *val) {
         r->status = PLC_ERR_BADINDEX;
     } else {
         r->s[idx].S = atol(val);
+        arm_blinker(r, idx);
+    }
+    return r;
+}
+
+plc_t plc_configure_task_period(const plc_t p, PLC_BYTE idx, const char *val) {
+    plc_t r = p;
+    
+    if (idx >= MAXTASK) {
+        r->status = PLC_ERR_BADINDEX;
+    } else {
+        r->tasks[idx].period = atol(val);
+        plan_tasks(r);
+    }
+    return r;
+}
+
+plc_t plc_configure_task_priority(const plc_t p, PLC_BYTE idx, const char *val) {
+    plc_t r = p;
+    
+    if (idx >= MAXTASK) {
+        r->status = PLC_ERR_BADINDEX;
+    } else {
+        r->tasks[idx].priority = atoi(val);
+        plan_tasks(r);
+    }
+    return r;
+}
+
+plc_t plc_configure_task_watchdog(const plc_t p, PLC_BYTE idx, const char *val) {
+    plc_t r = p;
+    
+    if (idx >= MAXTASK) {
+        r->status = PLC_ERR_BADINDEX;
+    } else {
+        r->tasks[idx].watchdog = atol(val);
+    }
+    return r;
+}
+
+plc_t plc_configure_workers(const plc_t p, const char *val) {
+    plc_t r = p;
+    
+    r->workers = atoi(val);
+    return r;
+}
+
+plc_t plc_configure_rung_task(const plc_t p, PLC_BYTE idx, const char *val) {
+    plc_t r = p;
+    int k = atoi(val);
+    
+    if (idx >= r->rungno || k < 0 || k >= MAXTASK) {
+        r->status = PLC_ERR_BADINDEX;
+    } else {
+        r->rungs[idx]->task = k;
+        plan_tasks(r);
     }
     return r;
 }
@@ -1943,14 +3320,14 @@ unsigned char plc_get_di_val(plc_t p, unsigned int i) {
     if (!p) {
         return -1;
     }
-    return p->di[i].I;
+    return BIT_GET(p->di.I, i);
 }
 
 unsigned char plc_get_dq_val(plc_t p, unsigned int i) {
     if (!p) {
         return -1;
     }
-    return p->dq[i].Q;
+    return BIT_GET(p->dq.Q, i);
 
 }
 
@@ -1965,7 +3342,7 @@ unsigned int plc_get_t_val(plc_t p, unsigned int i) {
     if (!p) {
         return -1;
     }
-    return p->t[i].V;
+    return timer_value(p, i);
 }
 
 unsigned char plc_get_t_out(plc_t p, unsigned int i) {
@@ -1975,6 +3352,13 @@ unsigned char plc_get_t_out(plc_t p, unsigned int i) {
     return p->t[i].Q;
 }
 
+plc_t plc_set_tickless(plc_t p, unsigned char on) {
+    if (p) {
+        p->tickless = on;
+    }
+    return p;
+}
+
 int plc_is_running(plc_t p) {
     if (!p) {
         return 0;
@@ -1982,6 +3366,192 @@ int plc_is_running(plc_t p) {
     return p->status;
 }
 
+/**
+ * @brief construct a snapshot for an image
+ * @param the sizes of the image
+ * @return the snapshot, NULL on error
+ */
+static snapshot_t new_snapshot(const shared_header_t h) {
+    snapshot_t s = (snapshot_t) calloc(1, sizeof(struct snapshot) 
+                                        + h->words * sizeof(uint64_t));
+    if (s == NULL) {
+        return NULL;
+    }
+    s->size = h->words;
+    s->di = (uint64_t*) (s + 1);
+    s->dq = s->di + BITWORDS(BYTESIZE * h->ni);
+    s->ai = (double*) (s->dq + BITWORDS(BYTESIZE * h->nq));
+    s->aq = s->ai + h->nai;
+    s->m = (uint64_t*) (s->aq + h->naq);
+    s->mr = (double*) (s->m + h->nm);
+    s->t = (uint64_t*) (s->mr + h->nmr);
+    s->t_q = s->t + h->nt;
+    s->s_q = s->t_q + BITWORDS(h->nt);
+    return s;
+}
+
+/**
+ * @brief copy an image that was not being written
+ * @param the sequence number of the image
+ * @param the image
+ * @param the snapshot to copy to
+ */
+static void read_image(uint64_t *seq, uint64_t *words, snapshot_t s) {
+    PLC_BYTE *to = (PLC_BYTE*) s->di;
+    uint64_t before = 0;
+    uint64_t after = 0;
+    unsigned int i = 0;
+    
+    do {
+        before = __atomic_load_n(seq, __ATOMIC_ACQUIRE);
+        if (before & 1) { // being written
+            after = before + 1;
+            continue;
+        }
+        for (i = 0; i < s->size; i++) {
+            uint64_t w = __atomic_load_n(&words[i], __ATOMIC_RELAXED);
+            memcpy(to + i * sizeof(uint64_t), &w, sizeof(uint64_t));
+        }
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        after = __atomic_load_n(seq, __ATOMIC_RELAXED);
+    } while (before != after);
+    s->cycle = before / 2;
+}
+
+snapshot_t plc_new_snapshot(plc_t p) {
+    struct shared_header h;
+    
+    if (p == NULL) {
+        return NULL;
+    }
+    describe(p, &h);
+    return new_snapshot(&h);
+}
+
+int plc_read_snapshot(plc_t p, snapshot_t s) {
+    if (p == NULL || s == NULL || s->size != p->image.size 
+     || p->image.words == NULL) {
+        return PLC_ERR;
+    }
+    read_image(p->image.seq, p->image.words, s);
+    return PLC_OK;
+}
+
+void plc_free_snapshot(snapshot_t s) {
+    if (s != NULL) {
+        free(s);
+    }
+}
+
+plc_t plc_share(plc_t p, const char *name) {
+    shared_header_t h = NULL;
+    size_t image = (sizeof(struct shared_header) + CACHELINE - 1) / CACHELINE * CACHELINE;
+    size_t requests = image + (p->image.size * sizeof(uint64_t) + CACHELINE - 1) 
+                            / CACHELINE * CACHELINE;
+    size_t size = requests + sizeof(struct queue);
+    int fd = -1;
+    
+    if (p->shm.header != NULL || p->image.seq == NULL || p->requests == NULL) {
+        p->status = PLC_ERR;
+        return p;
+    }
+    //never take over a segment someone else may still be using
+    fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0660);
+    if (fd < 0) {
+        plc_log("Could not create shared memory %s", name);
+        p->status = PLC_ERR;
+        return p;
+    }
+    if (ftruncate(fd, size) < 0) {
+        plc_log("Could not size shared memory %s", name);
+        close(fd);
+        shm_unlink(name);
+        p->status = PLC_ERR;
+        return p;
+    }
+    h = (shared_header_t) mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (h == MAP_FAILED) {
+        plc_log("Could not map shared memory %s", name);
+        shm_unlink(name);
+        p->status = PLC_ERR;
+        return p;
+    }
+    memset(h, 0, size);
+    describe(p, h);
+    h->version = SHARED_VERSION;
+    h->size = size;
+    h->image = image;
+    h->requests = requests;
+    h->seq = *p->image.seq;
+    memcpy((char*) h + image, p->image.words, p->image.size * sizeof(uint64_t));
+    memcpy((char*) h + requests, p->requests, sizeof(struct queue));
+    if (!(p->arena.mode & MEM_ARENA)) {
+        free(p->image.seq);
+        free(p->requests);
+    }
+    p->image.seq = &h->seq;
+    p->image.words = (uint64_t*) ((char*) h + image);
+    p->requests = (queue_t) ((char*) h + requests);
+    p->shm.header = h;
+    p->shm.name = strdup(name);
+    __atomic_store_n(&h->magic, SHARED_MAGIC, __ATOMIC_RELEASE); // ready
+    return p;
+}
+
+shared_header_t plc_attach(const char *name) {
+    shared_header_t h = NULL;
+    struct stat st;
+    int fd = shm_open(name, O_RDWR, 0);
+    
+    if (fd < 0) {
+        return NULL;
+    }
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t) sizeof(struct shared_header)) {
+        close(fd);
+        return NULL;
+    }
+    h = (shared_header_t) mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (h == MAP_FAILED) {
+        return NULL;
+    }
+    if (__atomic_load_n(&h->magic, __ATOMIC_ACQUIRE) != SHARED_MAGIC 
+     || h->version != SHARED_VERSION || h->size != st.st_size) {
+        munmap(h, st.st_size);
+        return NULL;
+    }
+    return h;
+}
+
+void plc_detach(shared_header_t h) {
+    if (h != NULL) {
+        munmap(h, h->size);
+    }
+}
+
+snapshot_t plc_new_shared_snapshot(shared_header_t h) {
+    if (h == NULL) {
+        return NULL;
+    }
+    return new_snapshot(h);
+}
+
+int plc_read_shared_snapshot(shared_header_t h, snapshot_t s) {
+    if (h == NULL || s == NULL || s->size != h->words) {
+        return PLC_ERR;
+    }
+    read_image(&h->seq, (uint64_t*) ((char*) h + h->image), s);
+    return PLC_OK;
+}
+
+const struct change *plc_next_change(plc_t p, unsigned int *it) {
+    if (!p || !it || *it >= p->chg.size) {
+        return NULL;
+    }
+    return &p->chg.list[(*it)++];
+}
+
 unsigned char plc_is_updated(plc_t p) {
     if (!p) {
         return 0;
@@ -0,0 +1,130 @@
+/*******************************************************************************
+ LibreLogic : a free PLC library
+ Copyright (C) 2022, Antonis K. (kalamara AT ceid DOT upatras DOT gr)
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+
+#include "pool.h"
+
+/**
+ * @brief take jobs of the current batch until there are none left
+ * @param the pool
+ */
+static void drain(pool_t pool) {
+    unsigned int i = __atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED);
+    
+    while (i < pool->count) {
+        pool->job(pool->arg, i);
+        i = __atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED);
+    }
+}
+
+static void *worker(void *arg) {
+    pool_t pool = (pool_t) arg;
+    unsigned int seen = 0;
+    
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (pool->batch == seen && !pool->quit) {
+            pthread_cond_wait(&pool->go, &pool->lock);
+        }
+        if (pool->quit) {
+            break;
+        }
+        seen = pool->batch;
+        pthread_mutex_unlock(&pool->lock);
+        drain(pool);
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->busy == 0) {
+            pthread_cond_signal(&pool->idle);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+pool_t pool_new(unsigned int threads) {
+    pool_t pool = NULL;
+    
+    if (threads < 2) {
+        return NULL;
+    }
+    pool = (pool_t) calloc(1, sizeof(struct pool));
+    pool->threads = (pthread_t*) calloc(threads - 1, sizeof(pthread_t));
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->go, NULL);
+    pthread_cond_init(&pool->idle, NULL);
+    for (; pool->n < threads - 1; pool->n++) { // make do with those that start
+        if (pthread_create(&pool->threads[pool->n], NULL, worker, pool) != 0) {
+            break;
+        }
+    }
+    if (pool->n == 0) {
+        pool_free(pool);
+        
+        return NULL;
+    }
+    return pool;
+}
+
+void pool_run(pool_t pool, job_f job, void *arg, unsigned int count) {
+    unsigned int i = 0;
+    
+    if (pool == NULL) {
+        for (; i < count; i++) {
+            job(arg, i);
+        }
+        return;
+    }
+    pthread_mutex_lock(&pool->lock);
+    pool->job = job;
+    pool->arg = arg;
+    pool->count = count;
+    pool->next = 0;
+    pool->busy = pool->n;
+    pool->batch++;
+    pthread_cond_broadcast(&pool->go);
+    pthread_mutex_unlock(&pool->lock);
+    
+    drain(pool);
+    
+    pthread_mutex_lock(&pool->lock);
+    while (pool->busy > 0) {
+        pthread_cond_wait(&pool->idle, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void pool_free(pool_t pool) {
+    unsigned int i = 0;
+    
+    if (pool == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&pool->lock);
+    pool->quit = 1;
+    pthread_cond_broadcast(&pool->go);
+    pthread_mutex_unlock(&pool->lock);
+    for (; i < pool->n; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->go);
+    pthread_cond_destroy(&pool->idle);
+    free(pool->threads);
+    free(pool);
+}
@@ -0,0 +1,70 @@
+/*******************************************************************************
+ LibreLogic : a free PLC library
+ Copyright (C) 2022, Antonis K. (kalamara AT ceid DOT upatras DOT gr)
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+
+#include "queue.h"
+
+void queue_init(queue_t q) {
+    uint64_t i = 0;
+    
+    q->head = 0;
+    q->tail = 0;
+    q->dropped = 0;
+    for (; i < QUEUE_SIZE; i++) {
+        q->cells[i].seq = i;
+    }
+}
+
+int queue_push(queue_t q, const struct request *r) {
+    uint64_t pos = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+    
+    for (;;) {
+        struct queue_cell *c = &q->cells[pos & (QUEUE_SIZE - 1)];
+        uint64_t seq = __atomic_load_n(&c->seq, __ATOMIC_ACQUIRE);
+        int64_t diff = (int64_t) (seq - pos);
+        
+        if (diff == 0) { // free for this round: claim it
+            if (__atomic_compare_exchange_n(&q->head, &pos, pos + 1, 1, 
+                                   __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                c->r = *r;
+                __atomic_store_n(&c->seq, pos + 1, __ATOMIC_RELEASE);
+                
+                return 1;
+            } // pos now holds the head another producer moved to
+        } else if (diff < 0) { // not popped since the last round
+            __atomic_fetch_add(&q->dropped, 1, __ATOMIC_RELAXED);
+            
+            return 0;
+        } else {
+            pos = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+int queue_pop(queue_t q, struct request *r) {
+    struct queue_cell *c = &q->cells[q->tail & (QUEUE_SIZE - 1)];
+    
+    if (__atomic_load_n(&c->seq, __ATOMIC_ACQUIRE) != q->tail + 1) {
+        return 0; // empty, or still being written
+    }
+    *r = c->r;
+    __atomic_store_n(&c->seq, q->tail + QUEUE_SIZE, __ATOMIC_RELEASE);
+    q->tail++;
+    return 1;
+}
@@ -0,0 +1,153 @@
+/*******************************************************************************
+ LibreLogic : a free PLC library
+ Copyright (C) 2022, Antonis K. (kalamara AT ceid DOT upatras DOT gr)
+
+ This program is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+
+#include "wheel.h"
+
+#define LEVEL_SPAN(l) ((uint64_t) 1 << (WHEEL_BITS * ((l) + 1)))
+
+static void link_node(wheel_node_t *head, wheel_node_t n) {
+    n->next = *head;
+    if (n->next != NULL) {
+        n->next->pprev = &n->next;
+    }
+    n->pprev = head;
+    *head = n;
+}
+
+static void unlink_node(wheel_node_t n) {
+    *n->pprev = n->next;
+    if (n->next != NULL) {
+        n->next->pprev = n->pprev;
+    }
+    n->next = NULL;
+    n->pprev = NULL;
+}
+
+/**
+ * @brief place an armed node in the slot that covers its expiry
+ * @param the wheel
+ * @param the node
+ */
+static void place(wheel_t w, wheel_node_t n) {
+    uint64_t delta = n->expiry - w->now;
+    int level = 0;
+    
+    while (level < WHEEL_LEVELS && delta >= LEVEL_SPAN(level)) {
+        level++;
+    }
+    if (level == WHEEL_LEVELS) { // too far: park it in the last slot to cascade
+        level = WHEEL_LEVELS - 1;
+        link_node(&w->slot[level][((w->now >> (WHEEL_BITS * level)) - 1) & WHEEL_MASK], n);
+    } else {
+        link_node(&w->slot[level][(n->expiry >> (WHEEL_BITS * level)) & WHEEL_MASK], n);
+    }
+}
+
+void wheel_arm(wheel_t w, wheel_node_t n, uint64_t expiry) {
+    if (w == NULL || n == NULL) {
+        return;
+    }
+    wheel_disarm(w, n);
+    n->expiry = expiry > w->now ? expiry : w->now + 1;
+    place(w, n);
+    w->armed++;
+}
+
+void wheel_disarm(wheel_t w, wheel_node_t n) {
+    if (w == NULL || n == NULL || n->pprev == NULL) {
+        return;
+    }
+    unlink_node(n);
+    w->armed--;
+}
+
+/**
+ * @brief redistribute a slot of a higher level into the lower ones
+ * @param the wheel
+ * @param level
+ */
+static void cascade(wheel_t w, int level) {
+    wheel_node_t *head = &w->slot[level][(w->now >> (WHEEL_BITS * level)) & WHEEL_MASK];
+    wheel_node_t n = *head;
+    
+    *head = NULL;
+    while (n != NULL) {
+        wheel_node_t next = n->next;
+        n->next = NULL;
+        n->pprev = NULL;
+        place(w, n);
+        n = next;
+    }
+}
+
+wheel_node_t wheel_advance(wheel_t w, uint64_t now) {
+    wheel_node_t due = NULL;
+    
+    if (w == NULL) {
+        return NULL;
+    }
+    while (w->now < now && w->armed > 0) {
+        int level = 1;
+        wheel_node_t *head = NULL;
+        
+        w->now++;
+        while (level < WHEEL_LEVELS 
+           && ((w->now >> (WHEEL_BITS * (level - 1))) & WHEEL_MASK) == 0) {
+            cascade(w, level++);
+        }
+        head = &w->slot[0][w->now & WHEEL_MASK];
+        while (*head != NULL) {
+            wheel_node_t n = *head;
+            unlink_node(n);
+            if (n->expiry > w->now) { // parked beyond the span
+                place(w, n);
+            } else {
+                w->armed--;
+                n->next = due;
+                due = n;
+            }
+        }
+    }
+    if (w->now < now) { // nothing armed, skip ahead
+        w->now = now;
+    }
+    return due;
+}
+
+uint64_t wheel_next(const struct wheel *w) {
+    uint64_t next = 0;
+    int level = 0;
+    
+    if (w == NULL || w->armed == 0) {
+        return 0;
+    }
+    for (; level < WHEEL_LEVELS; level++) {
+        int slot = 0;
+        for (; slot < WHEEL_SLOTS; slot++) {
+            wheel_node_t n = w->slot[level][slot];
+            for (; n != NULL; n = n->next) {
+                if (next == 0 || n->expiry < next) {
+                    next = n->expiry;
+                }
+            }
+        }
+    }
+    return next;
+}
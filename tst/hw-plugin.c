@@ -0,0 +1,77 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "plc_iface.h"
+
+//a hardware plugin, loaded by the tests at run time
+
+#ifndef UT_PLUGIN_ABI
+#define UT_PLUGIN_ABI PLC_HW_ABI
+#endif
+
+const uint32_t HardwareAbi = UT_PLUGIN_ABI;
+
+static int plugin_enable(hardware_t hw) {
+    return 0;
+}
+
+static int plugin_disable(hardware_t hw) {
+    return 0;
+}
+
+static int plugin_fetch(hardware_t hw) {
+    return 0;
+}
+
+static int plugin_flush(hardware_t hw) {
+    return 0;
+}
+
+static void plugin_dio_read(hardware_t hw, unsigned int n, unsigned char *bit) {
+    *bit = 1;
+}
+
+static void plugin_dio_write(hardware_t hw, const unsigned char *buf, unsigned int n, unsigned char bit) {
+    return;
+}
+
+static void plugin_data_read(hardware_t hw, unsigned int index, uint64_t *value) {
+    *value = 0xFEEDBEEF;
+}
+
+static void plugin_data_write(hardware_t hw, unsigned int index, uint64_t value) {
+    return;
+}
+
+struct hardware Hardware = {
+        HW_EXT,
+        0, //errorcode
+        "test plugin",
+        plugin_enable, //enable
+        plugin_disable, //disable
+        plugin_fetch, //fetch
+        plugin_flush, //flush
+        plugin_dio_read, //dio_read
+        plugin_dio_write, //dio_write
+        NULL, //dio_bitfield
+        NULL, //dio_read_bytes
+        NULL, //dio_write_bytes
+        NULL, //dio_edges
+        NULL, //count
+        plugin_data_read, //data_read
+        plugin_data_write, //data_write
+        NULL, //hw_config
+        NULL, //wait
+        NULL, //clock
+        NULL, //release
+        NULL, //priv
+};
+
+//one that cannot do I/O
+struct hardware Broken = {
+        HW_EXT,
+        0, //errorcode
+        "broken plugin",
+        plugin_enable, //enable
+        plugin_disable, //disable
+};
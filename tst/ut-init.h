@@ -7,11 +7,11 @@ void ut_construct() {
     CU_ASSERT_PTR_NULL(plc->hw);
     //printf("hw: %s\n", plc.hw);
     CU_ASSERT(plc->ni == 8);
-    CU_ASSERT(plc->di[63].I == 0);
+    CU_ASSERT(BIT_GET(plc->di.I, 63) == 0);
     CU_ASSERT(plc->inputs[7] == 0);
 
     CU_ASSERT(plc->nq == 8);
-    CU_ASSERT(plc->dq[63].Q == 0);
+    CU_ASSERT(BIT_GET(plc->dq.Q, 63) == 0);
     CU_ASSERT(plc->outputs[7] == 0);
 
     CU_ASSERT(plc->nai == 4);
@@ -34,38 +34,48 @@ void ut_construct() {
     CU_ASSERT(plc->nmr == 4);
     CU_ASSERT(plc->mr[3].V < FLOAT_PRECISION);
 
-    CU_ASSERT(plc->old->ni == 8);
-    CU_ASSERT(plc->old->di[63].I == 0);
-    CU_ASSERT(plc->old->inputs[7] == 0);
-
-    CU_ASSERT(plc->old->nq == 8);
-    CU_ASSERT(plc->old->dq[63].Q == 0);
-    CU_ASSERT(plc->old->outputs[7] == 0);
-
-    CU_ASSERT(plc->old->nai == 4);
-    CU_ASSERT(plc->old->real_in[3] == 0);
-    CU_ASSERT(plc->old->ai[3].V < FLOAT_PRECISION);
-    
-    CU_ASSERT(plc->old->naq == 4);
-    CU_ASSERT(plc->old->real_out[3] == 0);
-    CU_ASSERT(plc->old->aq[3].V < FLOAT_PRECISION);
-    
-    CU_ASSERT(plc->old->nt == 4);
-    CU_ASSERT(plc->old->t[3].Q == 0);
-    
-    CU_ASSERT(plc->old->ns == 4);
-    CU_ASSERT(plc->old->s[3].Q == 0);
-    
-    CU_ASSERT(plc->old->nm == 4);
-    CU_ASSERT(plc->old->m[3].V == 0);
-    
-    CU_ASSERT(plc->old->nmr == 4);
-    CU_ASSERT(plc->old->mr[3].V < FLOAT_PRECISION);
+    //previous state bank
+    CU_ASSERT(plc->cur != plc->prev);
+    CU_ASSERT(plc->inputs == plc->cur->inputs);
+    CU_ASSERT(plc->outputs == plc->cur->outputs);
+    CU_ASSERT(plc->prev->inputs[7] == 0);
+    CU_ASSERT(plc->prev->di[0] == 0);
+    CU_ASSERT(plc->prev->outputs[7] == 0);
+    CU_ASSERT(plc->prev->ai[3] < FLOAT_PRECISION);
+    CU_ASSERT(plc->prev->aq[3] < FLOAT_PRECISION);
+    CU_ASSERT(plc->prev->pulses[0] == 0);
 
     CU_ASSERT(plc->step == 100);
     CU_ASSERT(plc->command == 0);
     CU_ASSERT(plc->status == ST_STOPPED);
     
+    //the whole image lives in one cache aligned arena
+    CU_ASSERT(plc->arena.mode == MEM_ARENA);
+    CU_ASSERT_PTR_NOT_NULL(plc->arena.base);
+    CU_ASSERT(plc->arena.used <= plc->arena.size);
+    CU_ASSERT((PLC_BYTE*) plc->bank_mem == plc->arena.base);
+    CU_ASSERT((PLC_BYTE*) plc->mr >= plc->arena.base);
+    CU_ASSERT((PLC_BYTE*) plc->mr < plc->arena.base + plc->arena.used);
+    CU_ASSERT((uintptr_t) plc->m % CACHELINE == 0);
+    CU_ASSERT((uintptr_t) plc->ai % CACHELINE == 0);
+    
+    plc_clear(plc);
+    
+    //huge pages and locking fall back if not permitted
+    plc = plc_new_mem(8, 8, 4, 4, 4, 4, 4, 4, 100, NULL, 
+                      MEM_ARENA | MEM_HUGEPAGE | MEM_LOCKED);
+    CU_ASSERT_PTR_NOT_NULL(plc->arena.base);
+    CU_ASSERT(plc->arena.used <= plc->arena.size);
+    CU_ASSERT(plc->m[3].V == 0);
+    CU_ASSERT(plc->prev->inputs[7] == 0);
+    plc->mr[3].V = 1.0;
+    plc_clear(plc);
+    
+    //one allocation per array
+    plc = plc_new_mem(8, 8, 4, 4, 4, 4, 4, 4, 100, NULL, MEM_HEAP);
+    CU_ASSERT_PTR_NULL(plc->arena.base);
+    CU_ASSERT(plc->m[3].V == 0);
+    CU_ASSERT(plc->prev->inputs[7] == 0);
     plc_clear(plc);
 }
 
@@ -81,11 +91,11 @@ void ut_config() {
 
     plc->status = PLC_OK;
     plc = plc_declare_variable(plc, OP_INPUT, 1, "input_1");
-    CU_ASSERT_STRING_EQUAL(plc->di[1].nick, "input_1");
+    CU_ASSERT_STRING_EQUAL(plc->sym.di[1], "input_1");
     CU_ASSERT(plc->status == PLC_OK);
     
     plc = plc_declare_variable(plc, OP_OUTPUT, 2, "output_1");
-    CU_ASSERT_STRING_EQUAL(plc->dq[2].nick, "output_1");
+    CU_ASSERT_STRING_EQUAL(plc->sym.dq[2], "output_1");
     
     plc = plc_declare_variable(plc, OP_REAL_INPUT, 5, "input_1");
     CU_ASSERT(plc->status == PLC_ERR_BADINDEX);
@@ -189,8 +199,8 @@ void ut_config() {
     plc_clear(plc);
 }
 
-int stub_enable_fails();
-int stub_enable();
+int stub_enable_fails(hardware_t hw);
+int stub_enable(hardware_t hw);
 
 void ut_start_stop() {
     extern unsigned char Mock_din;
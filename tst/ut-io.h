@@ -50,4 +50,492 @@ void ut_write() {
     deinit_mock_plc(&p);
 }
 
+static unsigned int Bytes_calls = 0;
+static PLC_BYTE Bytes_out[8];
+
+static void bytes_dio_read(hardware_t hw, unsigned int n, PLC_BYTE *bytes) {
+    unsigned int i = 0;
+    Bytes_calls++;
+    for (; i < n; i++) {
+        bytes[i] = 0xA0 + i;
+    }
+}
+
+static void bytes_dio_write(hardware_t hw, unsigned int n, const PLC_BYTE *bytes) {
+    Bytes_calls++;
+    memcpy(Bytes_out, bytes, n < 8 ? n : 8);
+}
+
+void ut_io_bytes() {
+    extern unsigned char Mock_dout;
+    struct PLC_regs p;
+    init_mock_plc(&p);
+    struct hardware hw = *p.hw;
+    hw.dio_read_bytes = bytes_dio_read;
+    hw.dio_write_bytes = bytes_dio_write;
+    p.hw = &hw;
+    //a call for all the bytes, instead of one per bit
+    Bytes_calls = 0;
+    read_inputs(&p);
+    CU_ASSERT(Bytes_calls == 1);
+    CU_ASSERT(p.inputs[0] == 0xA0);
+    CU_ASSERT(p.inputs[p.ni - 1] == 0xA0 + p.ni - 1);
+    
+    Mock_dout = 0;
+    memset(p.outputs, 0x5A, p.nq);
+    write_outputs(&p);
+    CU_ASSERT(Bytes_calls == 2);
+    CU_ASSERT(Bytes_out[p.nq - 1] == 0x5A);
+    CU_ASSERT(Mock_dout == 0); //not a bit at a time
+    deinit_mock_plc(&p);
+}
+
+static void edges_dio_edges(hardware_t hw, unsigned int n, PLC_BYTE *rising, PLC_BYTE *falling) {
+    memset(rising, 0, n);
+    memset(falling, 0, n);
+    rising[0] = 0x0C; //inputs 2 and 3 pulsed between scans
+    falling[0] = 0x0C;
+}
+
+void ut_io_edges() {
+    struct PLC_regs p;
+    init_mock_plc(&p);
+    struct hardware hw = *p.hw;
+    hw.dio_read_bytes = bytes_dio_read; //0xA0: inputs 2, 3 stay low
+    hw.dio_edges = edges_dio_edges;
+    p.hw = &hw;
+    plc_force(&p, OP_INPUT, 3, "0");
+    read_inputs(&p);
+    CU_ASSERT(dec_inp(&p) == TRUE);
+    //the pulse is seen although the level came back
+    CU_ASSERT(BIT_GET(p.di.I, 2) == 0);
+    CU_ASSERT(BIT_GET(p.di.RE, 2) == 1);
+    CU_ASSERT(BIT_GET(p.di.FE, 2) == 1);
+    CU_ASSERT(BIT_GET(p.di.EDGE, 2) == 1);
+    //but not on a forced input
+    CU_ASSERT(BIT_GET(p.di.RE, 3) == 0);
+    CU_ASSERT(BIT_GET(p.di.FE, 3) == 0);
+    //nor on the others
+    CU_ASSERT(BIT_GET(p.di.RE, 1) == 0);
+    CU_ASSERT(BIT_GET(p.di.FE, 1) == 0);
+    deinit_mock_plc(&p);
+}
+
+//a fake sysfs and devfs tree, as iio_dummy would have it
+static const char *Iio_dirs[] = {
+    "sys", "sys/bus", "sys/bus/iio", "sys/bus/iio/devices", 
+    "sys/bus/iio/devices/iio:device0",
+    "sys/bus/iio/devices/iio:device0/scan_elements",
+    "sys/bus/iio/devices/iio:device0/buffer",
+    "sys/bus/iio/devices/iio:device0/trigger",
+    "dev",
+};
+
+#define IIO_DEV "sys/bus/iio/devices/iio:device0/"
+
+static const char *Iio_files[][2] = {
+    { IIO_DEV "scan_elements/in_timestamp_en", "1" },
+    { IIO_DEV "scan_elements/in_timestamp_index", "2" },
+    { IIO_DEV "scan_elements/in_timestamp_type", "le:s64/64>>0" },
+    { IIO_DEV "scan_elements/in_voltage1_en", "0" },
+    { IIO_DEV "scan_elements/in_voltage1_index", "1" },
+    { IIO_DEV "scan_elements/in_voltage1_type", "be:s12/16>>4" },
+    { IIO_DEV "scan_elements/in_voltage0_en", "0" },
+    { IIO_DEV "scan_elements/in_voltage0_index", "0" },
+    { IIO_DEV "scan_elements/in_voltage0_type", "le:u12/16>>0" },
+    { IIO_DEV "buffer/length", "" },
+    { IIO_DEV "buffer/enable", "" },
+    { IIO_DEV "trigger/current_trigger", "" },
+    { IIO_DEV "out_voltage0_raw", "" },
+    { IIO_DEV "out_voltage1_raw", "" },
+    //two scans of voltage0 (le), voltage1 (be, shifted)
+    { "dev/iio:device0", "\x23\x01\x00\x10" "\xFF\x0F\xFF\xE0" },
+};
+
+static void iio_attr(const char *root, const char *attr, char *val, unsigned int len) {
+    char path[MAXSTR];
+    FILE *f = NULL;
+    memset(val, 0, len);
+    sprintf(path, "%s/%s", root, attr);
+    if ((f = fopen(path, "r")) != NULL) {
+        fread(val, 1, len - 1, f);
+        fclose(f);
+    }
+}
+
+void ut_io_iio() {
+    extern struct hardware Iio;
+    char root[] = "/tmp/ut-iioXXXXXX";
+    char path[MAXSTR];
+    char val[TINYSTR];
+    uint64_t v = 0;
+    int i = 0;
+    CU_ASSERT(mkdtemp(root) != NULL);
+    for (i = 0; i < sizeof(Iio_dirs) / sizeof(Iio_dirs[0]); i++) {
+        sprintf(path, "%s/%s", root, Iio_dirs[i]);
+        mkdir(path, 0700);
+    }
+    for (i = 0; i < sizeof(Iio_files) / sizeof(Iio_files[0]); i++) {
+        sprintf(path, "%s/%s", root, Iio_files[i][0]);
+        FILE *f = fopen(path, "w");
+        CU_ASSERT(f != NULL);
+        if (f == NULL) {
+            continue;
+        }
+        fwrite(Iio_files[i][1], 1, i + 1 < sizeof(Iio_files) / sizeof(Iio_files[0]) 
+               ? strlen(Iio_files[i][1]) : 8, f);
+        fclose(f);
+    }
+    struct config_iio conf = { root, 0, 0, "trig0", 4, 2, 1, "fake iio" };
+    struct hardware hw = Iio;
+    hw.priv = NULL;
+    CU_ASSERT(hw.configure(&hw, &conf) == PLC_OK);
+    CU_ASSERT(hw.enable(&hw) == PLC_OK);
+    //the first two scan elements are captured, the timestamp left out
+    iio_attr(root, IIO_DEV "scan_elements/in_voltage0_en", val, TINYSTR);
+    CU_ASSERT_STRING_EQUAL(val, "1");
+    iio_attr(root, IIO_DEV "scan_elements/in_voltage1_en", val, TINYSTR);
+    CU_ASSERT_STRING_EQUAL(val, "1");
+    iio_attr(root, IIO_DEV "scan_elements/in_timestamp_en", val, TINYSTR);
+    CU_ASSERT_STRING_EQUAL(val, "0");
+    iio_attr(root, IIO_DEV "trigger/current_trigger", val, TINYSTR);
+    CU_ASSERT_STRING_EQUAL(val, "trig0");
+    iio_attr(root, IIO_DEV "buffer/length", val, TINYSTR);
+    CU_ASSERT_STRING_EQUAL(val, "4");
+    iio_attr(root, IIO_DEV "buffer/enable", val, TINYSTR);
+    CU_ASSERT_STRING_EQUAL(val, "1");
+    //one read takes both scans, the newest one is kept
+    CU_ASSERT(hw.fetch(&hw) == 8);
+    hw.data_read(&hw, 0, &v);
+    CU_ASSERT(v == 0xFFF);
+    hw.data_read(&hw, 1, &v);
+    CU_ASSERT((int64_t) v == -2);
+    //nothing new, the values stay
+    CU_ASSERT(hw.fetch(&hw) == 0);
+    hw.data_read(&hw, 0, &v);
+    CU_ASSERT(v == 0xFFF);
+    //outputs are written when flushed, only the configured ones
+    hw.data_write(&hw, 0, 42);
+    hw.data_write(&hw, 1, 7);
+    iio_attr(root, IIO_DEV "out_voltage0_raw", val, TINYSTR);
+    CU_ASSERT_STRING_EQUAL(val, "");
+    CU_ASSERT(hw.flush(&hw) == PLC_OK);
+    iio_attr(root, IIO_DEV "out_voltage0_raw", val, TINYSTR);
+    CU_ASSERT_STRING_EQUAL(val, "42\n");
+    iio_attr(root, IIO_DEV "out_voltage1_raw", val, TINYSTR);
+    CU_ASSERT_STRING_EQUAL(val, "");
+    CU_ASSERT(hw.disable(&hw) == PLC_OK);
+    iio_attr(root, IIO_DEV "buffer/enable", val, TINYSTR);
+    CU_ASSERT_STRING_EQUAL(val, "0");
+    //started again, with the same outputs
+    CU_ASSERT(hw.enable(&hw) == PLC_OK);
+    hw.data_write(&hw, 1, 7);
+    CU_ASSERT(hw.flush(&hw) == PLC_OK);
+    iio_attr(root, IIO_DEV "out_voltage1_raw", val, TINYSTR);
+    CU_ASSERT_STRING_EQUAL(val, "");
+    CU_ASSERT(hw.disable(&hw) == PLC_OK);
+    free(hw.priv);
+    for (i = sizeof(Iio_files) / sizeof(Iio_files[0]) - 1; i >= 0; i--) {
+        sprintf(path, "%s/%s", root, Iio_files[i][0]);
+        unlink(path);
+    }
+    for (i = sizeof(Iio_dirs) / sizeof(Iio_dirs[0]) - 1; i >= 0; i--) {
+        sprintf(path, "%s/%s", root, Iio_dirs[i]);
+        rmdir(path);
+    }
+    rmdir(root);
+}
+
+//the plant model side of a simulation
+static void plant_step(sim_header_t h, PLC_BYTE in, uint64_t ain) {
+    __atomic_add_fetch(&h->in_seq, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    ((PLC_BYTE*) h + h->inputs)[0] = in;
+    memcpy((char*) h + h->adc, &ain, sizeof(uint64_t));
+    __atomic_add_fetch(&h->in_seq, 1, __ATOMIC_RELEASE);
+    syscall(SYS_futex, &h->in_seq, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+static sim_header_t plant_attach(const char *name, size_t *size) {
+    sim_header_t h = NULL;
+    int fd = shm_open(name, O_RDWR, 0);
+    CU_ASSERT(fd >= 0);
+    h = (sim_header_t) mmap(NULL, sizeof(struct sim_header), 
+                            PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    CU_ASSERT(h != MAP_FAILED);
+    CU_ASSERT(__atomic_load_n(&h->magic, __ATOMIC_ACQUIRE) == SIM_MAGIC);
+    *size = h->size;
+    munmap(h, sizeof(struct sim_header));
+    h = (sim_header_t) mmap(NULL, *size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    return h;
+}
+
+static void *plant_late(void *arg) {
+    usleep(5000);
+    plant_step((sim_header_t) arg, 0x55, 7);
+    return NULL;
+}
+
+void ut_io_sim_shm() {
+    extern struct hardware Sim;
+    struct config_sim conf = { NULL, NULL, 1, 1, 1, 1, "sim", "/ut-sim-shm", 20 };
+    struct hardware hw = Sim;
+    struct PLC_regs p;
+    pthread_t plant;
+    PLC_BYTE b = 0;
+    uint64_t v = 0;
+    init_mock_plc(&p);
+    hw.priv = NULL;
+    p.hw = &hw;
+    CU_ASSERT(hw.configure(&hw, &conf) == PLC_OK);
+    CU_ASSERT(hw.enable(&hw) == PLC_OK);
+    //the plant attaches by name
+    size_t size = 0;
+    sim_header_t h = plant_attach("/ut-sim-shm", &size);
+    CU_ASSERT(h->ni == 1 && h->nq == 1 && h->nai == 1 && h->naq == 1);
+    CU_ASSERT(h->lockstep == 1);
+    //no step of the plant yet: the scan times out
+    CU_ASSERT(hw.fetch(&hw) == PLC_ERR);
+    plant_step(h, 0xA5, 0x1234);
+    read_inputs(&p);
+    CU_ASSERT(p.inputs[0] == 0xA5);
+    CU_ASSERT(p.real_in[0] == 0x1234);
+    hw.dio_read(&hw, 0, &b);
+    CU_ASSERT(b == 1);
+    hw.dio_read(&hw, 1, &b);
+    CU_ASSERT(b == 0);
+    //a step is taken once
+    CU_ASSERT(hw.fetch(&hw) == PLC_ERR);
+    hw.data_read(&hw, 0, &v);
+    CU_ASSERT(v == 0x1234);
+    //the outputs are published in binary
+    p.outputs[0] = 0x3C;
+    p.real_out[0] = 0xABCDEF01;
+    write_outputs(&p);
+    CU_ASSERT(__atomic_load_n(&h->out_seq, __ATOMIC_ACQUIRE) == 2);
+    CU_ASSERT(((PLC_BYTE*) h + h->outputs)[0] == 0x3C);
+    memcpy(&v, (char*) h + h->dac, sizeof(uint64_t));
+    CU_ASSERT(v == 0xABCDEF01);
+    //the scan waits for a late plant
+    pthread_create(&plant, NULL, plant_late, h);
+    CU_ASSERT(hw.fetch(&hw) > 0);
+    pthread_join(plant, NULL);
+    hw.dio_read_bytes(&hw, 1, &b);
+    CU_ASSERT(b == 0x55);
+    //stopped and started again, with the plant still attached
+    CU_ASSERT(hw.disable(&hw) == PLC_OK);
+    CU_ASSERT(hw.enable(&hw) == PLC_OK);
+    plant_step(h, 0x66, 9);
+    CU_ASSERT(hw.fetch(&hw) > 0);
+    hw.dio_read_bytes(&hw, 1, &b);
+    CU_ASSERT(b == 0x66);
+    CU_ASSERT(hw.disable(&hw) == PLC_OK);
+    int fd = shm_open("/ut-sim-shm", O_RDWR, 0);
+    CU_ASSERT(fd >= 0);
+    close(fd);
+    //until released
+    CU_ASSERT(hw.release(&hw) == PLC_OK);
+    CU_ASSERT(shm_open("/ut-sim-shm", O_RDWR, 0) < 0);
+    munmap(h, size);
+    free(hw.priv);
+    hw.priv = NULL;
+    
+    //free running: a step the plant never finishes writing is not taken
+    conf.lockstep_ms = 0;
+    CU_ASSERT(hw.configure(&hw, &conf) == PLC_OK);
+    CU_ASSERT(hw.enable(&hw) == PLC_OK);
+    h = plant_attach("/ut-sim-shm", &size);
+    CU_ASSERT(h->lockstep == 0);
+    plant_step(h, 0x0F, 3);
+    CU_ASSERT(hw.fetch(&hw) > 0);
+    __atomic_add_fetch(&h->in_seq, 1, __ATOMIC_RELEASE); //stuck writing
+    ((PLC_BYTE*) h + h->inputs)[0] = 0xF0;
+    CU_ASSERT(hw.fetch(&hw) == PLC_ERR);
+    hw.dio_read_bytes(&hw, 1, &b);
+    CU_ASSERT(b == 0x0F);
+    hw.data_read(&hw, 0, &v);
+    CU_ASSERT(v == 3);
+    //until it does
+    __atomic_add_fetch(&h->in_seq, 1, __ATOMIC_RELEASE);
+    CU_ASSERT(hw.fetch(&hw) > 0);
+    hw.dio_read_bytes(&hw, 1, &b);
+    CU_ASSERT(b == 0xF0);
+    CU_ASSERT(hw.disable(&hw) == PLC_OK);
+    CU_ASSERT(hw.release(&hw) == PLC_OK);
+    munmap(h, size);
+    free(hw.priv);
+    //released while enabled, before it is freed: no shared memory is left
+    hw.priv = NULL;
+    CU_ASSERT(hw.configure(&hw, &conf) == PLC_OK);
+    CU_ASSERT(hw.enable(&hw) == PLC_OK);
+    CU_ASSERT(hw.release(&hw) == PLC_OK);
+    CU_ASSERT(shm_open("/ut-sim-shm", O_RDWR, 0) < 0);
+    free(hw.priv);
+    deinit_mock_plc(&p);
+}
+
+//the device recorded: inputs that change every other scan
+static unsigned int Dev_scan = 0;
+static PLC_BYTE Dev_out[8];
+static uint64_t Dev_aout[2];
+
+static int dev_fetch(hardware_t hw) {
+    Dev_scan++;
+    return 0;
+}
+
+static void dev_dio_read_bytes(hardware_t hw, unsigned int n, PLC_BYTE *bytes) {
+    unsigned int i = 0;
+    for (; i < n; i++) {
+        bytes[i] = (i == 0) ? Dev_scan / 2 : 0x11;
+    }
+}
+
+static void dev_data_read(hardware_t hw, unsigned int index, uint64_t *value) {
+    *value = (index == 0) ? 1000 - Dev_scan : 7;
+}
+
+static void dev_dio_write_bytes(hardware_t hw, unsigned int n, const PLC_BYTE *bytes) {
+    memcpy(Dev_out, bytes, n < 8 ? n : 8);
+}
+
+static void dev_data_write(hardware_t hw, unsigned int index, uint64_t value) {
+    if (index < 2) {
+        Dev_aout[index] = value;
+    }
+}
+
+static void trace_logic(plc_t p, PLC_BYTE skew) {
+    int i = 0;
+    for (; i < p->nq; i++) {
+        p->outputs[i] = p->inputs[i] ^ 0xFF;
+    }
+    p->outputs[0] += skew;
+    p->real_out[0] = 2 * p->real_in[0];
+}
+
+void ut_io_trace() {
+    extern struct hardware Trace;
+    char path[] = "/tmp/ut-traceXXXXXX";
+    struct PLC_regs p;
+    struct stat st;
+    uint64_t clocks[5];
+    PLC_BYTE seen[5];
+    uint64_t t = 0;
+    int k = 0;
+    close(mkstemp(path));
+    init_mock_plc(&p);
+    //record
+    struct hardware dev = Hw_stub;
+    dev.fetch = dev_fetch;
+    dev.dio_read_bytes = dev_dio_read_bytes;
+    dev.data_read = dev_data_read;
+    dev.dio_write_bytes = dev_dio_write_bytes;
+    dev.data_write = dev_data_write;
+    struct config_trace conf = { path, 0, &dev, 8, 8, 2, 2, "record" };
+    struct hardware rec = Trace;
+    rec.priv = NULL;
+    Dev_scan = 0;
+    CU_ASSERT(rec.configure(&rec, &conf) == PLC_OK);
+    CU_ASSERT(rec.enable(&rec) == PLC_OK);
+    p.hw = &rec;
+    for (k = 0; k < 5; k++) {
+        clocks[k] = rec.clock(&rec);
+        read_inputs(&p);
+        seen[k] = p.inputs[0];
+        trace_logic(&p, 0);
+        write_outputs(&p);
+        usleep(2000);
+    }
+    //the device still does the I/O
+    CU_ASSERT(Dev_out[0] == (seen[4] ^ 0xFF));
+    CU_ASSERT(Dev_aout[0] == 2 * (1000 - 5));
+    write_outputs(&p); //as when stopped, not a scan
+    CU_ASSERT(rec.disable(&rec) == PLC_OK);
+    free(rec.priv);
+    //only the changes are kept
+    CU_ASSERT(stat(path, &st) == 0);
+    CU_ASSERT(st.st_size < 24 + 5 * (8 + 8 + 16 + 16));
+    //replay
+    struct config_trace rconf = { path, 1, NULL, 0, 0, 0, 0, "replay" };
+    struct hardware rep = Trace;
+    rep.priv = NULL;
+    CU_ASSERT(rep.configure(&rep, &rconf) == PLC_OK);
+    CU_ASSERT(rep.enable(&rep) == PLC_OK);
+    p.hw = &rep;
+    memset(p.inputs, 0, p.ni);
+    for (k = 0; k < 5; k++) {
+        uint64_t now = rep.clock(&rep);
+        //the scans are as far apart as they were recorded
+        if (k > 0) {
+            CU_ASSERT(now - t == clocks[k] - clocks[k - 1]);
+        }
+        t = now;
+        read_inputs(&p);
+        CU_ASSERT(p.inputs[0] == seen[k]);
+        CU_ASSERT(p.inputs[7] == 0x11);
+        CU_ASSERT(p.real_in[0] == 1000 - (k + 1));
+        CU_ASSERT(p.real_in[1] == 7);
+        trace_logic(&p, 0);
+        write_outputs(&p);
+    }
+    CU_ASSERT(plc_trace_divergence(&rep) == -1);
+    //the end of the trace
+    CU_ASSERT(rep.status == PLC_OK);
+    CU_ASSERT(rep.fetch(&rep) == PLC_ERR);
+    CU_ASSERT(rep.status == PLC_ERR);
+    CU_ASSERT(rep.disable(&rep) == PLC_OK);
+    free(rep.priv);
+    //a replay that diverges
+    rep = Trace;
+    rep.priv = NULL;
+    CU_ASSERT(rep.configure(&rep, &rconf) == PLC_OK);
+    CU_ASSERT(rep.enable(&rep) == PLC_OK);
+    for (k = 0; k < 5; k++) {
+        read_inputs(&p);
+        trace_logic(&p, k >= 3);
+        write_outputs(&p);
+    }
+    CU_ASSERT(plc_trace_divergence(&rep) == 3);
+    CU_ASSERT(rep.disable(&rep) == PLC_OK);
+    free(rep.priv);
+    CU_ASSERT(plc_trace_divergence(&Hw_stub) == -1);
+    unlink(path);
+    deinit_mock_plc(&p);
+}
+
+void ut_io_plugin() {
+    uint64_t v = 0;
+    PLC_BYTE b = 0;
+    //nothing to load
+    unsetenv("PLC_HARDWARE");
+    CU_ASSERT(plc_load_hardware(NULL, NULL) == NULL);
+    CU_ASSERT(plc_load_hardware("/nonexistent/plugin.so", NULL) == NULL);
+    //the default symbol
+    hardware_t hw = plc_load_hardware(UT_PLUGIN, NULL);
+    CU_ASSERT(hw != NULL);
+    if (hw == NULL) {
+        return;
+    }
+    CU_ASSERT(hw->type == HW_EXT);
+    CU_ASSERT_STRING_EQUAL(hw->label, "test plugin");
+    CU_ASSERT(hw->enable(hw) == PLC_OK);
+    hw->dio_read(hw, 0, &b);
+    CU_ASSERT(b == 1);
+    hw->data_read(hw, 0, &v);
+    CU_ASSERT(v == 0xFEEDBEEF);
+    CU_ASSERT(hw->disable(hw) == PLC_OK);
+    //symbols that are missing, or not a whole backend
+    CU_ASSERT(plc_load_hardware(UT_PLUGIN, "Missing") == NULL);
+    CU_ASSERT(plc_load_hardware(UT_PLUGIN, "Broken") == NULL);
+    //built against another struct hardware
+    CU_ASSERT(plc_load_hardware(UT_PLUGIN_OLD, NULL) == NULL);
+    //named by the environment, loaded once
+    setenv("PLC_HARDWARE", UT_PLUGIN, 1);
+    CU_ASSERT(plc_load_hardware(NULL, NULL) == hw);
+    CU_ASSERT(plc_load_hardware(NULL, NULL) == hw);
+    unsetenv("PLC_HARDWARE");
+}
+
 #endif //_UT_IO_
@@ -3,6 +3,9 @@
 
 extern struct hardware Hw_stub;
 
+plc_t allocate(plc_t plc);
+void deallocate(plc_t plc);
+
 void init_mock_plc(plc_t plc) {
     memset(plc, 0, sizeof(struct PLC_regs));
     plc->ni = 8;
@@ -14,88 +17,20 @@ void init_mock_plc(plc_t plc) {
     plc->nm = 8;
     plc->nmr = 8;
     plc->hw = &Hw_stub;
-    plc->inputs = (PLC_BYTE*) calloc(1, plc->ni);
-    plc->outputs = (PLC_BYTE*) calloc(1, plc->nq);
-    plc->real_in = (uint64_t*) calloc(plc->nai, sizeof(uint64_t));
-    plc->real_out = (uint64_t*) calloc(plc->naq, sizeof(uint64_t));
-
-    plc->di = (di_t) calloc(BYTESIZE * plc->ni, sizeof(struct digital_input));
-    plc->dq = (do_t) calloc(BYTESIZE * plc->nq, sizeof(struct digital_output));
-
-    plc->ai = (aio_t) calloc(plc->nai, sizeof(struct analog_io));
-    plc->aq = (aio_t) calloc(plc->naq, sizeof(struct analog_io));
-
-    plc->t = (dt_t) calloc(plc->nt, sizeof(struct timer));
-    plc->s = (blink_t) calloc(plc->ns, sizeof(struct blink));
-    plc->m = (mvar_t) calloc(plc->nm, sizeof(struct mvar));
-    plc->mr = (mreal_t) calloc(plc->nmr, sizeof(struct mreal));
+    allocate(plc);
 }
 
 void deinit_mock_plc(plc_t plc) {
-    if (plc->inputs) {
-        free(plc->inputs);
-        plc->inputs = NULL;
-    }
-    if (plc->outputs) {
-        free(plc->outputs);
-        plc->outputs = NULL;
-    }
-    if (plc->real_in) {
-        free(plc->real_in);
-        plc->real_in = NULL;
-    }
-    if (plc->real_out) {
-        free(plc->real_out);
-        plc->real_out = NULL;
-    }
-    if (plc->di) {
-        free(plc->di);
-        plc->di = NULL;
-    }
-    if (plc->dq) {
-        free(plc->dq);
-        plc->dq = NULL;
-    }
-    if (plc->ai) {
-        free(plc->ai);
-        plc->ai = NULL;
-    }
-    if (plc->aq) {
-        free(plc->aq);
-        plc->aq = NULL;
-    }
-    if (plc->t) {
-        free(plc->t);
-        plc->t = NULL;
-    }
-    if (plc->s) {
-        free(plc->s);
-        plc->s = NULL;
-    }
-    if (plc->m) {
-        free(plc->m);
-        plc->m = NULL;
-    }
-    if (plc->mr) {
-        free(plc->mr);
-        plc->mr = NULL;
-    }
-    if (plc->old) {
-        deinit_mock_plc(plc->old);
-        free(plc->old);
-        plc->old = NULL;
-    }
+    deallocate(plc);
+    memset(plc, 0, sizeof(struct PLC_regs));
 }
 
 unsigned char dec_inp(plc_t p); //decode input bytes
 unsigned char enc_out(plc_t p); //encode digital outputs to output bytes
+void swap_banks(plc_t p);
 void ut_codec() {
     struct PLC_regs p;
     init_mock_plc(&p);
-    plc_t p_old = NULL;
-    p_old = (plc_t) malloc(sizeof(struct PLC_regs));
-    init_mock_plc(p_old);
-    p.old = p_old;
 
     int i = 0;
     p.inputs[0] = 0xaa;
@@ -103,8 +38,8 @@ void ut_codec() {
     //from zero to 0xaa
     
     p.real_in[0] = UINT64_MAX / 2;
-    p.ai[0].min = 0.0l;
-    p.ai[0].max = 10.0l;
+    plc_configure_io_limit(&p, OP_REAL_INPUT, 0, "0.0", FALSE);
+    plc_configure_io_limit(&p, OP_REAL_INPUT, 0, "10.0", TRUE);
     
     PLC_BYTE changed = dec_inp(&p);
     
@@ -112,23 +47,25 @@ void ut_codec() {
     //everything in buffer should be transferred to inputs
     //any input that changed must have set rising edge
     for (i = 0; i < 8; i++) {
-        CU_ASSERT(p.di[i].I == (0xaa >> i) % 2);
-        CU_ASSERT(p.di[i].I == p.di[i].RE);
-        CU_ASSERT(p.di[i].FE == 0);
+        CU_ASSERT(BIT_GET(p.di.I, i) == (0xaa >> i) % 2);
+        CU_ASSERT(BIT_GET(p.di.I, i) == BIT_GET(p.di.RE, i));
+        CU_ASSERT(BIT_GET(p.di.FE, i) == 0);
     }
+    //decoded inputs are packed in the current bank
+    CU_ASSERT(p.cur->di[0] == 0xaa);
     
     //printf("\n%lf\n", p.ai[0].V);
     //analog should be max / 2 = 5
     CU_ASSERT_DOUBLE_EQUAL(p.ai[0].V, 5.0l, FLOAT_PRECISION);
     //first four outputs are true, next for are set
     for (i = 0; i < 4; i++) {
-        p.dq[i].Q = 1;
-        p.dq[i + 4].SET = 1;
+        BIT_ASSIGN(p.dq.Q, i, 1);
+        BIT_ASSIGN(p.dq.SET, i + 4, 1);
     }
     //analog 0 has value and is not forced (mask > max)
     p.aq[0].mask = 99.0l;
-    p.aq[0].min = -10.0l;
-    p.aq[0].max = 10.0l;
+    plc_configure_io_limit(&p, OP_REAL_OUTPUT, 0, "-10.0", FALSE);
+    plc_configure_io_limit(&p, OP_REAL_OUTPUT, 0, "10.0", TRUE);
     p.aq[0].V = -7.5l;
     
     changed = enc_out(&p);
@@ -141,35 +78,38 @@ void ut_codec() {
     CU_ASSERT(p.real_out[0] == 0x2000000000000000);
     
     //   printf("%lx\n", p.real_out[0]);
-    //0xaa to 0xaa
+    //next cycle: 0xaa to 0xaa
+    swap_banks(&p);
+    CU_ASSERT(p.prev->inputs[0] == 0xaa);
+    CU_ASSERT(p.prev->outputs[0] == 0xff);
+    p.inputs[0] = 0xaa;
+    //nothing changed
+    changed = dec_inp(&p);
     
-    p.old->inputs[0] = 0xaa;
-    for (i = 0; i < 8; i++) {
-        p.old->di[i].I = (0xaa >> i) % 2;
-        p.old->di[i].I = p.di[i].RE;
-        p.old->di[i].FE = 0;
-    }
-    p.old->outputs[0] = 0xff;
+    CU_ASSERT(changed == FALSE);
     
     //only analog changed
+    p.real_in[0] = UINT64_MAX / 4;
     changed = dec_inp(&p);
     
     CU_ASSERT(changed == TRUE);
+    CU_ASSERT_DOUBLE_EQUAL(p.ai[0].V, 2.5l, FLOAT_PRECISION);
     
-    p.old->aq[0].V = -7.5l;
-//same values as old
+//same values as previous cycle
     changed = enc_out(&p);
     
     CU_ASSERT(changed == FALSE);
+    CU_ASSERT(p.outputs[0] == 0xff);
     
     for (i = 0; i < 8; i++) {
 //    printf("input %d value %x re %x fe %x\n",
-//                i, p.di[i].I, p.di[i].RE, p.di[i].FE);
-        CU_ASSERT(p.di[i].I == (0xaa >> i) % 2);
-        CU_ASSERT(p.di[i].FE == p.di[i].RE);
-        CU_ASSERT(p.di[i].FE == 0);
+//                i, BIT_GET(p.di.I, i), BIT_GET(p.di.RE, i), BIT_GET(p.di.FE, i));
+        CU_ASSERT(BIT_GET(p.di.I, i) == (0xaa >> i) % 2);
+        CU_ASSERT(BIT_GET(p.di.FE, i) == BIT_GET(p.di.RE, i));
+        CU_ASSERT(BIT_GET(p.di.FE, i) == 0);
     }
     //0xaa to 0xcc        
+    swap_banks(&p);
     p.inputs[0] = 0xcc;
     //RE = 0x44
     //FE = 0x22
@@ -180,36 +120,38 @@ void ut_codec() {
     
     for (i = 0; i < 8; i++) {
         // printf("input %d value %x re %x fe %x\n",
-        //        i, p.di[i].I, p.di[i].RE, p.di[i].FE);
-        CU_ASSERT(p.di[i].I == (0xcc >> i) % 2);
-        CU_ASSERT(p.di[i].RE == (0x44 >> i) % 2);
-        CU_ASSERT(p.di[i].FE == (0x22 >> i) % 2);
+        //        i, BIT_GET(p.di.I, i), BIT_GET(p.di.RE, i), BIT_GET(p.di.FE, i));
+        CU_ASSERT(BIT_GET(p.di.I, i) == (0xcc >> i) % 2);
+        CU_ASSERT(BIT_GET(p.di.RE, i) == (0x44 >> i) % 2);
+        CU_ASSERT(BIT_GET(p.di.FE, i) == (0x22 >> i) % 2);
     }
+    enc_out(&p);
     //masks
     for (i = 0; i < 8; i++) {
-        p.di[i].MASK = (0x33 >> i) % 2;
+        BIT_ASSIGN(p.di.MASK, i, (0x33 >> i) % 2);
     }
     for (i = 0; i < 8; i++) {
-        p.di[i].N_MASK = (0xee >> i) % 2;
+        BIT_ASSIGN(p.di.N_MASK, i, (0xee >> i) % 2);
     }
     p.ai[0].mask = 9.0l;
     for (i = 0; i < 8; i++) {
-        p.dq[i].MASK = (0x33 >> i) % 2;
-        p.dq[i].N_MASK = (0xee >> i) % 2;
+        BIT_ASSIGN(p.dq.MASK, i, (0x33 >> i) % 2);
+        BIT_ASSIGN(p.dq.N_MASK, i, (0xee >> i) % 2);
     }
     p.aq[0].mask = 2.5l;
     
     //force 0 has precedence
     //Q:       1111 
     //I:       1100
-    //old:     1010
+    //old:     1100
     //force 1: 0011 
     //force 0: 1110
     //result:  0001
-    //edge:    1011
-    //fe:      1010
+    //edge:    1101
+    //fe:      1100
     //re:      0001
-    
+    swap_banks(&p);
+    p.inputs[0] = 0xcc;
     changed = dec_inp(&p);
     
     CU_ASSERT(changed == TRUE);
@@ -218,11 +160,11 @@ void ut_codec() {
     
     for (i = 0; i < 8; i++) {
         //printf("\noutput %d value %x set %x reset %x\n",
-        //          i, p.dq[i].Q,
-        //        p.dq[i].SET, p.dq[i].RESET);
-        CU_ASSERT(p.di[i].I == (0x11 >> i) % 2);
-        CU_ASSERT(p.di[i].RE == (0x11 >> i) % 2);
-        CU_ASSERT(p.di[i].FE == (0xaa >> i) % 2);
+        //          i, BIT_GET(p.dq.Q, i),
+        //        BIT_GET(p.dq.SET, i), BIT_GET(p.dq.RESET, i));
+        CU_ASSERT(BIT_GET(p.di.I, i) == (0x11 >> i) % 2);
+        CU_ASSERT(BIT_GET(p.di.RE, i) == (0x11 >> i) % 2);
+        CU_ASSERT(BIT_GET(p.di.FE, i) == (0xcc >> i) % 2);
     }
     
     changed = enc_out(&p);
@@ -233,10 +175,68 @@ void ut_codec() {
     //printf("%lx\n", p.real_out[0]);
     CU_ASSERT(p.real_out[0] == 0xa000000000000000);
 
-    deinit_mock_plc(p_old);
     deinit_mock_plc(&p);
 }
 
+void ut_codec_wide() {
+    //5 words of contacts and 6 analog channels: 
+    //both the batched part and the remainder of the codec
+    plc_t p = plc_new(40, 40, 6, 6, 0, 0, 0, 0, 100, &Hw_stub);
+    int i = 0;
+    char lim[8];
+    
+    for (i = 0; i < 40; i++) {
+        p->inputs[i] = i;
+    }
+    plc_force(p, OP_INPUT, 200, "0");
+    BIT_ASSIGN(p->di.MASK, 300, TRUE);
+    for (i = 0; i < 6; i++) {
+        sprintf(lim, "%d.0", i);
+        plc_configure_io_limit(p, OP_REAL_INPUT, i, lim, FALSE);
+        sprintf(lim, "%d.0", i + 10);
+        plc_configure_io_limit(p, OP_REAL_INPUT, i, lim, TRUE);
+        p->real_in[i] = UINT64_MAX / 2;
+        
+        plc_configure_io_limit(p, OP_REAL_OUTPUT, i, "0.0", FALSE);
+        plc_configure_io_limit(p, OP_REAL_OUTPUT, i, "10.0", TRUE);
+        p->aq[i].V = 2.5l;
+    }
+    CU_ASSERT(dec_inp(p) == TRUE);
+    
+    for (i = 0; i < 320; i++) {
+        int val = (i / 8 >> (i % 8)) % 2;
+        if (i == 200) {
+            val = 0;
+        } else if (i == 300) {
+            val = 1;
+        }
+        CU_ASSERT(BIT_GET(p->di.I, i) == val);
+        CU_ASSERT(BIT_GET(p->di.RE, i) == val);
+        CU_ASSERT(BIT_GET(p->di.EDGE, i) == val);
+        CU_ASSERT(BIT_GET(p->di.FE, i) == 0);
+    }
+    for (i = 0; i < 6; i++) {
+        CU_ASSERT_DOUBLE_EQUAL(p->ai[i].V, i + 5.0l, FLOAT_PRECISION);
+    }
+    
+    BIT_ASSIGN(p->dq.Q, 7, TRUE);
+    plc_force(p, OP_OUTPUT, 7, "0");
+    BIT_ASSIGN(p->dq.SET, 131, TRUE);
+    BIT_ASSIGN(p->dq.SET, 132, TRUE);
+    BIT_ASSIGN(p->dq.RESET, 132, TRUE);
+    BIT_ASSIGN(p->dq.MASK, 310, TRUE);
+    CU_ASSERT(enc_out(p) == TRUE);
+    
+    for (i = 0; i < 40; i++) {
+        PLC_BYTE val = i == 16 ? 0x08 : i == 38 ? 0x40 : 0;
+        CU_ASSERT(p->outputs[i] == val);
+    }
+    for (i = 0; i < 6; i++) {
+        CU_ASSERT(p->real_out[i] == 0x4000000000000000);
+    }
+    plc_clear(p);
+}
+
 int handle_jmp(const rung_t r, unsigned int *pc);
 void ut_jmp() {
     //degenerates
@@ -355,19 +355,19 @@ void ut_set_reset() {
     ins.modifier = IL_COND;
     result = handle_set(&ins, acc, TRUE, &p);
     CU_ASSERT(result == PLC_OK);
-    CU_ASSERT(p.dq[10].SET == TRUE);
-    CU_ASSERT(p.dq[10].RESET == FALSE);
+    CU_ASSERT(BIT_GET(p.dq.SET, 10) == TRUE);
+    CU_ASSERT(BIT_GET(p.dq.RESET, 10) == FALSE);
     
     //conditional
     acc.u = FALSE;
-    p.dq[10].SET = FALSE;
-    //   p.dq[10].RESET == FALSE;
+    BIT_ASSIGN(p.dq.SET, 10, FALSE);
+    //   BIT_GET(p.dq.RESET, 10) == FALSE;
     ins.operation = IL_RESET;
     ins.modifier = IL_COND;
     result = handle_reset(&ins, acc, TRUE, &p);
     CU_ASSERT(result == PLC_OK);
-    CU_ASSERT(p.dq[10].SET == FALSE);
-    CU_ASSERT(p.dq[10].RESET == FALSE);
+    CU_ASSERT(BIT_GET(p.dq.SET, 10) == FALSE);
+    CU_ASSERT(BIT_GET(p.dq.RESET, 10) == FALSE);
     // memset(&ins, 0, sizeof(struct instruction));
     
     //START
@@ -471,7 +471,7 @@ void ut_st() {
     ins.bit = 2;
     result = handle_st(&ins, acc, &p);
     CU_ASSERT(result == PLC_OK);
-    CU_ASSERT(p.dq[10].Q == TRUE);
+    CU_ASSERT(BIT_GET(p.dq.Q, 10) == TRUE);
     
     //real
     ins.operand = OP_REAL_CONTACT;
@@ -707,7 +707,7 @@ void ut_ld() {
     CU_ASSERT(acc.u == 123);
     
     ins.bit = 2;
-    p.dq[10].Q = TRUE;
+    BIT_ASSIGN(p.dq.Q, 10, TRUE);
     result = handle_ld(&ins, &acc, &p);
     CU_ASSERT(acc.u == 1);
     deinit_mock_plc(&p);
@@ -747,7 +747,7 @@ void ut_ld() {
     CU_ASSERT(acc.u == 123);
     
     ins.bit = 2;
-    p.di[10].I = TRUE;
+    BIT_ASSIGN(p.di.I, 10, TRUE);
     result = handle_ld(&ins, &acc, &p);
     CU_ASSERT(acc.u == 1);
     deinit_mock_plc(&p);
@@ -868,7 +868,7 @@ void ut_ld() {
     result = handle_ld(&ins, &acc, &p);
     CU_ASSERT(result == PLC_ERR_BADOPERAND);
     ins.bit = 2;
-    p.di[10].RE = TRUE;
+    BIT_ASSIGN(p.di.RE, 10, TRUE);
     result = handle_ld(&ins, &acc, &p);
     CU_ASSERT(acc.u == 1);
     deinit_mock_plc(&p);
@@ -885,7 +885,7 @@ void ut_ld() {
     result = handle_ld(&ins, &acc, &p);
     CU_ASSERT(result == PLC_ERR_BADOPERAND);
     ins.bit = 2;
-    p.di[10].FE = TRUE;
+    BIT_ASSIGN(p.di.FE, 10, TRUE);
     result = handle_ld(&ins, &acc, &p);
     CU_ASSERT(acc.u == 1);
     
@@ -1169,9 +1169,9 @@ void ut_instruct_bitwise() {
      I0.2-----I0.0-----+
      */
     /*triple majority gate. C, B true, A false => true*/
-    p.di[0].I = FALSE;
-    p.di[1].I = TRUE;
-    p.di[2].I = TRUE;
+    BIT_ASSIGN(p.di.I, 0, FALSE);
+    BIT_ASSIGN(p.di.I, 1, TRUE);
+    BIT_ASSIGN(p.di.I, 2, TRUE);
     
     //LD  %I0.0   ;A = TRUE
     ins.operation = IL_LD;
@@ -1274,7 +1274,7 @@ void ut_instruct_bitwise() {
     result = append(&ins, &r);
     pc = r.insno - 1;
     result = instruct(&p, &r, &pc);
-    CU_ASSERT(p.dq[0].Q == TRUE);
+    CU_ASSERT(BIT_GET(p.dq.Q, 0) == TRUE);
     
     clear_rung(&r);
     deinit_mock_plc(&p);
@@ -2540,62 +2540,62 @@ void ut_task_bitwise() {
     memset(&ins, 0, sizeof(struct instruction));
     
     /*triple majority gate*/
-    p.di[0].I = FALSE;
-    p.di[1].I = FALSE;
-    p.di[2].I = FALSE;
+    BIT_ASSIGN(p.di.I, 0, FALSE);
+    BIT_ASSIGN(p.di.I, 1, FALSE);
+    BIT_ASSIGN(p.di.I, 2, FALSE);
     result = task(1000, &p, &r);
-    CU_ASSERT(p.dq[0].Q == FALSE);
+    CU_ASSERT(BIT_GET(p.dq.Q, 0) == FALSE);
     CU_ASSERT(result == PLC_OK);
     
-    p.di[0].I = TRUE;
-    p.di[1].I = FALSE;
-    p.di[2].I = FALSE;
+    BIT_ASSIGN(p.di.I, 0, TRUE);
+    BIT_ASSIGN(p.di.I, 1, FALSE);
+    BIT_ASSIGN(p.di.I, 2, FALSE);
     result = task(1000, &p, &r);
-    CU_ASSERT(p.dq[0].Q == FALSE);
+    CU_ASSERT(BIT_GET(p.dq.Q, 0) == FALSE);
     CU_ASSERT(result == PLC_OK);
     CU_ASSERT(r.acc.u == FALSE);
     CU_ASSERT(r.stack == NULL);
     
-    p.di[0].I = FALSE;
-    p.di[1].I = TRUE;
-    p.di[2].I = FALSE;
+    BIT_ASSIGN(p.di.I, 0, FALSE);
+    BIT_ASSIGN(p.di.I, 1, TRUE);
+    BIT_ASSIGN(p.di.I, 2, FALSE);
     result = task(1000, &p, &r);
-    CU_ASSERT(p.dq[0].Q == FALSE);
+    CU_ASSERT(BIT_GET(p.dq.Q, 0) == FALSE);
     CU_ASSERT(result == PLC_OK);
     
-    p.di[0].I = FALSE;
-    p.di[1].I = FALSE;
-    p.di[2].I = TRUE;
+    BIT_ASSIGN(p.di.I, 0, FALSE);
+    BIT_ASSIGN(p.di.I, 1, FALSE);
+    BIT_ASSIGN(p.di.I, 2, TRUE);
     result = task(1000, &p, &r);
-    CU_ASSERT(p.dq[0].Q == FALSE);
+    CU_ASSERT(BIT_GET(p.dq.Q, 0) == FALSE);
     CU_ASSERT(result == PLC_OK);
     
-    p.di[0].I = TRUE;
-    p.di[1].I = TRUE;
-    p.di[2].I = FALSE;
+    BIT_ASSIGN(p.di.I, 0, TRUE);
+    BIT_ASSIGN(p.di.I, 1, TRUE);
+    BIT_ASSIGN(p.di.I, 2, FALSE);
     result = task(1000, &p, &r);
-    CU_ASSERT(p.dq[0].Q == TRUE);
+    CU_ASSERT(BIT_GET(p.dq.Q, 0) == TRUE);
     CU_ASSERT(result == PLC_OK);
 
-    p.di[0].I = TRUE;
-    p.di[1].I = FALSE;
-    p.di[2].I = TRUE;
+    BIT_ASSIGN(p.di.I, 0, TRUE);
+    BIT_ASSIGN(p.di.I, 1, FALSE);
+    BIT_ASSIGN(p.di.I, 2, TRUE);
     result = task(1000, &p, &r);
-    CU_ASSERT(p.dq[0].Q == TRUE);
+    CU_ASSERT(BIT_GET(p.dq.Q, 0) == TRUE);
     CU_ASSERT(result == PLC_OK);
     
-    p.di[0].I = FALSE;
-    p.di[1].I = TRUE;
-    p.di[2].I = TRUE;
+    BIT_ASSIGN(p.di.I, 0, FALSE);
+    BIT_ASSIGN(p.di.I, 1, TRUE);
+    BIT_ASSIGN(p.di.I, 2, TRUE);
     result = task(1000, &p, &r);
-    CU_ASSERT(p.dq[0].Q == TRUE);
+    CU_ASSERT(BIT_GET(p.dq.Q, 0) == TRUE);
     CU_ASSERT(result == PLC_OK);
 
-    p.di[0].I = TRUE;
-    p.di[1].I = TRUE;
-    p.di[2].I = TRUE;
+    BIT_ASSIGN(p.di.I, 0, TRUE);
+    BIT_ASSIGN(p.di.I, 1, TRUE);
+    BIT_ASSIGN(p.di.I, 2, TRUE);
     result = task(1000, &p, &r);
-    CU_ASSERT(p.dq[0].Q == TRUE);
+    CU_ASSERT(BIT_GET(p.dq.Q, 0) == TRUE);
     CU_ASSERT(result == PLC_OK);
 
     clear_rung(&r);
@@ -2642,6 +2642,15 @@ void ut_task_timeout() {
     
     result = task(timeout, &p, &r);
     CU_ASSERT(result == PLC_ERR_TIMEOUT);
+    
+    //longer than a second: the seconds count too
+    struct timespec t0;
+    struct timespec t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    result = task(MILLION + 1, &p, &r);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    CU_ASSERT(result == PLC_ERR_TIMEOUT);
+    CU_ASSERT(t1.tv_sec - t0.tv_sec >= 1 && t1.tv_sec - t0.tv_sec <= 3);
     deinit_mock_plc(&p);
 }
 
@@ -2875,6 +2884,7 @@ void ut_type() {
 
 void ut_force() {
     struct PLC_regs plc;
+    memset(&plc, 0, sizeof(struct PLC_regs));
     //degenerates
     plc_t r = plc_force(NULL, -1, -1, NULL);
     CU_ASSERT(plc_is_forced(NULL, -1, -1) == PLC_ERR);
@@ -2906,27 +2916,27 @@ void ut_force() {
     r = plc_force(&plc, OP_INPUT, 1, "1");
     
     CU_ASSERT_PTR_NOT_NULL(r);
-    CU_ASSERT(r->di[1].MASK == 1);
+    CU_ASSERT(BIT_GET(r->di.MASK, 1) == 1);
     r = plc_force(&plc, OP_INPUT, 1, "0");
-    CU_ASSERT(r->di[1].N_MASK == 1);
+    CU_ASSERT(BIT_GET(r->di.N_MASK, 1) == 1);
     CU_ASSERT(plc_is_forced(r, OP_INPUT, 1) == 1);
     r = plc_unforce(&plc, OP_INPUT, 1);
     
-    CU_ASSERT(r->di[1].MASK == 0);
-    CU_ASSERT(r->di[1].N_MASK == 0);
+    CU_ASSERT(BIT_GET(r->di.MASK, 1) == 0);
+    CU_ASSERT(BIT_GET(r->di.N_MASK, 1) == 0);
     CU_ASSERT(plc_is_forced(r, OP_INPUT, 1) == 0);
     
     r = plc_force(&plc, OP_OUTPUT, 1, "1");
     
     CU_ASSERT_PTR_NOT_NULL(r);
-    CU_ASSERT(r->dq[1].MASK == 1);
+    CU_ASSERT(BIT_GET(r->dq.MASK, 1) == 1);
     r = plc_force(&plc, OP_OUTPUT, 1, "0");
-    CU_ASSERT(r->dq[1].N_MASK == 1);
+    CU_ASSERT(BIT_GET(r->dq.N_MASK, 1) == 1);
     CU_ASSERT(plc_is_forced(r, OP_OUTPUT, 1) == 1);
     r = plc_unforce(&plc, OP_OUTPUT, 1);
     
-    CU_ASSERT(r->dq[1].MASK == 0);
-    CU_ASSERT(r->dq[1].N_MASK == 0);
+    CU_ASSERT(BIT_GET(r->dq.MASK, 1) == 0);
+    CU_ASSERT(BIT_GET(r->dq.N_MASK, 1) == 0);
     CU_ASSERT(plc_is_forced(r, OP_OUTPUT, 1) == 0);
     
     r = plc_force(&plc, OP_REAL_INPUT, 1, "-1.5");
@@ -2961,4 +2971,1163 @@ void ut_force() {
     deinit_mock_plc(&plc);
 }
 
+PLC_BYTE manage_timers(plc_t p);
+PLC_BYTE manage_blinkers(plc_t p);
+
+//a timer scanned every millisecond
+void scan_timer(dt_t t) {
+    if (t->V < t->P && t->START) {
+        t->sn++;
+        if (t->sn >= (t->S > 0 ? t->S : 1)) {
+            t->V++;
+            t->sn = 0;
+        }
+    }
+}
+
+void output_timer(dt_t t) {
+    if (t->START) {
+        t->Q = (t->V < t->P) ? !t->ONDELAY : t->ONDELAY;
+    }
+}
+
+void ut_timers() {
+    struct PLC_regs p;
+    init_mock_plc(&p);
+    struct timer ref[2];
+    memset(ref, 0, sizeof(ref));
+    
+    struct instruction ins;
+    memset(&ins, 0, sizeof(struct instruction));
+    ins.operand = OP_START;
+    data_t acc;
+    acc.u = TRUE;
+    
+    p.clock = 0;
+    plc_configure_timer_scale(&p, 0, "10");
+    plc_configure_timer_preset(&p, 0, "5");
+    plc_configure_timer_delay_mode(&p, 0, "ON");
+    ref[0].S = 10;
+    ref[0].P = 5;
+    ref[0].ONDELAY = TRUE;
+    //default time base: preset in msec
+    plc_configure_timer_preset(&p, 1, "400");
+    ref[1].P = 400;
+    
+    plc_configure_pulse_scale(&p, 1, "25");
+    
+    //cycles of varying length, in msec
+    int cycle = 0;
+    uint64_t ms = 0;
+    for (; cycle < 200; cycle++) {
+        int i = 0;
+        uint64_t next = ms + 1 + (cycle * 7) % 17;
+        for (; ms < next; ms++) {
+            scan_timer(&ref[0]);
+            scan_timer(&ref[1]);
+        }
+        output_timer(&ref[0]);
+        output_timer(&ref[1]);
+        p.clock = ms;
+        manage_timers(&p);
+        manage_blinkers(&p);
+        for (; i < 2; i++) {
+            CU_ASSERT(plc_get_t_val(&p, i) == ref[i].V);
+            CU_ASSERT(p.t[i].Q == ref[i].Q);
+        }
+        CU_ASSERT(p.s[1].Q == (ms / 25) % 2);
+        CU_ASSERT(p.s[0].Q == FALSE);
+        //the program: start, pause and resume timers, change presets
+        ins.byte = 0;
+        if (cycle == 3 || cycle == 30 || cycle == 100) {
+            ins.operation = IL_SET;
+            handle_set(&ins, acc, TRUE, &p);
+            ref[0].START = TRUE;
+        } else if (cycle == 10 || cycle == 60) {
+            ins.operation = IL_RESET;
+            handle_reset(&ins, acc, TRUE, &p);
+            ref[0].START = FALSE;
+        } else if (cycle == 45) {
+            plc_configure_timer_preset(&p, 0, "9");
+            ref[0].P = 9;
+        } else if (cycle == 80) {
+            plc_configure_timer_scale(&p, 0, "3");
+            ref[0].S = 3;
+        }
+        ins.byte = 1;
+        if (cycle == 5) {
+            ins.operation = IL_SET;
+            handle_set(&ins, acc, TRUE, &p);
+            ref[1].START = TRUE;
+        } else if (cycle == 20) {
+            plc_configure_timer_scale(&p, 1, "2");
+            ref[1].S = 2;
+        }
+        //counting starts at once
+        output_timer(&ref[0]);
+        output_timer(&ref[1]);
+        CU_ASSERT(p.t[0].Q == ref[0].Q);
+        CU_ASSERT(p.t[1].Q == ref[1].Q);
+    }
+    CU_ASSERT(plc_get_t_val(&p, 0) == 9);
+    CU_ASSERT(plc_get_t_val(&p, 1) == 400);
+    //only running timers are scheduled
+    CU_ASSERT(p.t_wheel.armed == 0);
+    CU_ASSERT(p.s_wheel.armed == 1);
+    
+    deinit_mock_plc(&p);
+}
+
+void ut_wheel() {
+    struct wheel w;
+    memset(&w, 0, sizeof(struct wheel));
+    struct wheel_node n[5];
+    memset(n, 0, sizeof(n));
+    uint64_t expiry[5] = {5, 64, 4099, 262200, 16777300};
+    int i = 0;
+    
+    wheel_arm(NULL, &n[0], 1);
+    CU_ASSERT(wheel_advance(NULL, 1) == NULL);
+    
+    for (; i < 5; i++) {
+        wheel_arm(&w, &n[i], expiry[i]);
+    }
+    CU_ASSERT(w.armed == 5);
+    //every node comes due exactly at its expiry, across all levels
+    for (i = 0; i < 5; i++) {
+        CU_ASSERT(wheel_next(&w) == expiry[i]);
+        CU_ASSERT_PTR_NULL(wheel_advance(&w, expiry[i] - 1));
+        CU_ASSERT(wheel_advance(&w, expiry[i]) == &n[i]);
+        CU_ASSERT_PTR_NULL(n[i].next);
+        CU_ASSERT_PTR_NULL(n[i].pprev);
+    }
+    CU_ASSERT(w.armed == 0);
+    CU_ASSERT(wheel_next(&w) == 0);
+    CU_ASSERT(wheel_next(NULL) == 0);
+    //empty wheel skips ahead
+    CU_ASSERT_PTR_NULL(wheel_advance(&w, 1000000000));
+    CU_ASSERT(w.now == 1000000000);
+    //past expiries are due on the next tick, rearming moves a node
+    wheel_arm(&w, &n[0], 0);
+    wheel_arm(&w, &n[1], w.now + 10);
+    wheel_arm(&w, &n[1], w.now + 1);
+    wheel_arm(&w, &n[2], w.now + 1);
+    wheel_disarm(&w, &n[2]);
+    wheel_disarm(&w, &n[2]);
+    CU_ASSERT(w.armed == 2);
+    wheel_node_t due = wheel_advance(&w, w.now + 1);
+    CU_ASSERT(due == &n[0] || due == &n[1]);
+    CU_ASSERT(due->next == &n[0] || due->next == &n[1]);
+    CU_ASSERT_PTR_NULL(due->next->next);
+    CU_ASSERT_PTR_NULL(wheel_advance(&w, w.now + 100));
+    CU_ASSERT(w.armed == 0);
+}
+
+void read_mvars(plc_t p);
+void write_mvars(plc_t p);
+PLC_BYTE check_pulses(plc_t p);
+
+void ut_counters() {
+    struct PLC_regs p;
+    init_mock_plc(&p);
+    //the same counters, passed over in full every cycle
+    struct mvar ref[8];
+    PLC_BYTE ref_pulse[8];
+    memset(ref, 0, sizeof(ref));
+    memset(ref_pulse, 0, sizeof(ref_pulse));
+    
+    struct instruction ins;
+    memset(&ins, 0, sizeof(struct instruction));
+    ins.operand = OP_PULSEIN;
+    data_t acc;
+    acc.u = TRUE;
+    
+    plc_configure_counter_direction(&p, 2, "DOWN");
+    ref[2].DOWN = TRUE;
+    plc_configure_variable_readonly(&p, OP_MEMORY, 3, "TRUE");
+    ref[3].RO = TRUE;
+    
+    unsigned int seed = 7;
+    int cycle = 0;
+    for (; cycle < 300; cycle++) {
+        int i = 0;
+        int k = 0;
+        
+        swap_banks(&p);
+        read_mvars(&p);
+        for (i = 0; i < 8; i++) {
+            if (ref[i].SET || ref[i].RESET)
+                ref[i].PULSE = ref[i].SET && !ref[i].RESET;
+        }
+        //a program touching a few counters
+        for (k = 0; k < 3; k++) {
+            seed = seed * 1103515245 + 12345;
+            i = (seed >> 8) % 8;
+            ins.byte = i;
+            switch ((seed >> 16) % 6) {
+                case 0:
+                    ins.operation = IL_SET;
+                    handle_set(&ins, acc, FALSE, &p);
+                    ref[i].SET = TRUE;
+                    ref[i].RESET = FALSE;
+                    if (!ref[i].PULSE)
+                        ref[i].EDGE = TRUE;
+                    break;
+                case 1:
+                    ins.operation = IL_RESET;
+                    handle_reset(&ins, acc, FALSE, &p);
+                    ref[i].RESET = TRUE;
+                    ref[i].SET = FALSE;
+                    if (ref[i].PULSE)
+                        ref[i].EDGE = TRUE;
+                    break;
+                case 2:
+                case 3:
+                    ins.operation = IL_ST;
+                    ins.bit = 0;
+                    st_mem(&ins, (seed >> 20) % 2, &p);
+                    ref[i].EDGE = ref[i].PULSE != (seed >> 20) % 2;
+                    ref[i].PULSE = (seed >> 20) % 2;
+                    break;
+                default: //idle
+                    break;
+            }
+        }
+        PLC_BYTE changed = FALSE;
+        for (i = 0; i < 8; i++) {
+            if (ref[i].PULSE != ref_pulse[i]) {
+                ref[i].EDGE = TRUE;
+                changed = TRUE;
+            }
+            ref_pulse[i] = ref[i].PULSE;
+        }
+        CU_ASSERT(check_pulses(&p) == changed);
+        write_mvars(&p);
+        for (i = 0; i < 8; i++) {
+            if (!ref[i].RO && ref[i].PULSE && ref[i].EDGE) {
+                ref[i].V += (ref[i].DOWN) ? -1 : 1;
+                ref[i].EDGE = FALSE;
+            }
+            CU_ASSERT(p.m[i].V == ref[i].V);
+            CU_ASSERT(p.m[i].PULSE == ref[i].PULSE);
+            CU_ASSERT(p.m[i].EDGE == ref[i].EDGE);
+            CU_ASSERT(BIT_GET(p.cur->pulses, i) == ref[i].PULSE);
+        }
+    }
+    CU_ASSERT(p.m[0].V > 0);
+    CU_ASSERT(p.m[3].V == 0);
+    
+    deinit_mock_plc(&p);
+}
+
+void collect_changes(plc_t p);
+
+void ut_changes() {
+    struct PLC_regs p;
+    init_mock_plc(&p);
+    //the registers as the last cycle left them, compared in full
+    double ref[N_REG][64];
+    memset(ref, 0, sizeof(ref));
+    int n[N_REG] = {64, 64, 2, 2, 8, 8, 2, 2};
+    PLC_BYTE in[8];
+    memset(in, 0, sizeof(in));
+    
+    struct instruction ins;
+    memset(&ins, 0, sizeof(struct instruction));
+    data_t acc;
+    acc.u = TRUE;
+    
+    p.clock = 0;
+    plc_configure_timer_scale(&p, 0, "10");
+    plc_configure_timer_preset(&p, 0, "5");
+    plc_configure_timer_delay_mode(&p, 0, "ON");
+    plc_configure_pulse_scale(&p, 1, "25");
+    plc_configure_io_limit(&p, OP_REAL_INPUT, 0, "0.0", FALSE);
+    plc_configure_io_limit(&p, OP_REAL_INPUT, 0, "10.0", TRUE);
+    
+    unsigned int seed = 11;
+    int cycle = 0;
+    for (; cycle < 300; cycle++) {
+        int i = 0;
+        int k = 0;
+        int r = 0;
+        
+        swap_banks(&p);
+        p.clock += 1 + cycle % 13;
+        seed = seed * 1103515245 + 12345;
+        if ((seed >> 4) % 3 == 0) {
+            in[(seed >> 8) % 8] = seed >> 16;
+        }
+        memcpy(p.inputs, in, 8);
+        if ((seed >> 4) % 5 == 0) {
+            plc_force(&p, OP_REAL_INPUT, 0, ((seed >> 8) % 2) ? "1.5" : "2.5");
+        }
+        manage_timers(&p);
+        manage_blinkers(&p);
+        read_mvars(&p);
+        dec_inp(&p);
+        //a program touching a few registers
+        for (k = 0; k < 3; k++) {
+            seed = seed * 1103515245 + 12345;
+            i = (seed >> 8) % 8;
+            ins.byte = i;
+            ins.bit = 0;
+            switch ((seed >> 16) % 9) {
+                case 0:
+                    ins.operand = OP_CONTACT;
+                    ins.bit = (seed >> 20) % 8;
+                    st_out(&ins, (seed >> 24) % 2, &p);
+                    break;
+                case 1:
+                    ins.byte = i % 2;
+                    st_out_r(&ins, 0.5 * ((seed >> 20) % 4), &p);
+                    break;
+                case 2:
+                    ins.operand = OP_MEMORY;
+                    ins.bit = BYTESIZE;
+                    st_mem(&ins, (seed >> 20) % 4, &p);
+                    break;
+                case 3:
+                    ins.operand = OP_MEMORY;
+                    st_mem(&ins, (seed >> 20) % 2, &p);
+                    break;
+                case 4:
+                    ins.operand = OP_PULSEIN;
+                    ins.operation = ((seed >> 20) % 2) ? IL_SET : IL_RESET;
+                    handle_set(&ins, acc, FALSE, &p);
+                    handle_reset(&ins, acc, FALSE, &p);
+                    break;
+                case 5:
+                    st_mem_r(&ins, 0.5 * ((seed >> 20) % 4), &p);
+                    break;
+                case 6:
+                    ins.byte = 0;
+                    ins.operand = OP_START;
+                    ins.operation = ((seed >> 20) % 2) ? IL_SET : IL_RESET;
+                    handle_set(&ins, acc, TRUE, &p);
+                    handle_reset(&ins, acc, TRUE, &p);
+                    break;
+                case 7:
+                    plc_configure_timer_preset(&p, i % 2, ((seed >> 20) % 2) ? "3" : "40");
+                    break;
+                default: //idle
+                    break;
+            }
+        }
+        enc_out(&p);
+        check_pulses(&p);
+        write_mvars(&p);
+        collect_changes(&p);
+        
+        double now[N_REG][64];
+        memset(now, 0, sizeof(now));
+        for (i = 0; i < 64; i++) {
+            now[REG_DI][i] = plc_get_di_val(&p, i);
+            now[REG_DQ][i] = (p.outputs[i / BYTESIZE] >> (i % BYTESIZE)) & 1;
+        }
+        for (i = 0; i < 2; i++) {
+            now[REG_AI][i] = p.ai[i].V;
+            now[REG_AQ][i] = p.aq[i].V;
+            now[REG_T][i] = p.t[i].Q;
+            now[REG_S][i] = p.s[i].Q;
+        }
+        for (i = 0; i < 8; i++) {
+            now[REG_M][i] = p.m[i].V;
+            now[REG_MR][i] = p.mr[i].V;
+        }
+        //exactly the registers that differ, each once
+        int differ = 0;
+        for (r = 0; r < N_REG; r++) {
+            for (i = 0; i < n[r]; i++) {
+                differ += now[r][i] != ref[r][i];
+            }
+        }
+        unsigned int it = 0;
+        const struct change *c = NULL;
+        while ((c = plc_next_change(&p, &it)) != NULL) {
+            double v = (c->reg == REG_AI || c->reg == REG_AQ || c->reg == REG_MR) 
+                     ? c->r : c->u;
+            CU_ASSERT(c->reg < N_REG);
+            CU_ASSERT(now[c->reg][c->index] == v);
+            CU_ASSERT(ref[c->reg][c->index] != v);
+            ref[c->reg][c->index] = v;
+            differ--;
+        }
+        CU_ASSERT(differ == 0);
+        CU_ASSERT(it == p.chg.size);
+    }
+    CU_ASSERT_PTR_NULL(plc_next_change(NULL, NULL));
+    
+    deinit_mock_plc(&p);
+}
+
+extern int Mock_wait_count;
+extern long Mock_wait_ms;
+void plc_destroy_rungs(const plc_t p);
+
+void ut_tickless() {
+    struct PLC_regs p;
+    init_mock_plc(&p);
+    p.step = 1;
+    Mock_wait_count = 0;
+    
+    plc_set_tickless(&p, TRUE);
+    plc_configure_pulse_scale(&p, 1, "500");
+    plc_start(&p);
+    CU_ASSERT(p.status == ST_RUNNING);
+    CU_ASSERT(p.periodic == FALSE);
+    //scan while something changes: the stub raises all inputs
+    plc_func(&p);
+    CU_ASSERT(p.quiet == FALSE);
+    plc_func(&p);
+    CU_ASSERT(Mock_wait_count == 0);
+    CU_ASSERT(p.quiet == TRUE);
+    //then sleep until the blinker is due, or an input event
+    plc_func(&p);
+    CU_ASSERT(Mock_wait_count == 1);
+    CU_ASSERT(Mock_wait_ms > 0 && Mock_wait_ms <= 500);
+    //forcing is scanned at once
+    plc_force(&p, OP_INPUT, 3, "0");
+    plc_func(&p);
+    CU_ASSERT(Mock_wait_count == 1);
+    CU_ASSERT(plc_get_di_val(&p, 3) == 0);
+    plc_func(&p);
+    CU_ASSERT(Mock_wait_count == 1);
+    plc_func(&p);
+    CU_ASSERT(Mock_wait_count == 2);
+    //nothing due: wait for an input indefinitely
+    plc_configure_pulse_scale(&p, 1, "0");
+    plc_func(&p);
+    CU_ASSERT(Mock_wait_count == 3);
+    CU_ASSERT(Mock_wait_ms < 0);
+    //disabled
+    plc_set_tickless(&p, FALSE);
+    plc_func(&p);
+    CU_ASSERT(Mock_wait_count == 3);
+    plc_set_tickless(&p, TRUE);
+    plc_stop(&p);
+    //a program reading analog inputs is scanned every cycle
+    struct instruction ins;
+    memset(&ins, 0, sizeof(struct instruction));
+    ins.operation = IL_LD;
+    ins.operand = OP_REAL_INPUT;
+    append(&ins, plc_mk_rung("analog", &p));
+    plc_start(&p);
+    CU_ASSERT(p.periodic == TRUE);
+    plc_func(&p);
+    plc_func(&p);
+    plc_func(&p);
+    CU_ASSERT(Mock_wait_count == 3);
+    
+    plc_stop(&p);
+    plc_destroy_rungs(&p);
+    deinit_mock_plc(&p);
+}
+
+int run_tasks(plc_t p);
+
+void ut_tasks() {
+    struct PLC_regs p;
+    init_mock_plc(&p);
+    p.step = 5;
+    p.clock = 0;
+    struct instruction ins;
+    int i = 0;
+    //rung i: LD %I0.i ST %Q0.i, and all of them ST %Q0.7
+    for (; i < 3; i++) {
+        rung_t r = plc_mk_rung("task", &p);
+        memset(&ins, 0, sizeof(struct instruction));
+        ins.operation = IL_LD;
+        ins.operand = OP_INPUT;
+        ins.bit = i;
+        append(&ins, r);
+        memset(&ins, 0, sizeof(struct instruction));
+        ins.operation = IL_ST;
+        ins.operand = OP_CONTACT;
+        ins.bit = i;
+        append(&ins, r);
+        ins.bit = 7;
+        append(&ins, r);
+    }
+    //a slow task declared before a fast one
+    plc_configure_rung_task(&p, 1, "2");
+    plc_configure_rung_task(&p, 2, "1");
+    plc_configure_task_period(&p, 2, "10");
+    plc_configure_task_period(&p, 1, "30");
+    CU_ASSERT(p.status == ST_STOPPED);
+    plc_configure_rung_task(&p, 0, "8");
+    CU_ASSERT(p.status == PLC_ERR_BADINDEX);
+    p.status = ST_STOPPED;
+    CU_ASSERT(p.tasks[0].rungs == 1);
+    CU_ASSERT(p.tasks[1].rungs == 1);
+    CU_ASSERT(p.tasks[2].rungs == 1);
+    //every cycle, then rate monotonic
+    int at[MAXTASK];
+    for (i = 0; i < MAXTASK; i++) {
+        at[p.task_order[i]] = i;
+    }
+    CU_ASSERT(at[0] < at[2]);
+    CU_ASSERT(at[2] < at[1]);
+    
+    BIT_ASSIGN(p.di.I, 0, TRUE);
+    BIT_ASSIGN(p.di.I, 1, TRUE);
+    BIT_ASSIGN(p.di.I, 2, TRUE);
+    int cycle = 0;
+    for (; cycle < 40; cycle++) {
+        p.clock = cycle * 5;
+        p.dq.Q[0] = 0;
+        CU_ASSERT(run_tasks(&p) == PLC_OK);
+        CU_ASSERT(BIT_GET(p.dq.Q, 0) == TRUE);
+        CU_ASSERT(BIT_GET(p.dq.Q, 1) == (p.clock % 10 == 0));
+        CU_ASSERT(BIT_GET(p.dq.Q, 2) == (p.clock % 30 == 0));
+    }
+    CU_ASSERT(p.tasks[2].overruns == 0);
+    //the last task to run has the last word
+    BIT_ASSIGN(p.di.I, 2, FALSE);
+    p.clock = 210;
+    run_tasks(&p);
+    CU_ASSERT(BIT_GET(p.dq.Q, 7) == FALSE);
+    plc_configure_task_priority(&p, 2, "1");
+    CU_ASSERT(p.task_order[MAXTASK - 1] == 2);
+    p.clock = 240;
+    run_tasks(&p);
+    CU_ASSERT(BIT_GET(p.dq.Q, 7) == TRUE);
+    //late runs are skipped and counted
+    unsigned int overruns = p.tasks[2].overruns;
+    p.clock = 1000;
+    run_tasks(&p);
+    CU_ASSERT(p.tasks[2].overruns == overruns + 1);
+    CU_ASSERT(p.tasks[2].due == 1010);
+    p.clock = 1010;
+    run_tasks(&p);
+    CU_ASSERT(p.tasks[2].overruns == overruns + 1);
+    CU_ASSERT(p.tasks[2].due == 1020);
+    
+    plc_destroy_rungs(&p);
+    deinit_mock_plc(&p);
+}
+
+static void count_job(void *arg, unsigned int i) {
+    unsigned int *hits = (unsigned int*) arg;
+    
+    __atomic_fetch_add(&hits[i], 1, __ATOMIC_RELAXED);
+}
+
+void ut_pool() {
+    unsigned int hits[100];
+    pool_t pool = pool_new(1);
+    //one thread is the caller alone
+    CU_ASSERT_PTR_NULL(pool);
+    memset(hits, 0, sizeof(hits));
+    pool_run(pool, count_job, hits, 100);
+    int i = 0;
+    for (; i < 100; i++) {
+        CU_ASSERT(hits[i] == 1);
+    }
+    pool = pool_new(4);
+    CU_ASSERT_PTR_NOT_NULL(pool);
+    CU_ASSERT(pool->n == 3);
+    int batch = 0;
+    for (; batch < 50; batch++) {
+        pool_run(pool, count_job, hits, 1 + batch % 100);
+    }
+    for (i = 0; i < 100; i++) {
+        CU_ASSERT(hits[i] == 1 + (i < 50 ? 50 - i : 0));
+    }
+    pool_run(pool, count_job, hits, 0);
+    pool_free(pool);
+}
+
+static rung_t mk_copy_rung(plc_t p, unsigned int from, unsigned int to) {
+    //LD %I0.from ST %Q0.to
+    struct instruction ins;
+    rung_t r = plc_mk_rung("copy", p);
+    memset(&ins, 0, sizeof(struct instruction));
+    ins.operation = IL_LD;
+    ins.operand = OP_INPUT;
+    ins.byte = from / BYTESIZE;
+    ins.bit = from % BYTESIZE;
+    append(&ins, r);
+    memset(&ins, 0, sizeof(struct instruction));
+    ins.operation = IL_ST;
+    ins.operand = OP_CONTACT;
+    ins.byte = to / BYTESIZE;
+    ins.bit = to % BYTESIZE;
+    append(&ins, r);
+    return r;
+}
+
+void ut_parallel() {
+    struct PLC_regs p;
+    init_mock_plc(&p);
+    p.step = 5;
+    p.clock = 0;
+    struct instruction ins;
+    int i = 0;
+    //rungs 0, 1 write the same word of outputs, 
+    //rung 2 reads it, rung 3 only writes a counter
+    mk_copy_rung(&p, 0, 0);
+    mk_copy_rung(&p, 1, 1);
+    rung_t r = plc_mk_rung("feedback", &p);
+    memset(&ins, 0, sizeof(struct instruction));
+    ins.operation = IL_LD;
+    ins.operand = OP_OUTPUT;
+    append(&ins, r);
+    memset(&ins, 0, sizeof(struct instruction));
+    ins.operation = IL_ST;
+    ins.operand = OP_REAL_CONTACT;
+    append(&ins, r);
+    r = plc_mk_rung("count", &p);
+    memset(&ins, 0, sizeof(struct instruction));
+    ins.operation = IL_LD;
+    ins.operand = OP_INPUT;
+    append(&ins, r);
+    memset(&ins, 0, sizeof(struct instruction));
+    ins.operation = IL_SET;
+    ins.operand = OP_PULSEIN;
+    append(&ins, r);
+    plc_configure_workers(&p, "4");
+    plc_start(&p);
+    CU_ASSERT_PTR_NOT_NULL(p.pool);
+    CU_ASSERT(p.rung_level[0] == 0);
+    CU_ASSERT(p.rung_level[1] == 1);
+    CU_ASSERT(p.rung_level[2] == 2);
+    CU_ASSERT(p.rung_level[3] == 0);
+    //reads do not conflict
+    CU_ASSERT(p.par_rung[0] == 0);
+    CU_ASSERT(p.par_rung[1] == 3);
+    CU_ASSERT(p.par_rung[2] == 1);
+    CU_ASSERT(p.par_rung[3] == 2);
+    plc_stop(&p);
+    CU_ASSERT_PTR_NULL(p.pool);
+    plc_destroy_rungs(&p);
+    deinit_mock_plc(&p);
+    //every input to outputs spread over 4 words, so that rungs 
+    //writing different words run concurrently
+    init_mock_plc(&p);
+    deallocate(&p);
+    p.nq = 32;
+    allocate(&p);
+    p.step = 5;
+    for (i = 0; i < 64; i++) {
+        mk_copy_rung(&p, i, 4 * i);
+    }
+    for (i = 0; i < 16; i++) {
+        mk_copy_rung(&p, i, 4 * i + 1);
+    }
+    plc_configure_workers(&p, "4");
+    plc_start(&p);
+    CU_ASSERT(p.rung_level[1] == 1);
+    CU_ASSERT(p.rung_level[16] == 0);
+    int cycle = 0;
+    int done = 0;
+    for (; cycle < 100; cycle++) {
+        uint64_t seq[4];
+        pool_t pool = p.pool;
+        int rv = PLC_OK;
+        p.di.I[0] = ((uint64_t) rand() << 32) | rand();
+        p.pool = NULL;
+        rv = run_tasks(&p);
+        memcpy(seq, p.dq.Q, sizeof(seq));
+        memset(p.dq.Q, 0, sizeof(seq));
+        p.pool = pool;
+        if (rv != PLC_OK || run_tasks(&p) != PLC_OK) {
+            continue; //preempted past the cycle: nothing to compare
+        }
+        done++;
+        CU_ASSERT(memcmp(seq, p.dq.Q, sizeof(seq)) == 0);
+        for (i = 0; i < 64; i++) {
+            CU_ASSERT(BIT_GET(p.dq.Q, 4 * i) == BIT_GET(p.di.I, i));
+            CU_ASSERT(BIT_GET(p.dq.Q, 4 * i + 1) == (i < 16 && BIT_GET(p.di.I, i)));
+        }
+    }
+    CU_ASSERT(done > 0);
+    //levels that spend the budget stop the task before the last ones
+    plc_configure_task_watchdog(&p, 0, "1");
+    p.di.I[0] = ~0ULL;
+    memset(p.dq.Q, 0, 4 * sizeof(uint64_t));
+    CU_ASSERT(run_tasks(&p) == PLC_ERR_TIMEOUT);
+    CU_ASSERT(BIT_GET(p.dq.Q, 4 * 63) == 0);
+    CU_ASSERT(BIT_GET(p.dq.Q, 4 * 15 + 1) == 0);
+    plc_stop(&p);
+    plc_destroy_rungs(&p);
+    deinit_mock_plc(&p);
+}
+
+static int own_helper(hardware_t hw) {
+    return PLC_OK;
+}
+
+static void own_dio_read(hardware_t hw, unsigned int n, PLC_BYTE *bit) {
+    *bit = *(PLC_BYTE*) hw->priv; //every instance reads its own input
+}
+
+static void own_dio_write(hardware_t hw, const unsigned char *buf, unsigned int n, PLC_BYTE bit) {
+}
+
+static void own_data_read(hardware_t hw, unsigned int index, uint64_t *value) {
+    *value = 0;
+}
+
+static void own_data_write(hardware_t hw, unsigned int index, uint64_t value) {
+}
+
+void ut_host() {
+    struct PLC_regs p[4];
+    struct hardware hw[4];
+    PLC_BYTE in[4];
+    struct instruction ins;
+    int i = 0;
+    
+    CU_ASSERT_PTR_NULL(plc_new_host(0));
+    host_t h = plc_new_host(2);
+    CU_ASSERT_PTR_NOT_NULL(h);
+    for (; i < 4; i++) {
+        init_mock_plc(&p[i]);
+        hw[i] = Hw_stub;
+        hw[i].enable = own_helper;
+        hw[i].disable = own_helper;
+        hw[i].fetch = own_helper;
+        hw[i].flush = own_helper;
+        hw[i].dio_read = own_dio_read;
+        hw[i].dio_write = own_dio_write;
+        hw[i].data_read = own_data_read;
+        hw[i].data_write = own_data_write;
+        in[i] = i % 2;
+        hw[i].priv = &in[i];
+        p[i].hw = &hw[i];
+        p[i].step = 2 + i;
+        //LD %I0.0 ST %Q0.0
+        rung_t r = plc_mk_rung("echo", &p[i]);
+        memset(&ins, 0, sizeof(struct instruction));
+        ins.operation = IL_LD;
+        ins.operand = OP_INPUT;
+        append(&ins, r);
+        memset(&ins, 0, sizeof(struct instruction));
+        ins.operation = IL_ST;
+        ins.operand = OP_CONTACT;
+        append(&ins, r);
+        plc_start(&p[i]);
+        CU_ASSERT(plc_host_add(h, &p[i]) == PLC_OK);
+    }
+    CU_ASSERT(plc_host_start(h) == PLC_OK);
+    CU_ASSERT(plc_host_add(h, &p[0]) == PLC_ERR);
+    CU_ASSERT(plc_host_start(h) == PLC_ERR);
+    usleep(100 * THOUSAND);
+    plc_host_stop(h);
+    //every PLC kept its own cycle time and its own state
+    for (i = 0; i < 4; i++) {
+        unsigned int expected = 100 / p[i].step;
+        CU_ASSERT(h->plcs[i].scans + h->plcs[i].overruns >= expected / 2);
+        CU_ASSERT(h->plcs[i].scans <= expected + 2);
+        CU_ASSERT(plc_get_dq_val(&p[i], 0) == i % 2);
+    }
+    //can be restarted
+    unsigned int scans = h->plcs[0].scans;
+    CU_ASSERT(plc_host_start(h) == PLC_OK);
+    usleep(20 * THOUSAND);
+    plc_host_stop(h);
+    CU_ASSERT(h->plcs[0].scans > scans);
+    plc_free_host(h);
+    CU_ASSERT(p[0].status == ST_RUNNING);
+    for (i = 0; i < 4; i++) {
+        plc_stop(&p[i]);
+        plc_destroy_rungs(&p[i]);
+        deinit_mock_plc(&p[i]);
+    }
+}
+
+static void *post_writes(void *arg) {
+    plc_t p = (plc_t) arg;
+    static int next = 0;
+    int id = __atomic_fetch_add(&next, 1, __ATOMIC_RELAXED) % 4;
+    char val[MAXSTR];
+    int i = 1;
+    
+    for (; i <= 1000; i++) {
+        sprintf(val, "%d", i);
+        while (plc_post(p, REQ_WRITE, OP_MEMORY, id, val) != PLC_OK) {
+            sched_yield(); //full, retry
+        }
+    }
+    return NULL;
+}
+
+void ut_requests() {
+    struct PLC_regs p;
+    init_mock_plc(&p);
+    p.step = 1;
+    
+    CU_ASSERT(plc_post(&p, REQ_FORCE, OP_INPUT, 3, NULL) == PLC_ERR);
+    CU_ASSERT(plc_post(&p, REQ_FORCE, OP_MEMORY, 3, "1") == PLC_ERR_BADOPERAND);
+    CU_ASSERT(plc_post(&p, REQ_WRITE, OP_INPUT, 3, "1") == PLC_ERR_BADOPERAND);
+    CU_ASSERT(plc_post(&p, N_REQ, OP_INPUT, 3, "1") == PLC_ERR_BADOPERAND);
+    CU_ASSERT(plc_post(&p, REQ_FORCE, OP_INPUT, 64, "1") == PLC_ERR_BADINDEX);
+    CU_ASSERT(plc_post(&p, REQ_WRITE, OP_REAL_MEMORY, 8, "1") == PLC_ERR_BADINDEX);
+    //applied at the next cycle, in order
+    CU_ASSERT(plc_post(&p, REQ_FORCE, OP_INPUT, 3, "0") == PLC_OK);
+    CU_ASSERT(plc_post(&p, REQ_FORCE, OP_OUTPUT, 2, "1") == PLC_OK);
+    CU_ASSERT(plc_post(&p, REQ_UNFORCE, OP_OUTPUT, 2, NULL) == PLC_OK);
+    CU_ASSERT(plc_post(&p, REQ_WRITE, OP_REAL_MEMORY, 1, "2.5") == PLC_OK);
+    CU_ASSERT(plc_is_forced(&p, OP_INPUT, 3) == FALSE);
+    plc_start(&p);
+    plc_scan(&p);
+    CU_ASSERT(plc_is_forced(&p, OP_INPUT, 3) == TRUE);
+    CU_ASSERT(plc_get_di_val(&p, 3) == 0);
+    CU_ASSERT(plc_is_forced(&p, OP_OUTPUT, 2) == FALSE);
+    CU_ASSERT(p.mr[1].V == 2.5);
+    //bounded
+    int i = 0;
+    for (; i < QUEUE_SIZE; i++) {
+        CU_ASSERT(plc_post(&p, REQ_UNFORCE, OP_INPUT, 3, NULL) == PLC_OK);
+    }
+    CU_ASSERT(plc_post(&p, REQ_UNFORCE, OP_INPUT, 3, NULL) == PLC_ERR);
+    CU_ASSERT(p.requests->dropped == 1);
+    plc_scan(&p);
+    CU_ASSERT(plc_is_forced(&p, OP_INPUT, 3) == FALSE);
+    //several threads writing while the plc scans
+    pthread_t threads[4];
+    for (i = 0; i < 4; i++) {
+        pthread_create(&threads[i], NULL, post_writes, &p);
+    }
+    uint64_t last[4] = {0, 0, 0, 0};
+    int done = FALSE;
+    while (!done) {
+        plc_scan(&p);
+        done = TRUE;
+        for (i = 0; i < 4; i++) {
+            CU_ASSERT(p.m[i].V >= last[i]); //each thread's writes in order
+            last[i] = p.m[i].V;
+            done = done && last[i] == 1000;
+        }
+    }
+    for (i = 0; i < 4; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    plc_stop(&p);
+    deinit_mock_plc(&p);
+}
+
+struct reader {
+    plc_t p;
+    int stop;
+    unsigned int reads;
+    unsigned int torn;   // images whose registers disagree
+    unsigned int behind; // images older than the one read before
+};
+
+static void *read_snapshots(void *arg) {
+    struct reader *r = (struct reader*) arg;
+    snapshot_t s = plc_new_snapshot(r->p);
+    uint64_t cycle = 0;
+    
+    while (!__atomic_load_n(&r->stop, __ATOMIC_ACQUIRE)) {
+        plc_read_snapshot(r->p, s);
+        r->reads++;
+        if (s->m[0] != s->m[1] || s->mr[0] != (double) s->m[0]) {
+            r->torn++;
+        }
+        if (s->cycle < cycle) {
+            r->behind++;
+        }
+        cycle = s->cycle;
+    }
+    plc_free_snapshot(s);
+    return NULL;
+}
+
+void ut_snapshot() {
+    struct PLC_regs p;
+    init_mock_plc(&p);
+    p.step = 1;
+    CU_ASSERT_PTR_NULL(plc_new_snapshot(NULL));
+    snapshot_t s = plc_new_snapshot(&p);
+    CU_ASSERT_PTR_NOT_NULL(s);
+    CU_ASSERT(plc_read_snapshot(NULL, s) == PLC_ERR);
+    //nothing published yet
+    CU_ASSERT(plc_read_snapshot(&p, s) == PLC_OK);
+    CU_ASSERT(s->cycle == 0);
+    CU_ASSERT(s->m[7] == 0);
+    
+    plc_configure_io_limit(&p, OP_REAL_INPUT, 1, "0.0", FALSE);
+    plc_configure_io_limit(&p, OP_REAL_INPUT, 1, "10.0", TRUE);
+    plc_start(&p);
+    p.m[7].V = 77;
+    p.mr[7].V = -7.5;
+    p.t[1].P = 1000;
+    p.t[1].START = TRUE;
+    p.t[1].ONDELAY = FALSE;
+    p.s[1].Q = TRUE;
+    plc_force(&p, OP_INPUT, 9, "1");
+    plc_force(&p, OP_REAL_INPUT, 1, "5.0");
+    plc_scan(&p);
+    plc_scan(&p);
+    //as of the end of the cycle
+    CU_ASSERT(plc_read_snapshot(&p, s) == PLC_OK);
+    CU_ASSERT(s->cycle == 2);
+    CU_ASSERT(s->m[7] == 77);
+    CU_ASSERT(s->mr[7] == -7.5);
+    CU_ASSERT(((s->di[0] >> 9) & 1) == 1);
+    CU_ASSERT(s->ai[1] == p.ai[1].V);
+    CU_ASSERT(s->dq[0] == p.dq.Q[0]);
+    CU_ASSERT(s->s_q[0] == 2);
+    CU_ASSERT(s->t[1] == plc_get_t_val(&p, 1));
+    CU_ASSERT(((s->t_q[0] >> 1) & 1) == p.t[1].Q);
+    //readers copy consistent images while the plc scans
+    struct reader r;
+    pthread_t threads[2];
+    memset(&r, 0, sizeof(struct reader));
+    r.p = &p;
+    struct reader r2 = r;
+    pthread_create(&threads[0], NULL, read_snapshots, &r);
+    pthread_create(&threads[1], NULL, read_snapshots, &r2);
+    int i = 0;
+    for (; i < 20000; i++) {
+        p.m[0].V = i;
+        p.m[1].V = i;
+        p.mr[0].V = i;
+        plc_scan(&p);
+    }
+    __atomic_store_n(&r.stop, TRUE, __ATOMIC_RELEASE);
+    __atomic_store_n(&r2.stop, TRUE, __ATOMIC_RELEASE);
+    pthread_join(threads[0], NULL);
+    pthread_join(threads[1], NULL);
+    CU_ASSERT(r.reads > 0);
+    CU_ASSERT(r.torn == 0);
+    CU_ASSERT(r.behind == 0);
+    CU_ASSERT(r2.torn == 0);
+    CU_ASSERT(r2.behind == 0);
+    
+    plc_stop(&p);
+    plc_free_snapshot(s);
+    deinit_mock_plc(&p);
+}
+
+void ut_shared() {
+    struct PLC_regs p;
+    char name[32];
+    init_mock_plc(&p);
+    p.step = 1;
+    sprintf(name, "/ut-plc-%d", getpid());
+    CU_ASSERT_PTR_NULL(plc_attach(name));
+    //a segment left behind is not taken over
+    int fd = shm_open(name, O_CREAT | O_RDWR, 0660);
+    CU_ASSERT(fd >= 0);
+    close(fd);
+    plc_share(&p, name);
+    CU_ASSERT(p.status == PLC_ERR);
+    CU_ASSERT_PTR_NULL(p.shm.header);
+    p.status = 0;
+    shm_unlink(name);
+    
+    plc_share(&p, name);
+    CU_ASSERT(p.status != PLC_ERR);
+    CU_ASSERT_PTR_NOT_NULL(p.shm.header);
+    //sharing twice is an error
+    plc_share(&p, name);
+    CU_ASSERT(p.status == PLC_ERR);
+    p.status = 0;
+    //and so is sharing a live name
+    struct PLC_regs q;
+    init_mock_plc(&q);
+    plc_share(&q, name);
+    CU_ASSERT(q.status == PLC_ERR);
+    CU_ASSERT_PTR_NULL(q.shm.header);
+    deinit_mock_plc(&q);
+    
+    shared_header_t h = plc_attach(name);
+    CU_ASSERT_PTR_NOT_NULL(h);
+    if (h == NULL) {
+        deinit_mock_plc(&p);
+        return;
+    }
+    CU_ASSERT(h->magic == SHARED_MAGIC);
+    CU_ASSERT(h->version == SHARED_VERSION);
+    CU_ASSERT(h->words == p.image.size);
+    CU_ASSERT(h->nm == p.nm);
+    CU_ASSERT_PTR_NULL(plc_new_shared_snapshot(NULL));
+    snapshot_t s = plc_new_shared_snapshot(h);
+    CU_ASSERT_PTR_NOT_NULL(s);
+    snapshot_t local = plc_new_snapshot(&p);
+    CU_ASSERT(plc_read_shared_snapshot(h, local) == PLC_OK);
+    CU_ASSERT(plc_read_shared_snapshot(NULL, s) == PLC_ERR);
+    
+    plc_start(&p);
+    p.m[7].V = 77;
+    p.mr[7].V = -7.5;
+    plc_scan(&p);
+    //the attached image is the one the plc publishes
+    CU_ASSERT(plc_read_shared_snapshot(h, s) == PLC_OK);
+    CU_ASSERT(s->cycle == 1);
+    CU_ASSERT(s->m[7] == 77);
+    CU_ASSERT(s->mr[7] == -7.5);
+    CU_ASSERT(plc_read_snapshot(&p, local) == PLC_OK);
+    CU_ASSERT(memcmp(s->di, local->di, s->size * sizeof(uint64_t)) == 0);
+    
+    //writes go through the shared ring
+    CU_ASSERT(plc_shared_post(NULL, REQ_WRITE, OP_MEMORY, 3, "42") == PLC_ERR);
+    CU_ASSERT(plc_shared_post(h, REQ_WRITE, OP_INPUT, 3, "42") == PLC_ERR_BADOPERAND);
+    CU_ASSERT(plc_shared_post(h, REQ_WRITE, OP_MEMORY, 8, "42") == PLC_ERR_BADINDEX);
+    CU_ASSERT(plc_shared_post(h, REQ_WRITE, OP_MEMORY, 3, "42") == PLC_OK);
+    CU_ASSERT(plc_shared_post(h, REQ_FORCE, OP_INPUT, 5, "1") == PLC_OK);
+    CU_ASSERT(plc_post(&p, REQ_WRITE, OP_REAL_MEMORY, 2, "2.5") == PLC_OK);
+    plc_scan(&p);
+    CU_ASSERT(p.m[3].V == 42);
+    CU_ASSERT(p.mr[2].V == 2.5);
+    CU_ASSERT(plc_is_forced(&p, OP_INPUT, 5) == TRUE);
+    CU_ASSERT(plc_read_shared_snapshot(h, s) == PLC_OK);
+    CU_ASSERT(s->m[3] == 42);
+    CU_ASSERT(((s->di[0] >> 5) & 1) == 1);
+    
+    plc_stop(&p);
+    plc_free_snapshot(s);
+    plc_free_snapshot(local);
+    plc_detach(h);
+    deinit_mock_plc(&p);
+    //unlinked with the plc
+    CU_ASSERT_PTR_NULL(plc_attach(name));
+}
+
+static uint64_t Hsc_count = 0;
+static unsigned int Hsc_reads = 0;
+
+static int hsc_count(hardware_t hw, unsigned int n, uint64_t *count) {
+    if (n != 9) { //only input 9 is counted by the hardware
+        return PLC_ERR;
+    }
+    *count = Hsc_count;
+    return PLC_OK;
+}
+
+static void hsc_dio_read(hardware_t hw, unsigned int n, PLC_BYTE *bit) {
+    //input 5 toggles at every read
+    unsigned int reads = __atomic_add_fetch(&Hsc_reads, n == 5, __ATOMIC_RELAXED);
+    *bit = (n == 5) ? reads % 2 : 0;
+}
+
+void ut_fast_counter() {
+    struct PLC_regs p;
+    init_mock_plc(&p);
+    struct hardware hw = *p.hw;
+    hw.count = hsc_count;
+    hw.dio_read = hsc_dio_read;
+    p.hw = &hw;
+    p.step = 1;
+    
+    plc_configure_fast_counter(&p, 8, "1");
+    CU_ASSERT(p.status == PLC_ERR_BADINDEX);
+    p.status = 0;
+    plc_configure_fast_counter(&p, 1, "64");
+    CU_ASSERT(p.status == PLC_ERR_BADINDEX);
+    p.status = 0;
+    plc_configure_counter_poll(&p, "-1");
+    CU_ASSERT(p.status == PLC_ERR);
+    p.status = 0;
+    //counted by the hardware
+    plc_configure_fast_counter(&p, 1, "9");
+    plc_configure_fast_counter(&p, 2, "9");
+    plc_configure_counter_direction(&p, 2, "DOWN");
+    p.m[2].V = 100;
+    //the hardware cannot count input 3, it is counted by the scan
+    plc_configure_fast_counter(&p, 3, "3");
+    CU_ASSERT(p.status == 0);
+    CU_ASSERT(p.hsc.n == 3);
+    
+    Hsc_count = 1000; //counted before the start do not count
+    plc_start(&p);
+    CU_ASSERT(p.hsc.source[0] == COUNT_HARDWARE);
+    CU_ASSERT(p.hsc.source[2] == COUNT_SCAN);
+    CU_ASSERT(p.hsc.running == FALSE);
+    Hsc_count += 25; //between scans
+    plc_scan(&p);
+    CU_ASSERT(p.m[1].V == 25);
+    CU_ASSERT(p.m[2].V == 75);
+    CU_ASSERT(BIT_GET(p.m_dirty, 1) == 1);
+    Hsc_count += 5;
+    plc_scan(&p);
+    CU_ASSERT(p.m[1].V == 30);
+    CU_ASSERT(p.m[3].V == 0);
+    //scanned edges, one per rise of the scanned level
+    plc_force(&p, OP_INPUT, 3, "1");
+    plc_scan(&p);
+    plc_scan(&p);
+    CU_ASSERT(p.m[3].V == 1);
+    plc_unforce(&p, OP_INPUT, 3);
+    plc_stop(&p);
+    
+    //polled between scans
+    deinit_mock_plc(&p);
+    init_mock_plc(&p);
+    p.hw = &hw;
+    p.step = 1;
+    plc_configure_counter_poll(&p, "50");
+    plc_configure_fast_counter(&p, 4, "5");
+    plc_start(&p);
+    CU_ASSERT(p.hsc.source[0] == COUNT_POLL);
+    CU_ASSERT(p.hsc.running == TRUE);
+    usleep(20000);
+    plc_scan(&p);
+    CU_ASSERT(p.m[4].V > 1); //more than once per scan
+    plc_stop(&p);
+    CU_ASSERT(p.hsc.running == FALSE);
+    uint64_t counted = p.m[4].V;
+    usleep(2000);
+    plc_scan(&p);
+    CU_ASSERT(p.m[4].V == counted); //not while stopped
+    deinit_mock_plc(&p);
+}
+
+static PLC_BYTE *Hsc_buf = NULL;
+static pthread_mutex_t Hsc_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int hsc_fetch(hardware_t hw) {
+    //like the simulation in lock step: blocks for the plant, 
+    //then the input buffer moves, guarded by the backend itself
+    usleep(2000);
+    pthread_mutex_lock(&Hsc_lock);
+    free(Hsc_buf);
+    Hsc_buf = calloc(BYTESIZE, sizeof(PLC_BYTE));
+    pthread_mutex_unlock(&Hsc_lock);
+    return PLC_OK;
+}
+
+static void hsc_buf_read(hardware_t hw, unsigned int n, PLC_BYTE *bit) {
+    //input 5 toggles at every read
+    pthread_mutex_lock(&Hsc_lock);
+    if (n == 5) {
+        Hsc_buf[5] = !Hsc_buf[5];
+    }
+    *bit = Hsc_buf[n % BYTESIZE];
+    pthread_mutex_unlock(&Hsc_lock);
+}
+
+void ut_fast_counter_blocking() {
+    struct PLC_regs p;
+    int i = 0;
+    init_mock_plc(&p);
+    struct hardware hw = *p.hw;
+    hw.count = NULL;
+    hw.fetch = hsc_fetch;
+    hw.dio_read = hsc_buf_read;
+    hw.dio_read_bytes = NULL;
+    p.hw = &hw;
+    p.step = 1;
+    Hsc_buf = calloc(BYTESIZE, sizeof(PLC_BYTE));
+    
+    plc_configure_counter_poll(&p, "10");
+    plc_configure_fast_counter(&p, 1, "5");
+    plc_start(&p);
+    CU_ASSERT(p.hsc.running == TRUE);
+    for (; i < 20; i++) {
+        plc_scan(&p);
+    }
+    plc_stop(&p);
+    CU_ASSERT(p.hsc.running == FALSE);
+    //the poller kept counting while the scans blocked in fetch
+    CU_ASSERT(p.m[1].V > 2 * 20);
+    deinit_mock_plc(&p);
+    free(Hsc_buf);
+    Hsc_buf = NULL;
+}
+
 #endif //_UT_LIB_H_
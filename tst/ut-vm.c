@@ -2,6 +2,15 @@
 #include <stdlib.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/futex.h>
 
 #include "CUnit/Basic.h"
 #include "CUnit/Console.h"
@@ -11,6 +20,7 @@
 #include "instruction.h"
 #include "rung.h"
 #include "plclib.h"
+#include "host.h"
 
 #include "parser-tree.h"
 #include "parser-il.h"
@@ -80,7 +90,7 @@ int main() {
 
     // start_thread();
 //plclib
-    if (ADD_TEST(suite_lib, ut_codec) || ADD_TEST(suite_lib, ut_stack)
+    if (ADD_TEST(suite_lib, ut_codec) || ADD_TEST(suite_lib, ut_codec_wide) || ADD_TEST(suite_lib, ut_stack)
     || ADD_TEST(suite_lib, ut_type)
     || ADD_TEST(suite_lib, ut_operate)
     || ADD_TEST(suite_lib, ut_operate_b)
@@ -104,13 +114,30 @@ int main() {
     || ADD_TEST(suite_lib, ut_task_real)
     || ADD_TEST(suite_lib, ut_task_timeout)
     || ADD_TEST(suite_lib, ut_force)
+    || ADD_TEST(suite_lib, ut_timers)
+    || ADD_TEST(suite_lib, ut_wheel)
+    || ADD_TEST(suite_lib, ut_counters)
+    || ADD_TEST(suite_lib, ut_changes)
+    || ADD_TEST(suite_lib, ut_tickless)
+    || ADD_TEST(suite_lib, ut_tasks)
+    || ADD_TEST(suite_lib, ut_pool)
+    || ADD_TEST(suite_lib, ut_parallel)
+    || ADD_TEST(suite_lib, ut_host)
+    || ADD_TEST(suite_lib, ut_requests)
+    || ADD_TEST(suite_lib, ut_snapshot)
+    || ADD_TEST(suite_lib, ut_shared)
+    || ADD_TEST(suite_lib, ut_fast_counter)
+    || ADD_TEST(suite_lib, ut_fast_counter_blocking)
     ) {
         CU_cleanup_registry();
         return CU_get_error();
     }
 
 //I/O
-    if (ADD_TEST(suite_io, ut_read) || ADD_TEST(suite_io, ut_write)) {
+    if (ADD_TEST(suite_io, ut_read) || ADD_TEST(suite_io, ut_write)
+    || ADD_TEST(suite_io, ut_io_bytes) || ADD_TEST(suite_io, ut_io_edges)
+    || ADD_TEST(suite_io, ut_io_iio) || ADD_TEST(suite_io, ut_io_sim_shm)
+    || ADD_TEST(suite_io, ut_io_trace) || ADD_TEST(suite_io, ut_io_plugin)) {
         CU_cleanup_registry();
         return CU_get_error();
     }
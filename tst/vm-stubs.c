@@ -32,7 +32,7 @@ int project_init() {
     return 0;
 }
 
-void compute_variance(double x) {
+void compute_variance(variance_t v, double x) {
 }
 
 /********************stubbed hardware****************/
@@ -42,8 +42,10 @@ unsigned char Mock_dout = 0;
 int Mock_flush_count = 0;
 uint64_t Mock_ain = 0;
 uint64_t Mock_aout = 0;
+int Mock_wait_count = 0;
+long Mock_wait_ms = 0;
 
-int stub_enable() /* Enable bus communication */
+int stub_enable(hardware_t hw) /* Enable bus communication */
 {
     Mock_din = 0;
     Mock_ain = 0;
@@ -53,7 +55,7 @@ int stub_enable() /* Enable bus communication */
     return r;
 }
 
-int stub_enable_fails() /* Enable bus communication */
+int stub_enable_fails(hardware_t hw) /* Enable bus communication */
 {
     Mock_din = 0;
     Mock_ain = 0;
@@ -63,7 +65,7 @@ int stub_enable_fails() /* Enable bus communication */
     return r;
 }
 
-int stub_disable() /* Disable bus communication */
+int stub_disable(hardware_t hw) /* Disable bus communication */
 {
     Mock_aout = 0;
     Mock_dout = 0;
@@ -72,37 +74,43 @@ int stub_disable() /* Disable bus communication */
     return PLC_OK;
 }
 
-int stub_fetch() {
+int stub_fetch(hardware_t hw) {
     Mock_din = 1;
     Mock_ain = 0xABCDEF01;
     return PLC_OK;
 }
 
-int stub_flush() {
+int stub_flush(hardware_t hw) {
     Mock_flush_count = 1;
     return PLC_OK;
 }
 
-void stub_dio_read(unsigned int n, PLC_BYTE *bit) {
+void stub_dio_read(hardware_t hw, unsigned int n, PLC_BYTE *bit) {
     *bit = Mock_din;
 }
 
-void stub_dio_write(const unsigned char *buf, unsigned int n, unsigned char bit) {    //write bit to n output
+void stub_dio_write(hardware_t hw, const unsigned char *buf, unsigned int n, unsigned char bit) {    //write bit to n output
     if (n < 8)
         Mock_dout += (bit << n);
 }
 
-void stub_dio_bitfield(const unsigned char *mask, unsigned char *bits) {    //simultaneusly write output bits defined by mask and read all inputs
+void stub_dio_bitfield(hardware_t hw, const unsigned char *mask, unsigned char *bits, unsigned int n) {    //simultaneusly write output bits defined by mask and read all inputs
 }
 
-void stub_data_read(unsigned int index, uint64_t *value) {
+void stub_data_read(hardware_t hw, unsigned int index, uint64_t *value) {
     *value = Mock_ain;
 }
 
-void stub_data_write(unsigned int index, uint64_t value) {
+void stub_data_write(hardware_t hw, unsigned int index, uint64_t value) {
     Mock_aout = value;
 }
 
+int stub_wait(hardware_t hw, long ms) { //returns at once, as if an input event arrived
+    Mock_wait_count++;
+    Mock_wait_ms = ms;
+    return 1;
+}
+
 struct hardware Hw_stub = {
         HW_SIM,
         0, //errorcode
@@ -114,9 +122,17 @@ struct hardware Hw_stub = {
         stub_dio_read, //dio_read
         stub_dio_write, //dio_write
         stub_dio_bitfield, //dio_bitfield
+        NULL, //dio_read_bytes, a bit at a time
+        NULL, //dio_write_bytes
+        NULL, //dio_edges
+        NULL, //count
         stub_data_read, //data_read
         stub_data_write, //data_write
         NULL, //hw_config
+        stub_wait, //wait
+        NULL, //clock
+        NULL, //release
+        NULL, //priv
 };
 
 hardware_t plc_get_hardware(int type) {